@@ -2,7 +2,6 @@ import Foundation
 import FSKit
 import os
 import MotionCamModule
-import TinyDngModule
 
 final class McrawFSVolume: FSVolume {
     
@@ -12,74 +11,52 @@ final class McrawFSVolume: FSVolume {
     
     private let root: McrawRootItem
 
-    private let writer = tinydngwriter.DNGWriter(false)
-
     init(resource: FSResource) {
         self.resource = resource
         
-        do {
-            guard let resource = resource as? FSPathURLResource else {
-                exit(EXIT_FAILURE)
-            }
-            
-            let fileName = resource.url.deletingPathExtension().lastPathComponent
+        guard let resource = resource as? FSPathURLResource else {
+            exit(EXIT_FAILURE)
+        }
+        
+        let fileName = resource.url.deletingPathExtension().lastPathComponent
 
-            let ok = resource.url.startAccessingSecurityScopedResource()
-            guard ok else { exit(EXIT_FAILURE) }
-            
-            // 2. Convert to fileSystemRepresentation (null-terminated C string)
-            let filePath = (resource.url as NSURL).fileSystemRepresentation
+        let ok = resource.url.startAccessingSecurityScopedResource()
+        guard ok else { exit(EXIT_FAILURE) }
+        
+        // 2. Convert to fileSystemRepresentation (null-terminated C string)
+        let filePath = (resource.url as NSURL).fileSystemRepresentation
 
-            // 3. Open with fopen (for reading, change mode as needed)
-            let filePointer = fopen(filePath, "r")
-            guard filePointer != nil else {
-                resource.url.stopAccessingSecurityScopedResource()
-                exit(EXIT_FAILURE)
-            }
+        // 3. Open with fopen (for reading, change mode as needed)
+        let filePointer = fopen(filePath, "r")
+        guard filePointer != nil else {
+            resource.url.stopAccessingSecurityScopedResource()
+            exit(EXIT_FAILURE)
+        }
 
-            root = McrawRootItem(name: FSFileName(string: "/"), decoder: MotionCamModule.motioncam.Decoder(filePointer))
-            
-            let frameTimestamps = root.decoder.getFrames()
-            
-            let firstFrameMetadataJson = String(root.decoder.loadFrameMetadata(frameTimestamps.first!))
-            let firstFrameMetadata = try JSONDecoder().decode(FrameMetadata.self, from: firstFrameMetadataJson.data(using: .utf8)!)
+        root = McrawRootItem(name: FSFileName(string: "/"), decoder: MotionCamModule.motioncam.Decoder(filePointer))
+        
+        // Create a child McrawFrame for each frame timestamp
+        for index in 0..<root.decoder.numFrames() {
+            let timestamp = root.decoder.getFrameTimestamp(index)
+            let frameMetadata = MotionCamModule.motioncam.FrameMetadata.parse(root.decoder.loadFrameMetadata(timestamp))
+            let frameFileSize = UInt64(root.renderer.dngSize(frameMetadata))
             
-            let frameFileSize = UInt64(McrawFSVolume.getData(
-                timestamp: frameTimestamps.first!,
-                frameMetadata: firstFrameMetadata,
-                containerMetadata: root.containerMetadata,
-                writer: writer,
-                rootItem: root
-            ).count)
+            let nameString = "frame_\(index).dng"
+            let fileName = FSFileName(string: nameString)
             
-            // Create a child McrawFrame for each frame timestamp
-            for (index, timestamp) in frameTimestamps.enumerated() {
-                let frameMetadataJson = String(root.decoder.loadFrameMetadata(timestamp))
-                let frameMetadata = try JSONDecoder().decode(FrameMetadata.self, from: frameMetadataJson.data(using: .utf8)!)
-                
-                // now `data` holds the exact bytes from your CChar buffer
-                let nameString = "frame_\(index).dng"
-                let fileName = FSFileName(string: nameString)
-                
-                let frameItem = McrawFrame(name: fileName, timestamp: timestamp, metadata: frameMetadata, size: frameFileSize)
-                root.addItem(frameItem)
-            }
+            let frameItem = McrawFrame(name: fileName, timestamp: timestamp, metadata: frameMetadata, size: frameFileSize)
+            root.addItem(frameItem)
+        }
         
         super.init(
             volumeID: FSVolume.Identifier(uuid: UUID()),
             volumeName: FSFileName(string: fileName)
         )
-        } catch {
-            print("Decoding failed:", error)
-            exit(EXIT_FAILURE)
-        }
     }
     
     static func getData(
         timestamp: MotionCamModule.motioncam.Timestamp,
-        frameMetadata: FrameMetadata,
-        containerMetadata: ContainerMetadata,
-        writer: borrowing tinydngwriter.DNGWriter,
+        frameMetadata: MotionCamModule.motioncam.FrameMetadata,
         rootItem: McrawRootItem
     ) -> Data {
         os_unfair_lock_lock(&rootItem.cacheLock)
@@ -93,78 +70,13 @@ final class McrawFSVolume: FSVolume {
             }
         }
         
-        var outData = MotionCamModule.motioncam.FrameOutData()
-        rootItem.decoder.loadFrame(timestamp, &outData, frameMetadata.width, frameMetadata.height, frameMetadata.compressionType)
-
-        var dng = TinyDngModule.tinydngwriter.DNGImage()
-        dng.SetBigEndian(false);
-        dng.SetDNGVersion(1, 4, 0, 0);
-        dng.SetDNGBackwardVersion(1, 1, 0, 0);
-        dng.SetImageData(&outData);
-        dng.SetImageWidth(UInt32(frameMetadata.width));
-        dng.SetImageLength(UInt32(frameMetadata.height));
-        dng.SetPlanarConfig(UInt16(tinydngwriter.PLANARCONFIG_CONTIG));
-        dng.SetPhotometric(UInt16(tinydngwriter.PHOTOMETRIC_CFA));
-        dng.SetRowsPerStrip(UInt32(frameMetadata.height));
-        dng.SetSamplesPerPixel(1);
-        dng.SetCFARepeatPatternDim(2, 2);
+        // The renderer decodes the frame straight into the DNG, which Data then takes ownership of
+        let count = rootItem.renderer.dngSize(frameMetadata)
+        let dng = malloc(count)!.bindMemory(to: UInt8.self, capacity: count)
         
-        dng.SetBlackLevelRepeatDim(2, 2);
-        dng.SetBlackLevel(4, rootItem.containerMetadata.blackLevel);
-        dng.SetWhiteLevel(Int16(rootItem.containerMetadata.whiteLevel));
-        dng.SetCompression(UInt16(tinydngwriter.COMPRESSION_NONE));
-        
-        var cfa: MotionCamModule.motioncam.CFA
-        
-        if(rootItem.containerMetadata.sensorArrangement == "rggb") {
-            cfa = MotionCamModule.motioncam.CFA(arrayLiteral: 0, 1, 1, 2);
-        }
-        else if(rootItem.containerMetadata.sensorArrangement == "bggr") {
-            cfa = MotionCamModule.motioncam.CFA(arrayLiteral: 2, 1, 1, 0);
-        }
-        else if(rootItem.containerMetadata.sensorArrangement == "grbg") {
-            cfa = MotionCamModule.motioncam.CFA(arrayLiteral: 1, 0, 2, 1);
-        }
-        else if(rootItem.containerMetadata.sensorArrangement == "gbrg") {
-            cfa = MotionCamModule.motioncam.CFA(arrayLiteral: 1, 2, 0, 1);
-        } else {
-            cfa = MotionCamModule.motioncam.CFA(arrayLiteral: 1, 2, 0, 1);
-        }
-        
-        dng.SetCFAPattern(4, cfa);
-        
-        // Rectangular
-        dng.SetCFALayout(1);
-
-        dng.SetBitsPerSample();
-        
-        dng.SetColorMatrix1(3, rootItem.containerMetadata.colorMatrix1);
-        dng.SetColorMatrix2(3, rootItem.containerMetadata.colorMatrix2);
-        
-        dng.SetForwardMatrix1(3, rootItem.containerMetadata.forwardMatrix1);
-        dng.SetForwardMatrix2(3, rootItem.containerMetadata.forwardMatrix2);
-        
-        dng.SetAsShotNeutral(3, frameMetadata.asShotNeutral);
-        
-        dng.SetCalibrationIlluminant1(21);
-        dng.SetCalibrationIlluminant2(17);
-        
-        dng.SetUniqueCameraModel("MotionCam");
-        dng.SetSubfileType();
-        
-        var activeArea = motioncam.ActiveArea()
-        activeArea.push_back(0)
-        activeArea.push_back(0)
-        activeArea.push_back(UInt32(frameMetadata.height))
-        activeArea.push_back(UInt32(frameMetadata.width))
-        dng.SetActiveArea(activeArea)
-
-        var err = std.string()
-        var count = motioncam.Count()
-
-        let str = writer.WriteToFile(&dng, &err, &count)
+        rootItem.renderer.render(&rootItem.decoder, timestamp, frameMetadata, dng)
         
-        let data = Data(bytesNoCopy: UnsafeMutableRawPointer(mutating: str!), count: Int(count), deallocator: .free)
+        let data = Data(bytesNoCopy: dng, count: count, deallocator: .free)
 
         // 3) Insert into cache, popping oldest if needed
         if rootItem.frameCache.count >= rootItem.maxCacheFrames {
@@ -386,8 +298,6 @@ extension McrawFSVolume: FSVolume.ReadWriteOperations {
             let dng = McrawFSVolume.getData(
               timestamp: item.timestamp,
               frameMetadata: item.metadata,
-              containerMetadata: root.containerMetadata,
-              writer: writer,
               rootItem: root
             )
             
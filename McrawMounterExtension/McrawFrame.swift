@@ -9,9 +9,9 @@ final class McrawFrame: FSItem {
     let timestamp: MotionCamModule.motioncam.Timestamp
     
     let attributes = FSItem.Attributes()
-    let metadata: FrameMetadata
+    let metadata: MotionCamModule.motioncam.FrameMetadata
     
-    init(name: FSFileName, timestamp: MotionCamModule.motioncam.Timestamp, metadata: FrameMetadata, size: UInt64) {
+    init(name: FSFileName, timestamp: MotionCamModule.motioncam.Timestamp, metadata: MotionCamModule.motioncam.FrameMetadata, size: UInt64) {
         self.name = name
         self.timestamp = timestamp
         self.metadata = metadata
@@ -10,7 +10,7 @@ final class McrawRootItem: FSItem {
    
     private(set) var children: [FSFileName: McrawFrame] = [:]
     
-    var containerMetadata: ContainerMetadata
+    let renderer: MotionCamModule.motioncam.FrameRenderer
     
     var decoder: MotionCamModule.motioncam.Decoder
 
@@ -24,14 +24,8 @@ final class McrawRootItem: FSItem {
         self.name = name
         self.decoder = decoder
         
-        let containerMetadataJson = String(self.decoder.getContainerMetadata())
-        
-        do {
-            self.containerMetadata = try JSONDecoder().decode(ContainerMetadata.self, from: containerMetadataJson.data(using: .utf8)!)
-        } catch {
-            print("error decoding")
-            exit(EXIT_FAILURE)
-        }
+        let containerMetadata = MotionCamModule.motioncam.ContainerMetadata.parse(self.decoder.getContainerMetadata())
+        self.renderer = MotionCamModule.motioncam.FrameRenderer(containerMetadata)
         
         var timespec = timespec()
         timespec_get(&timespec, TIME_UTC)
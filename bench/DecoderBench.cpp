@@ -0,0 +1,478 @@
+//
+// Decoder micro benchmarks.
+//
+//   decoder_bench [--benchmark_* flags] [file.mcraw ...]
+//
+// Synthetic frames are generated for every block bit width. Any .mcraw files given on the
+// command line are benchmarked as well.
+//
+
+#include "Synthetic.hpp"
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/FrameRenderer.hpp>
+#include <motioncam/LinearRenderer.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/RawData.hpp>
+#include <tiny_dng_writer.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <string>
+#include <unistd.h>
+
+//
+// Count heap allocations so we can report allocations per frame
+//
+
+namespace {
+    std::atomic<uint64_t> gAllocations(0);
+}
+
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    if(void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace motioncam {
+    namespace bench {
+        namespace {
+            const int WIDTH = 4032;
+            const int HEIGHT = 3024;
+            const int NUM_FRAMES = 8;
+
+            const int BLOCK_BITS[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 16 };
+
+            void SetCounters(benchmark::State& state, uint64_t allocations, int width, int height) {
+                const double pixels = static_cast<double>(width) * height;
+
+                state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * pixels * sizeof(uint16_t)));
+                state.counters["MP/s"] = benchmark::Counter(pixels / 1e6, benchmark::Counter::kIsIterationInvariantRate);
+                state.counters["allocs/frame"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+            }
+
+            std::string TempPath(const std::string& name) {
+                const char* tmp = std::getenv("TMPDIR");
+                return std::string(tmp ? tmp : "/tmp") + "/mcraw_bench_" + std::to_string(getpid()) + "_" + name + ".mcraw";
+            }
+
+            //
+            // raw::Decode / raw::DecodeLegacy
+            //
+
+            void BM_Decode(benchmark::State& state) {
+                const int bits = static_cast<int>(state.range(0));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, bits);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                std::vector<uint16_t> output(frame.size());
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::Decode(output.data(), WIDTH, HEIGHT, encoded.data(), encoded.size()));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+                state.counters["ratio"] = static_cast<double>(frame.size() * sizeof(uint16_t)) / encoded.size();
+            }
+
+            void BM_DecodeBinned(benchmark::State& state) {
+                const int factor = static_cast<int>(state.range(0));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                std::vector<uint16_t> output(static_cast<size_t>(raw::BinnedSize(WIDTH, factor)) * raw::BinnedSize(HEIGHT, factor));
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::DecodeBinned(output.data(), WIDTH, HEIGHT, encoded.data(), encoded.size(), factor));
+                    benchmark::ClobberMemory();
+                }
+
+                // Rates are of the full size frame so they compare with raw::Decode
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void BM_DecodeNormalized(benchmark::State& state) {
+                const auto format = static_cast<raw::OutputFormat>(state.range(0));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                raw::Normalization normalization;
+                normalization.blackLevel[0] = normalization.blackLevel[1] = normalization.blackLevel[2] = normalization.blackLevel[3] = 64.0f;
+                normalization.whiteLevel = 1023.0f;
+                normalization.format = format;
+
+                std::vector<uint8_t> output(frame.size() * raw::BytesPerPixel(format));
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::DecodeNormalized(output.data(), WIDTH, HEIGHT, encoded.data(), encoded.size(), normalization));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void BM_DecodeWithStats(benchmark::State& state) {
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                std::vector<uint16_t> output(frame.size());
+                raw::FrameStats stats;
+
+                stats.clipLevel = 1023;
+                stats.histogramShift = raw::HistogramShift(1023);
+
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::DecodeWithStats(output.data(), WIDTH, HEIGHT, encoded.data(), encoded.size(), stats));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void BM_EstimateStats(benchmark::State& state) {
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                raw::FrameStats stats;
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::EstimateStats(WIDTH, HEIGHT, encoded.data(), encoded.size(), stats));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void BM_SummarizeBlocks(benchmark::State& state) {
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint8_t> encoded;
+                raw::Encode(encoded, frame.data(), WIDTH, HEIGHT);
+
+                raw::BlockSummary summary;
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::SummarizeBlocks(WIDTH, HEIGHT, encoded.data(), encoded.size(), summary));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void BM_DecodeLegacy(benchmark::State& state) {
+                const int bits = static_cast<int>(state.range(0));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, bits);
+
+                std::vector<uint8_t> encoded;
+                EncodeLegacy(encoded, frame.data(), WIDTH, HEIGHT);
+
+                std::vector<uint16_t> output(frame.size());
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(raw::DecodeLegacy(output.data(), WIDTH, HEIGHT, encoded.data(), encoded.size()));
+                    benchmark::ClobberMemory();
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+                state.counters["ratio"] = static_cast<double>(frame.size() * sizeof(uint16_t)) / encoded.size();
+            }
+
+            //
+            // Decoder::loadFrame / Decoder::loadFrameMetadata
+            //
+
+            void LoadFrames(benchmark::State& state, const std::string& path) {
+                Decoder decoder(path);
+
+                const auto frames = decoder.getFrames();
+                const FrameMetadata metadata = FrameMetadata::parse(decoder.loadFrameMetadata(frames.front()));
+
+                std::vector<uint8_t> output;
+                size_t i = 0;
+
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    decoder.loadFrame(frames[i++ % frames.size()], output, metadata.width, metadata.height, metadata.compressionType);
+                    benchmark::DoNotOptimize(output.data());
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, metadata.width, metadata.height);
+            }
+
+            void LoadFrameMetadata(benchmark::State& state, const std::string& path) {
+                Decoder decoder(path);
+
+                const auto frames = decoder.getFrames();
+                size_t i = 0;
+
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    benchmark::DoNotOptimize(decoder.loadFrameMetadata(frames[i++ % frames.size()]));
+                }
+
+                state.counters["allocs/frame"] = benchmark::Counter(static_cast<double>(gAllocations.load() - allocationsStart), benchmark::Counter::kAvgIterations);
+            }
+
+            void BM_LoadFrame(benchmark::State& state) {
+                const int compressionType = static_cast<int>(state.range(0));
+                const std::string path = TempPath("load_" + std::to_string(compressionType));
+
+                WriteContainer(path, NUM_FRAMES, WIDTH, HEIGHT, 10, compressionType);
+                LoadFrames(state, path);
+                std::remove(path.c_str());
+            }
+
+            void BM_LoadFrameMetadata(benchmark::State& state) {
+                const std::string path = TempPath("metadata");
+
+                WriteContainer(path, NUM_FRAMES, WIDTH, HEIGHT, 10, MOTIONCAM_COMPRESSION_TYPE);
+                LoadFrameMetadata(state, path);
+                std::remove(path.c_str());
+            }
+
+            //
+            // DNGWriter::WriteToFile
+            //
+
+            void BM_WriteDNG(benchmark::State& state) {
+                const ContainerMetadata containerMetadata = ContainerMetadata::parse(MakeContainerMetadata());
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                const std::vector<uint8_t> imageData(
+                    reinterpret_cast<const uint8_t*>(frame.data()),
+                    reinterpret_cast<const uint8_t*>(frame.data() + frame.size()));
+
+                const std::vector<float> asShotNeutral = { 0.5f, 1.0f, 0.6f };
+                const tinydngwriter::DNGWriter writer(false);
+
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    tinydngwriter::DNGImage dng;
+
+                    dng.SetBigEndian(false);
+                    dng.SetDNGVersion(1, 4, 0, 0);
+                    dng.SetDNGBackwardVersion(1, 1, 0, 0);
+                    dng.SetImageData(&imageData);
+                    dng.SetImageWidth(WIDTH);
+                    dng.SetImageLength(HEIGHT);
+                    dng.SetPlanarConfig(tinydngwriter::PLANARCONFIG_CONTIG);
+                    dng.SetPhotometric(tinydngwriter::PHOTOMETRIC_CFA);
+                    dng.SetRowsPerStrip(HEIGHT);
+                    dng.SetSamplesPerPixel(1);
+                    dng.SetCFARepeatPatternDim(2, 2);
+                    dng.SetBlackLevelRepeatDim(2, 2);
+                    dng.SetBlackLevel(4, containerMetadata.blackLevel.data());
+                    dng.SetWhiteLevel(static_cast<short>(containerMetadata.whiteLevel));
+                    dng.SetCompression(tinydngwriter::COMPRESSION_NONE);
+                    dng.SetCFAPattern(4, { 0, 1, 1, 2 });
+                    dng.SetCFALayout(1);
+                    dng.SetBitsPerSample();
+                    dng.SetColorMatrix1(3, containerMetadata.colorMatrix1.data());
+                    dng.SetColorMatrix2(3, containerMetadata.colorMatrix2.data());
+                    dng.SetForwardMatrix1(3, containerMetadata.forwardMatrix1.data());
+                    dng.SetForwardMatrix2(3, containerMetadata.forwardMatrix2.data());
+                    dng.SetAsShotNeutral(3, asShotNeutral.data());
+                    dng.SetCalibrationIlluminant1(21);
+                    dng.SetCalibrationIlluminant2(17);
+                    dng.SetUniqueCameraModel("MotionCam");
+                    dng.SetSubfileType();
+                    dng.SetActiveArea({ 0, 0, HEIGHT, WIDTH });
+
+                    std::string err;
+                    unsigned long count = 0;
+
+                    const char* data = writer.WriteToFile(&dng, &err, &count);
+                    benchmark::DoNotOptimize(data);
+
+                    std::free(const_cast<char*>(data));
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            //
+            // FrameRenderer::render
+            //
+
+            void BM_RenderDNG(benchmark::State& state) {
+                const FrameRenderer renderer(ContainerMetadata::parse(MakeContainerMetadata()));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                FrameMetadata metadata;
+
+                metadata.width = WIDTH;
+                metadata.height = HEIGHT;
+                metadata.asShotNeutral = { 0.5f, 1.0f, 0.6f };
+                metadata.compressionType = MOTIONCAM_COMPRESSION_TYPE;
+
+                std::vector<uint8_t> output(renderer.dngSize(metadata));
+
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    renderer.render(frame.data(), metadata, output.data());
+                    benchmark::DoNotOptimize(output.data());
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            //
+            // LinearRenderer::demosaic
+            //
+
+            void BM_Demosaic(benchmark::State& state) {
+                const LinearRenderer renderer(ContainerMetadata::parse(MakeContainerMetadata()));
+                const auto frame = MakeFrame(WIDTH, HEIGHT, 10);
+
+                std::vector<uint16_t> output(3 * frame.size());
+
+                const unsigned int numThreads = static_cast<unsigned int>(state.range(0));
+                const uint64_t allocationsStart = gAllocations.load();
+
+                for(auto _ : state) {
+                    renderer.demosaic(frame.data(), WIDTH, HEIGHT, output.data(), numThreads);
+                    benchmark::DoNotOptimize(output.data());
+                }
+
+                SetCounters(state, gAllocations.load() - allocationsStart, WIDTH, HEIGHT);
+            }
+
+            void RegisterSynthetic() {
+                auto* decode = benchmark::RegisterBenchmark("raw::Decode", BM_Decode);
+                auto* decodeLegacy = benchmark::RegisterBenchmark("raw::DecodeLegacy", BM_DecodeLegacy);
+
+                for(int bits : BLOCK_BITS) {
+                    decode->Arg(bits);
+                    decodeLegacy->Arg(bits);
+                }
+
+                decode->ArgName("bits")->Unit(benchmark::kMillisecond);
+                decodeLegacy->ArgName("bits")->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("raw::DecodeBinned", BM_DecodeBinned)
+                    ->ArgName("factor")
+                    ->Arg(2)
+                    ->Arg(4)
+                    ->Unit(benchmark::kMillisecond);
+
+                // Output formats in the order of raw::OutputFormat: uint16, half, float
+                benchmark::RegisterBenchmark("raw::DecodeNormalized", BM_DecodeNormalized)
+                    ->ArgName("format")
+                    ->Arg(static_cast<int>(raw::OutputFormat::UInt16))
+                    ->Arg(static_cast<int>(raw::OutputFormat::Half))
+                    ->Arg(static_cast<int>(raw::OutputFormat::Float))
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("raw::DecodeWithStats", BM_DecodeWithStats)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("raw::EstimateStats", BM_EstimateStats)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("raw::SummarizeBlocks", BM_SummarizeBlocks)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("Decoder::loadFrame", BM_LoadFrame)
+                    ->ArgName("compressionType")
+                    ->Arg(MOTIONCAM_COMPRESSION_TYPE_LEGACY)
+                    ->Arg(MOTIONCAM_COMPRESSION_TYPE)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("Decoder::loadFrameMetadata", BM_LoadFrameMetadata)
+                    ->Unit(benchmark::kMicrosecond);
+
+                benchmark::RegisterBenchmark("DNGWriter::WriteToFile", BM_WriteDNG)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark("FrameRenderer::render", BM_RenderDNG)
+                    ->Unit(benchmark::kMillisecond);
+
+                // 0 uses all cores
+                benchmark::RegisterBenchmark("LinearRenderer::demosaic", BM_Demosaic)
+                    ->ArgName("threads")
+                    ->Arg(1)
+                    ->Arg(0)
+                    ->UseRealTime()
+                    ->Unit(benchmark::kMillisecond);
+            }
+
+            void RegisterCorpus(const std::string& path) {
+                benchmark::RegisterBenchmark(("Decoder::loadFrame/" + path).c_str(), LoadFrames, path)
+                    ->Unit(benchmark::kMillisecond);
+
+                benchmark::RegisterBenchmark(("Decoder::loadFrameMetadata/" + path).c_str(), LoadFrameMetadata, path)
+                    ->Unit(benchmark::kMicrosecond);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    motioncam::bench::RegisterSynthetic();
+
+    // Whatever is left after the benchmark flags are real containers
+    for(int i = 1; i < argc; i++) {
+        if(argv[i][0] == '-') {
+            std::fprintf(stderr, "%s: unrecognized option %s\n", argv[0], argv[i]);
+            return 1;
+        }
+
+        // Open each one up front so a bad path fails here instead of inside a benchmark
+        try {
+            motioncam::Decoder decoder(argv[i]);
+        }
+        catch(const std::exception& e) {
+            std::fprintf(stderr, "%s: %s\n", argv[0], e.what());
+            return 1;
+        }
+
+        motioncam::bench::RegisterCorpus(argv[i]);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
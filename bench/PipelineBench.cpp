@@ -0,0 +1,246 @@
+//
+// End to end frame pipeline benchmark.
+//
+//   pipeline_bench [--threads 1,2,4,8] [--frames N] [--chunk bytes] [--cache frames] [file.mcraw]
+//
+// Drives the read path of the file system: open the container with fuse::McrawFileSystem, then
+// have N readers read whole frame_N.dng files in fixed size chunks through getFrame(), each
+// chunk being one FUSE read. Frame sizes come from frameFileSize(), like the sizes the mount
+// reports.
+//
+// Reports frames/s, read latency percentiles, where the time went (from the pipeline
+// statistics, see Stats.hpp), the cache hit rate and the peak RSS of the process so far.
+// Without a file a synthetic container is generated.
+//
+
+#include "Synthetic.hpp"
+#include "McrawFileSystem.hpp"
+
+#include <motioncam/Stats.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace motioncam {
+    namespace bench {
+        namespace {
+            typedef std::chrono::steady_clock Clock;
+
+            uint64_t ElapsedNs(const Clock::time_point& start) {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            }
+
+            size_t PeakRssBytes() {
+                struct rusage usage{};
+                getrusage(RUSAGE_SELF, &usage);
+
+#if defined(__APPLE__)
+                return static_cast<size_t>(usage.ru_maxrss);
+#else
+                return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+            }
+
+            uint64_t StageNs(const stats::Snapshot& snapshot, stats::Stage stage) {
+                return snapshot.stages[static_cast<size_t>(stage)].totalNs;
+            }
+
+            uint64_t CounterValue(const stats::Snapshot& snapshot, stats::Counter counter) {
+                return snapshot.counters[static_cast<size_t>(counter)];
+            }
+
+            struct Options {
+                std::vector<int> threads = { 1, 2, 4, 8 };
+                size_t maxFrames = 0;
+                size_t chunkSize = 128 * 1024;
+                size_t cacheFrames = 5;
+                std::string path;
+            };
+
+            double Percentile(const std::vector<uint64_t>& sorted, double p) {
+                if(sorted.empty())
+                    return 0;
+
+                const size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(p * (sorted.size() - 1) + 0.5));
+                return sorted[idx] / 1e6;
+            }
+
+            void Run(const Options& options) {
+                fuse::FileSystemOptions fsOptions;
+                fsOptions.maxCacheFrames = options.cacheFrames;
+
+                auto start = Clock::now();
+                auto probe = std::make_unique<fuse::McrawFileSystem>(options.path, fsOptions);
+
+                std::printf("%s\n", options.path.c_str());
+                std::printf("open + metadata for %zu frames: %.1f ms\n\n", probe->numFrames(), ElapsedNs(start) / 1e6);
+
+                probe.reset();
+
+                std::printf("%8s %9s %9s %10s %10s %10s %8s %8s %8s %8s %8s %10s\n",
+                    "threads", "frames/s", "MB/s", "p50 ms", "p99 ms", "max ms",
+                    "io %", "decode %", "dng %", "copy %", "hit %", "peak MB");
+
+                stats::SetEnabled(true);
+
+                for(int numThreads : options.threads) {
+                    // Fresh file system per run so the cache starts cold
+                    fuse::McrawFileSystem fs(options.path, fsOptions);
+
+                    const size_t numFrames = options.maxFrames > 0 ? std::min(options.maxFrames, fs.numFrames()) : fs.numFrames();
+
+                    std::atomic<size_t> nextFrame(0);
+                    std::atomic<uint64_t> bytesRead(0);
+                    std::vector<std::vector<uint64_t>> latencies(numThreads);
+                    std::vector<std::thread> readers;
+
+                    stats::Reset();
+                    start = Clock::now();
+
+                    for(int t = 0; t < numThreads; t++) {
+                        readers.emplace_back([&, t] {
+                            std::vector<uint8_t> buffer(options.chunkSize);
+
+                            for(size_t frame = nextFrame++; frame < numFrames; frame = nextFrame++) {
+                                const uint64_t fileSize = fs.frameFileSize(frame);
+
+                                for(uint64_t offset = 0; offset < fileSize; offset += options.chunkSize) {
+                                    const auto readStart = Clock::now();
+                                    const fuse::FileData data = fs.getFrame(frame);
+
+                                    const size_t len = std::min<size_t>(options.chunkSize, data->size() - std::min<size_t>(offset, data->size()));
+
+                                    {
+                                        stats::ScopedTimer timer(stats::Stage::Copy);
+                                        std::memcpy(buffer.data(), data->data() + offset, len);
+                                    }
+
+                                    latencies[t].push_back(ElapsedNs(readStart));
+                                    bytesRead += len;
+                                }
+                            }
+                        });
+                    }
+
+                    for(auto& reader : readers)
+                        reader.join();
+
+                    const double elapsedSecs = ElapsedNs(start) / 1e9;
+                    const stats::Snapshot snapshot = stats::TakeSnapshot();
+
+                    std::vector<uint64_t> all;
+                    for(const auto& l : latencies)
+                        all.insert(all.end(), l.begin(), l.end());
+
+                    std::sort(all.begin(), all.end());
+
+                    const uint64_t ioNs = StageNs(snapshot, stats::Stage::Read);
+                    const uint64_t decodeNs = StageNs(snapshot, stats::Stage::Decode);
+                    const uint64_t dngNs = StageNs(snapshot, stats::Stage::Render);
+                    const uint64_t copyNs = StageNs(snapshot, stats::Stage::Copy);
+
+                    const double stageTotal = std::max(1.0, static_cast<double>(ioNs + decodeNs + dngNs + copyNs));
+
+                    const uint64_t hits = CounterValue(snapshot, stats::Counter::CacheHits);
+                    const double lookups = static_cast<double>(hits + CounterValue(snapshot, stats::Counter::CacheMisses));
+
+                    std::printf("%8d %9.1f %9.1f %10.3f %10.3f %10.3f %8.1f %8.1f %8.1f %8.1f %8.1f %10.1f\n",
+                        numThreads,
+                        numFrames / elapsedSecs,
+                        bytesRead / elapsedSecs / (1024.0 * 1024.0),
+                        Percentile(all, 0.5),
+                        Percentile(all, 0.99),
+                        all.empty() ? 0.0 : all.back() / 1e6,
+                        100.0 * ioNs / stageTotal,
+                        100.0 * decodeNs / stageTotal,
+                        100.0 * dngNs / stageTotal,
+                        100.0 * copyNs / stageTotal,
+                        lookups > 0 ? 100.0 * hits / lookups : 0.0,
+                        PeakRssBytes() / (1024.0 * 1024.0));
+                }
+            }
+
+            std::vector<int> ParseList(const std::string& value) {
+                std::vector<int> result;
+                std::stringstream ss(value);
+                std::string item;
+
+                while(std::getline(ss, item, ',')) {
+                    const int n = std::atoi(item.c_str());
+                    if(n > 0)
+                        result.push_back(n);
+                }
+
+                return result;
+            }
+
+            void Usage(const char* name) {
+                std::fprintf(stderr, "Usage: %s [--threads 1,2,4,8] [--frames N] [--chunk bytes] [--cache frames] [file.mcraw]\n", name);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    using namespace motioncam::bench;
+
+    Options options;
+
+    for(int i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+        const bool hasValue = i + 1 < argc;
+
+        if(arg == "--threads" && hasValue)
+            options.threads = ParseList(argv[++i]);
+        else if(arg == "--frames" && hasValue)
+            options.maxFrames = std::strtoul(argv[++i], nullptr, 10);
+        else if(arg == "--chunk" && hasValue)
+            options.chunkSize = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if(arg == "--cache" && hasValue)
+            options.cacheFrames = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        else if(!arg.empty() && arg[0] != '-' && options.path.empty())
+            options.path = arg;
+        else {
+            Usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::string syntheticPath;
+
+    if(options.path.empty()) {
+        const char* tmp = std::getenv("TMPDIR");
+
+        syntheticPath = std::string(tmp ? tmp : "/tmp") + "/mcraw_pipeline_bench_" + std::to_string(getpid()) + ".mcraw";
+        WriteContainer(syntheticPath, 32, 4032, 3024, 10, motioncam::MOTIONCAM_COMPRESSION_TYPE);
+
+        options.path = syntheticPath;
+    }
+
+    int result = EXIT_SUCCESS;
+
+    try {
+        Run(options);
+    }
+    catch(const std::exception& e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        result = EXIT_FAILURE;
+    }
+
+    if(!syntheticPath.empty())
+        std::remove(syntheticPath.c_str());
+
+    return result;
+}
@@ -0,0 +1,144 @@
+#include "Synthetic.hpp"
+
+#include <motioncam/ContainerWriter.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/RawData.hpp>
+
+#include <algorithm>
+#include <random>
+
+namespace motioncam {
+    namespace bench {
+        namespace {
+            const int LEGACY_BLOCK_SIZE = 16;
+            const uint16_t BLACK_LEVEL = 64;
+
+            // Legacy blocks are a plain MSB first bitstream of 16 values
+            void PackLegacyBlock(std::vector<uint8_t>& output, const uint16_t* values, const int bits) {
+                uint32_t acc = 0;
+                int accBits = 0;
+
+                for(int i = 0; i < LEGACY_BLOCK_SIZE; i++) {
+                    acc = (acc << bits) | (values[i] & ((1u << bits) - 1));
+                    accBits += bits;
+
+                    while(accBits >= 8) {
+                        accBits -= 8;
+                        output.push_back((acc >> accBits) & 0xFF);
+                    }
+                }
+            }
+        }
+
+        std::vector<uint16_t> MakeFrame(const int width, const int height, const int bits, const uint32_t seed) {
+            std::mt19937 rng(seed);
+            std::vector<uint16_t> frame(static_cast<size_t>(width) * height);
+
+            const uint16_t base = bits >= 16 ? 0 : BLACK_LEVEL;
+            const uint32_t mask = bits >= 16 ? 0xFFFF : (1u << bits) - 1;
+
+            for(auto& p : frame)
+                p = static_cast<uint16_t>(base + (rng() & mask));
+
+            return frame;
+        }
+
+        size_t EncodeLegacy(std::vector<uint8_t>& output, const uint16_t* input, const int width, const int height) {
+            const int encodingBlock = LEGACY_BLOCK_SIZE * 2;
+            const int paddedWidth = encodingBlock * ((width + encodingBlock - 1) / encodingBlock);
+
+            uint16_t values[LEGACY_BLOCK_SIZE];
+
+            output.clear();
+
+            for(int y = 0; y < height; y++) {
+                const uint16_t* row = input + static_cast<size_t>(y) * width;
+
+                for(int x = 0; x < paddedWidth; x += encodingBlock) {
+                    // Even columns then odd columns
+                    for(int c = 0; c < 2; c++) {
+                        for(int i = 0; i < LEGACY_BLOCK_SIZE; i++) {
+                            const int px = std::min(x + i*2 + c, width - 2 + c);
+                            values[i] = row[px];
+                        }
+
+                        const uint16_t reference = std::min<uint16_t>(*std::min_element(values, values + LEGACY_BLOCK_SIZE), 0x0FFF);
+                        uint16_t range = 0;
+
+                        for(auto& v : values) {
+                            v -= reference;
+                            range |= v;
+                        }
+
+                        int bits = 0;
+                        while(range >> bits)
+                            ++bits;
+
+                        // Anything above 10 bits is stored as 16 bits
+                        if(bits > 10)
+                            bits = 16;
+
+                        output.push_back(static_cast<uint8_t>((std::min(bits, 15) << 4) | (reference >> 8)));
+                        output.push_back(static_cast<uint8_t>(reference & 0xFF));
+
+                        if(bits > 0)
+                            PackLegacyBlock(output, values, bits);
+                    }
+                }
+            }
+
+            // Decoder needs a byte past the last block and a last byte that is not an offset marker
+            output.push_back(0);
+            output.push_back(0);
+
+            return output.size();
+        }
+
+        std::string MakeContainerMetadata() {
+            return
+                "{\"blackLevel\":[64,64,64,64],"
+                "\"whiteLevel\":1023,"
+                "\"sensorArrangment\":\"rggb\","
+                "\"colorMatrix1\":[0.7,-0.2,-0.1,-0.4,1.2,0.2,-0.1,0.2,0.6],"
+                "\"colorMatrix2\":[1.1,-0.4,-0.1,-0.4,1.3,0.1,-0.1,0.2,0.5],"
+                "\"forwardMatrix1\":[0.6,0.2,0.1,0.2,0.8,-0.1,0.0,-0.2,1.0],"
+                "\"forwardMatrix2\":[0.6,0.2,0.1,0.3,0.8,-0.1,0.0,-0.3,1.1]}";
+        }
+
+        std::string MakeFrameMetadata(const int width, const int height, const int compressionType) {
+            return
+                "{\"width\":" + std::to_string(width) +
+                ",\"height\":" + std::to_string(height) +
+                ",\"asShotNeutral\":[0.5,1.0,0.6]"
+                ",\"compressionType\":" + std::to_string(compressionType) + "}";
+        }
+
+        void WriteContainer(
+            const std::string& path,
+            const int numFrames,
+            const int width,
+            const int height,
+            const int bits,
+            const int compressionType)
+        {
+            ContainerWriter writer(path, MakeContainerMetadata());
+
+            const std::string frameMetadata = MakeFrameMetadata(width, height, compressionType);
+            std::vector<uint8_t> buffer;
+
+            for(int i = 0; i < numFrames; i++) {
+                const auto frame = MakeFrame(width, height, bits, static_cast<uint32_t>(i + 1));
+
+                if(compressionType == MOTIONCAM_COMPRESSION_TYPE_LEGACY)
+                    EncodeLegacy(buffer, frame.data(), width, height);
+                else
+                    raw::Encode(buffer, frame.data(), width, height);
+
+                // ~30 fps timestamps in nanoseconds
+                writer.writeFrame(static_cast<Timestamp>(i) * 33333333, buffer, frameMetadata);
+            }
+
+            writer.finish();
+        }
+    }
+}
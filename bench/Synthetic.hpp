@@ -0,0 +1,46 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Synthetic_hpp
+#define Synthetic_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    namespace bench {
+        // Bayer frame where every encoded block needs exactly `bits` bits per pixel
+        std::vector<uint16_t> MakeFrame(const int width, const int height, const int bits, const uint32_t seed = 1);
+
+        // Compression type 6 encoder, only used to produce input for raw::DecodeLegacy
+        size_t EncodeLegacy(std::vector<uint8_t>& output, const uint16_t* input, const int width, const int height);
+
+        std::string MakeContainerMetadata();
+        std::string MakeFrameMetadata(const int width, const int height, const int compressionType);
+
+        // Writes a container with `numFrames` synthetic frames
+        void WriteContainer(
+            const std::string& path,
+            const int numFrames,
+            const int width,
+            const int height,
+            const int bits,
+            const int compressionType);
+    }
+}
+
+#endif /* Synthetic_hpp */
@@ -0,0 +1,426 @@
+#include "McrawFileSystem.hpp"
+
+#include <motioncam/RawData.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+namespace motioncam {
+    namespace fuse {
+        namespace {
+            const char* FRAME_PREFIX = "frame_";
+            const char* FRAME_SUFFIX = ".dng";
+            const char* JPEG_SUFFIX = ".jpg";
+
+            // Room for the JPEG headers on top of the pixels
+            const uint64_t JPEG_HEADER_SIZE = 4096;
+
+            // Longest line of the CSV and longest frame of the JSON from TakeStatsToCsv() and
+            // TakeStatsToJson(), a JSON frame being mostly four full histograms
+            const uint64_t STATS_CSV_LINE_SIZE = 256;
+            const uint64_t STATS_JSON_FRAME_SIZE = 12288;
+
+            const size_t NUM_VIEWS = static_cast<size_t>(View::Count);
+
+            size_t CacheKey(size_t index, View view) {
+                return index * NUM_VIEWS + static_cast<size_t>(view);
+            }
+        }
+
+        McrawFileSystem::McrawFileSystem(const std::string& path, const FileSystemOptions& options) :
+            mMaxCacheFrames(std::max<size_t>(1, options.maxCacheFrames)),
+            mPrototype(std::make_unique<SegmentedDecoder>(path)),
+            mJpegQuality(options.jpegQuality),
+            mContactSheetSize(0),
+            mFrameStats(options.frameStats),
+            mFrameStatsOptions(options.frameStatsOptions),
+            mFrameStatsSizes{},
+            mTotalFileSize(0),
+            mNextId(0)
+        {
+            auto decoder = mPrototype->clone();
+
+            const ContainerMetadata containerMetadata = ContainerMetadata::parse(decoder->getContainerMetadata());
+
+            if(options.defectPixels)
+                mDefectPixels = FindDefectPixels(*decoder, options.defectPixelOptions);
+
+            mRenderers[static_cast<size_t>(View::Frame)] = std::make_unique<FrameRenderer>(containerMetadata, options.previewSize, 1, mDefectPixels);
+
+            if(options.proxyFactor > 0)
+                mRenderers[static_cast<size_t>(View::Proxy)] = std::make_unique<FrameRenderer>(containerMetadata, options.previewSize, options.proxyFactor);
+
+            if(options.jpegBinning > 0) {
+                if(!PreviewRenderer::supportsJpeg())
+                    throw MotionCamException("Built without JPEG support");
+
+                mPreviewRenderer = std::make_unique<PreviewRenderer>(containerMetadata, options.jpegBinning);
+            }
+
+            if(options.linear)
+                mLinearRenderer = std::make_unique<LinearRenderer>(containerMetadata, mDefectPixels);
+
+            mFrames = mPrototype->getFrames();
+
+            if(mFrames.empty())
+                throw IOException("Container has no frames");
+
+            mFrameMetadata.reserve(mFrames.size());
+
+            for(size_t i = 0; i < mFrames.size(); i++)
+                mFrameMetadata.push_back(FrameMetadata::parse(decoder->loadFrameMetadataAt(i)));
+
+            mFrameHashes = std::make_unique<std::atomic<uint64_t>[]>(mFrames.size());
+
+            for(size_t view = 0; view < NUM_VIEWS; view++) {
+                if(!hasView(static_cast<View>(view)) || !hasFixedSize(static_cast<View>(view)))
+                    continue;
+
+                mFrameFileSizes[view].reserve(mFrames.size());
+
+                for(const auto& metadata : mFrameMetadata) {
+                    if(view == static_cast<size_t>(View::Linear))
+                        mFrameFileSizes[view].push_back(mLinearRenderer->dngSize(metadata));
+                    else
+                        mFrameFileSizes[view].push_back(mRenderers[view]->dngSize(metadata));
+
+                    mTotalFileSize += mFrameFileSizes[view].back();
+                }
+            }
+
+            if(mPreviewRenderer) {
+                mJpegSizes = std::make_unique<std::atomic<uint64_t>[]>(mFrames.size());
+
+                for(size_t i = 0; i < mFrames.size(); i++)
+                    mTotalFileSize += frameFileSize(i, View::Preview);
+            }
+
+            if(options.contactSheet) {
+                if(!PreviewRenderer::supportsJpeg())
+                    throw MotionCamException("Built without JPEG support");
+
+                mContactSheet = std::make_unique<ContactSheet>(*decoder, options.contactSheetOptions);
+                mTotalFileSize += contactSheetSize();
+            }
+
+            if(mFrameStats) {
+                mTotalFileSize += frameStatsSize(StatsFormat::Csv);
+                mTotalFileSize += frameStatsSize(StatsFormat::Json);
+            }
+
+            releaseDecoder(std::move(decoder));
+        }
+
+        bool McrawFileSystem::hasView(View view) const {
+            if(view == View::Preview)
+                return mPreviewRenderer != nullptr;
+
+            if(view == View::Linear)
+                return mLinearRenderer != nullptr;
+
+            return mRenderers[static_cast<size_t>(view)] != nullptr;
+        }
+
+        uint64_t McrawFileSystem::frameFileSize(size_t index, View view) const {
+            if(view != View::Preview)
+                return mFrameFileSizes[static_cast<size_t>(view)][index];
+
+            const uint64_t size = mJpegSizes[index].load(std::memory_order_relaxed);
+
+            if(size > 0)
+                return size;
+
+            // A JPEG this size would be larger than the pixels it holds
+            const FrameMetadata& metadata = mFrameMetadata[index];
+
+            return JPEG_HEADER_SIZE +
+                3 * static_cast<uint64_t>(std::max(0, mPreviewRenderer->width(metadata))) * static_cast<uint64_t>(std::max(0, mPreviewRenderer->height(metadata)));
+        }
+
+        uint64_t McrawFileSystem::contactSheetSize() const {
+            const uint64_t size = mContactSheetSize.load(std::memory_order_relaxed);
+
+            if(size > 0)
+                return size;
+
+            return JPEG_HEADER_SIZE + 3 * static_cast<uint64_t>(mContactSheet->width()) * static_cast<uint64_t>(mContactSheet->height());
+        }
+
+        uint64_t McrawFileSystem::frameStatsSize(StatsFormat format) const {
+            const uint64_t size = mFrameStatsSizes[static_cast<size_t>(format)].load(std::memory_order_relaxed);
+
+            if(size > 0)
+                return size;
+
+            // One line (or frame) per frame plus the header
+            const uint64_t lineSize = format == StatsFormat::Csv ? STATS_CSV_LINE_SIZE : STATS_JSON_FRAME_SIZE;
+
+            return lineSize * (mFrames.size() + 1);
+        }
+
+        std::string McrawFileSystem::frameName(size_t index, View view) {
+            return FRAME_PREFIX + std::to_string(index) + (view == View::Preview ? JPEG_SUFFIX : FRAME_SUFFIX);
+        }
+
+        bool McrawFileSystem::findFrame(const std::string& name, size_t& outIndex, View view) const {
+            const std::string prefix(FRAME_PREFIX);
+
+            if(name.compare(0, prefix.size(), prefix) != 0)
+                return false;
+
+            const char* start = name.c_str() + prefix.size();
+            char* end = nullptr;
+
+            const unsigned long long index = std::strtoull(start, &end, 10);
+
+            // Only accept the exact names we list, so no leading zeros, signs or spaces
+            if(end == start || index >= mFrames.size() || name != frameName(index, view))
+                return false;
+
+            outIndex = static_cast<size_t>(index);
+            return true;
+        }
+
+        FileData McrawFileSystem::getFrame(size_t index, View view) {
+            const size_t key = CacheKey(index, view);
+
+            std::promise<FileData> promise;
+            std::shared_future<FileData> future;
+            uint64_t id = 0;
+
+            trace::ScopedEvent event("get_frame", mFrames[index]);
+
+            {
+                const int64_t lockStart = trace::Now();
+                std::unique_lock<std::mutex> lock(mCacheLock);
+
+                // Time spent waiting for the lock
+                trace::Record("cache_lock", lockStart);
+
+                auto it = mCache.find(key);
+                if(it != mCache.end()) {
+                    stats::Add(stats::Counter::CacheHits);
+
+                    // Rendered or being rendered by another thread
+                    mLru.splice(mLru.begin(), mLru, it->second.lru);
+                    future = it->second.data;
+
+                    lock.unlock();
+
+                    trace::ScopedEvent wait("cache_hit");
+                    return future.get();
+                }
+
+                stats::Add(stats::Counter::CacheMisses);
+
+                future = promise.get_future().share();
+                id = ++mNextId;
+
+                mLru.push_front(key);
+                mCache.emplace(key, CacheEntry{ future, mLru.begin(), id });
+
+                // Evicted entries that are still rendering stay alive for whoever waits on them
+                while(mCache.size() > mMaxCacheFrames) {
+                    mCache.erase(mLru.back());
+                    mLru.pop_back();
+
+                    stats::Add(stats::Counter::CacheEvictions);
+                }
+            }
+
+            stats::AddGauge(stats::Gauge::RendersInFlight, 1);
+
+            try {
+                promise.set_value(render(index, view));
+            }
+            catch(...) {
+                promise.set_exception(std::current_exception());
+
+                // Don't keep failures around, the next read tries again
+                std::lock_guard<std::mutex> lock(mCacheLock);
+
+                auto it = mCache.find(key);
+                if(it != mCache.end() && it->second.id == id) {
+                    mLru.erase(it->second.lru);
+                    mCache.erase(it);
+                }
+            }
+
+            stats::AddGauge(stats::Gauge::RendersInFlight, -1);
+
+            return future.get();
+        }
+
+        FileData McrawFileSystem::getContactSheet() {
+            if(!mContactSheet)
+                throw MotionCamException("Contact sheet is not enabled");
+
+            std::lock_guard<std::mutex> lock(mContactSheetLock);
+
+            if(!mContactSheetData) {
+                auto data = std::make_shared<std::vector<uint8_t>>();
+
+                mContactSheet->renderJpeg(*data);
+                mContactSheetSize.store(data->size(), std::memory_order_relaxed);
+
+                mContactSheetData = std::move(data);
+            }
+
+            return mContactSheetData;
+        }
+
+        FileData McrawFileSystem::getFrameStats(StatsFormat format) {
+            if(!mFrameStats)
+                throw MotionCamException("Frame statistics are not enabled");
+
+            std::lock_guard<std::mutex> lock(mFrameStatsLock);
+
+            const size_t i = static_cast<size_t>(format);
+
+            if(!mFrameStatsData[i]) {
+                auto decoder = acquireDecoder();
+
+                const auto frames = CollectTakeStats(*decoder, mFrameStatsOptions);
+                const ContainerMetadata metadata = ContainerMetadata::parse(decoder->getContainerMetadata());
+
+                releaseDecoder(std::move(decoder));
+
+                // Both formats come from the same pass
+                const std::string documents[] = {
+                    TakeStatsToCsv(frames, metadata),
+                    TakeStatsToJson(frames, metadata)
+                };
+
+                for(size_t f = 0; f < static_cast<size_t>(StatsFormat::Count); f++) {
+                    mFrameStatsData[f] = std::make_shared<std::vector<uint8_t>>(documents[f].begin(), documents[f].end());
+                    mFrameStatsSizes[f].store(documents[f].size(), std::memory_order_relaxed);
+                }
+            }
+
+            return mFrameStatsData[i];
+        }
+
+        bool McrawFileSystem::findRepeat(size_t index, View view, uint64_t hash, FileData& outData, size_t& outIndex) {
+            std::shared_future<FileData> future;
+
+            {
+                std::lock_guard<std::mutex> lock(mCacheLock);
+
+                auto& frames = mHashFrames[static_cast<size_t>(view)];
+                auto it = frames.find(hash);
+
+                if(it == frames.end() || it->second == index)
+                    return false;
+
+                auto entry = mCache.find(CacheKey(it->second, view));
+
+                // Evicted, forget it
+                if(entry == mCache.end()) {
+                    frames.erase(it);
+                    return false;
+                }
+
+                outIndex = it->second;
+                future = entry->second.data;
+            }
+
+            // Don't wait for a render in progress, decoding may well be quicker
+            if(future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return false;
+
+            try {
+                outData = future.get();
+            }
+            catch(...) {
+                return false;
+            }
+
+            return true;
+        }
+
+        std::unique_ptr<SegmentedDecoder> McrawFileSystem::acquireDecoder() {
+            {
+                std::lock_guard<std::mutex> lock(mDecoderLock);
+
+                if(!mDecoders.empty()) {
+                    auto decoder = std::move(mDecoders.back());
+                    mDecoders.pop_back();
+
+                    return decoder;
+                }
+            }
+
+            // Decoders aren't thread safe, so every concurrent render opens the segments again
+            return mPrototype->clone();
+        }
+
+        void McrawFileSystem::releaseDecoder(std::unique_ptr<SegmentedDecoder> decoder) {
+            std::lock_guard<std::mutex> lock(mDecoderLock);
+
+            mDecoders.push_back(std::move(decoder));
+        }
+
+        FileData McrawFileSystem::render(size_t index, View view) {
+            trace::ScopedEvent event("render");
+
+            if(!hasView(view))
+                throw MotionCamException("View is not enabled");
+
+            auto data = std::make_shared<std::vector<uint8_t>>();
+
+            auto decoder = acquireDecoder();
+            size_t segmentIndex = 0;
+            Decoder& segment = decoder->decoderFor(index, segmentIndex);
+
+            // Concurrent reads already render frames in parallel, one thread each keeps the cores
+            // from being oversubscribed
+            if(view == View::Preview) {
+                mPreviewRenderer->renderJpeg(segment, segmentIndex, mFrameMetadata[index], *data, mJpegQuality, 1);
+                mJpegSizes[index].store(data->size(), std::memory_order_relaxed);
+            }
+            else if(view == View::Linear) {
+                mLinearRenderer->render(segment, segmentIndex, mFrameMetadata[index], *data, 1);
+            }
+            else {
+                const FrameRenderer& renderer = *mRenderers[static_cast<size_t>(view)];
+
+                std::vector<uint8_t> compressed;
+                uint64_t hash = mFrameHashes[index].load(std::memory_order_relaxed);
+
+                if(hash == 0) {
+                    std::string metadata;
+                    segment.loadCompressedFrame(mFrames[index], compressed, metadata);
+
+                    hash = raw::HashFrame(compressed.data(), compressed.size());
+                    mFrameHashes[index].store(hash, std::memory_order_relaxed);
+                }
+
+                FileData source;
+                size_t sourceIndex = 0;
+
+                data->resize(renderer.dngSize(mFrameMetadata[index]));
+
+                if(findRepeat(index, view, hash, source, sourceIndex)) {
+                    renderer.render(source->data(), mFrameMetadata[sourceIndex], mFrameMetadata[index], data->data());
+                    stats::Add(stats::Counter::RepeatedFrames);
+                }
+                else if(!compressed.empty()) {
+                    renderer.render(compressed, mFrameMetadata[index], data->data());
+                }
+                else {
+                    renderer.renderAt(segment, segmentIndex, mFrameMetadata[index], data->data());
+                }
+
+                std::lock_guard<std::mutex> lock(mCacheLock);
+                mHashFrames[static_cast<size_t>(view)][hash] = index;
+            }
+
+            releaseDecoder(std::move(decoder));
+
+            return data;
+        }
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef McrawFileSystem_hpp
+#define McrawFileSystem_hpp
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/ContactSheet.hpp>
+#include <motioncam/DefectPixels.hpp>
+#include <motioncam/FrameRenderer.hpp>
+#include <motioncam/LinearRenderer.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/PreviewRenderer.hpp>
+#include <motioncam/SegmentedDecoder.hpp>
+#include <motioncam/TakeStats.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace motioncam {
+    namespace fuse {
+        typedef std::shared_ptr<const std::vector<uint8_t>> FileData;
+
+        // Each frame is shown as one file per view
+        enum class View {
+            Frame,      // The full frame
+            Proxy,      // Binned by the proxy factor, see raw::DecodeBinned()
+            Preview,    // JPEG from PreviewRenderer
+            Linear,     // Demosaiced DNG from LinearRenderer
+            Count
+        };
+
+        enum class StatsFormat {
+            Csv,
+            Json,
+            Count
+        };
+
+        struct FileSystemOptions {
+            // Number of rendered files kept in memory
+            size_t maxCacheFrames = 8;
+
+            // Long edge of the preview embedded in each DNG, 0 for none
+            int previewSize = FrameRenderer::DEFAULT_PREVIEW_SIZE;
+
+            // Binning of View::Proxy (2 or 4), 0 leaves proxies out
+            int proxyFactor = 0;
+
+            // Binning of the frame before the half size demosaic of View::Preview (1, 2 or 4), 0
+            // leaves previews out
+            int jpegBinning = 0;
+            int jpegQuality = PreviewRenderer::DEFAULT_JPEG_QUALITY;
+
+            // Demosaiced linear DNGs in View::Linear
+            bool linear = false;
+
+            // Hot and dead pixels found when the container is opened, listed in the full size
+            // DNGs and fixed in View::Linear, see FindDefectPixels()
+            bool defectPixels = false;
+            DefectPixelOptions defectPixelOptions;
+
+            // Thumbnails of the whole take in one JPEG, see getContactSheet()
+            bool contactSheet = false;
+            ContactSheetOptions contactSheetOptions;
+
+            // Per-frame exposure statistics of the whole take, see getFrameStats()
+            bool frameStats = false;
+            TakeStatsOptions frameStatsOptions;
+        };
+
+        //
+        // The frame_N.dng views of a container, independent of FUSE. A segmented recording is
+        // shown as one sequence. Safe to call from any number of threads: each thread borrows its
+        // own decoder from a pool, different frames are rendered in parallel and concurrent reads
+        // of the same frame wait for a single render.
+        //
+        // Full size and proxy DNGs of a frame that repeats one still in the cache (the same
+        // compressed data, see raw::HashFrame()) copy its pixels instead of decoding them again.
+        // The hash of each frame is kept once it has been read, so a repeat read later on doesn't
+        // even read the frame.
+        //
+        class McrawFileSystem {
+        public:
+            McrawFileSystem(const std::string& path, const FileSystemOptions& options = {});
+
+            size_t numFrames() const { return mFrames.size(); }
+
+            size_t numSegments() const { return mPrototype->numSegments(); }
+
+            // Empty unless FileSystemOptions::defectPixels is set
+            const std::vector<DefectPixel>& defectPixels() const { return mDefectPixels; }
+
+            bool hasView(View view) const;
+
+            // The size of a JPEG isn't known until it is encoded, until then frameFileSize() is
+            // an upper bound for it
+            static bool hasFixedSize(View view) { return view != View::Preview; }
+
+            uint64_t frameFileSize(size_t index, View view = View::Frame) const;
+
+            uint64_t totalFileSize() const { return mTotalFileSize; }
+
+            static std::string frameName(size_t index, View view = View::Frame);
+
+            // Returns false if name isn't a file of this container in view
+            bool findFrame(const std::string& name, size_t& outIndex, View view = View::Frame) const;
+
+            // view must be one hasView() is true for
+            FileData getFrame(size_t index, View view = View::Frame);
+
+            bool hasContactSheet() const { return mContactSheet != nullptr; }
+
+            // An upper bound until the contact sheet has been rendered, like frameFileSize()
+            uint64_t contactSheetSize() const;
+
+            // Rendered on first use and kept, concurrent callers wait for the same render
+            FileData getContactSheet();
+
+            bool hasFrameStats() const { return mFrameStats; }
+
+            // An upper bound until the statistics have been collected
+            uint64_t frameStatsSize(StatsFormat format) const;
+
+            // Collected on first use for both formats and kept, like getContactSheet()
+            FileData getFrameStats(StatsFormat format);
+
+        private:
+            struct CacheEntry {
+                std::shared_future<FileData> data;
+                std::list<size_t>::iterator lru;
+                uint64_t id;
+            };
+
+            std::unique_ptr<SegmentedDecoder> acquireDecoder();
+            void releaseDecoder(std::unique_ptr<SegmentedDecoder> decoder);
+
+            FileData render(size_t index, View view);
+
+            // A rendered file of view in the cache for another frame with hash, false if there is none
+            bool findRepeat(size_t index, View view, uint64_t hash, FileData& outData, size_t& outIndex);
+
+        private:
+            const size_t mMaxCacheFrames;
+
+            // Only used to create decoders for the pool, they share its index
+            std::unique_ptr<SegmentedDecoder> mPrototype;
+
+            std::vector<DefectPixel> mDefectPixels;
+
+            // Indexed by View, null for views that are left out and the ones with their own renderer
+            std::unique_ptr<FrameRenderer> mRenderers[static_cast<size_t>(View::Count)];
+            std::vector<uint64_t> mFrameFileSizes[static_cast<size_t>(View::Count)];
+
+            std::unique_ptr<PreviewRenderer> mPreviewRenderer;
+            const int mJpegQuality;
+
+            std::unique_ptr<LinearRenderer> mLinearRenderer;
+
+            // Sizes of the JPEGs encoded so far, 0 for the others
+            std::unique_ptr<std::atomic<uint64_t>[]> mJpegSizes;
+
+            std::unique_ptr<ContactSheet> mContactSheet;
+            std::mutex mContactSheetLock;
+            FileData mContactSheetData;
+            std::atomic<uint64_t> mContactSheetSize;
+
+            const bool mFrameStats;
+            const TakeStatsOptions mFrameStatsOptions;
+            std::mutex mFrameStatsLock;
+            FileData mFrameStatsData[static_cast<size_t>(StatsFormat::Count)];
+            std::atomic<uint64_t> mFrameStatsSizes[static_cast<size_t>(StatsFormat::Count)];
+
+            std::span<const Timestamp> mFrames;
+            std::vector<FrameMetadata> mFrameMetadata;
+
+            // See raw::HashFrame(), 0 until the frame has been read
+            std::unique_ptr<std::atomic<uint64_t>[]> mFrameHashes;
+            uint64_t mTotalFileSize;
+
+            std::mutex mDecoderLock;
+            std::vector<std::unique_ptr<SegmentedDecoder>> mDecoders;
+
+            std::mutex mCacheLock;
+
+            // Keyed by frame index and view, see CacheKey()
+            std::list<size_t> mLru;
+            std::unordered_map<size_t, CacheEntry> mCache;
+
+            // Last frame rendered with each hash, per view. Its file may have been evicted since.
+            std::unordered_map<uint64_t, size_t> mHashFrames[static_cast<size_t>(View::Count)];
+            uint64_t mNextId;
+        };
+    }
+}
+
+#endif /* McrawFileSystem_hpp */
@@ -0,0 +1,792 @@
+//
+// Mounts a .mcraw container as a read only directory of frame_N.dng files using the libfuse3
+// low level API.
+//
+//   mcrawfs-fuse [options] <file.mcraw> <mountpoint>
+//
+// The files never change, so the kernel is told to keep their pages cached across opens and to
+// cache lookups and attributes for a long time. Reads are answered from a small cache of
+// rendered frames and spliced into the kernel when it supports it.
+//
+// Unless -o proxy=0 is given, a proxy directory has the same frames binned 2x (or 4x with
+// -o proxy=4) for editing. They are binned while the frame is decoded, which makes them much
+// quicker to read than the full frames.
+//
+// A preview directory has a frame_N.jpg for every frame, demosaiced at half size (after binning
+// by -o jpeg=N) for looking through a recording quickly. Their size isn't known until they are
+// encoded, so they are listed with an upper bound that is replaced by the real size once read,
+// and served with direct I/O.
+//
+// With -o defects=N hot and dead pixels are found in N frames spread over the take when it is
+// mounted. They are listed in the OpcodeList1 of the full size DNGs for raw processors to fix
+// and fixed before the demosaic of the linear DNGs.
+//
+// With -o linear a linear directory has the frames demosaiced as 16 bit LinearRaw DNGs in camera
+// RGB with the container's colour matrices, for compositing tools that don't demosaic.
+//
+// contact_sheet.jpg in the root tiles thumbnails of up to -o contact_sheet=N frames spread over
+// the take (or every Nth frame with -o contact_step=N) for triage. It is rendered from the proxy
+// decode the first time it is opened and kept. -o contact_unique leaves out frames that repeat
+// one already on the sheet, for timelapses.
+//
+// A frame whose compressed data is the same as that of a frame still in the cache has its DNGs
+// copied from the earlier one's pixels instead of decoded again.
+//
+// frame_stats.csv and frame_stats.json in the root have the min, max, mean, clipped fraction and
+// (in the JSON) histogram of each CFA colour of every frame, for checking exposure across a take.
+// They are estimated from the block headers of each frame unless -o exact_stats is given, which
+// decodes every frame instead. Both are collected the first time either is opened and kept.
+//
+// With -o stats a .stats file in the root shows the pipeline counters and latencies as JSON,
+// every open takes a new snapshot. -o trace does the same for .trace.json, a timeline of the
+// most recent reads that chrome://tracing and Perfetto open.
+//
+
+#define FUSE_USE_VERSION 312
+
+#include "McrawFileSystem.hpp"
+
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <fuse_lowlevel.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+using motioncam::fuse::McrawFileSystem;
+using motioncam::fuse::StatsFormat;
+using motioncam::fuse::View;
+
+namespace stats = motioncam::stats;
+namespace trace = motioncam::trace;
+
+namespace {
+    // Inodes between the root and the first frame are for virtual files and directories. The
+    // frames of each view follow each other, see FrameIno().
+    const fuse_ino_t STATS_INO = FUSE_ROOT_ID + 1;
+    const fuse_ino_t TRACE_INO = FUSE_ROOT_ID + 2;
+    const fuse_ino_t PROXY_DIR_INO = FUSE_ROOT_ID + 3;
+    const fuse_ino_t PREVIEW_DIR_INO = FUSE_ROOT_ID + 4;
+    const fuse_ino_t CONTACT_SHEET_INO = FUSE_ROOT_ID + 5;
+    const fuse_ino_t FRAME_STATS_CSV_INO = FUSE_ROOT_ID + 6;
+    const fuse_ino_t FRAME_STATS_JSON_INO = FUSE_ROOT_ID + 7;
+    const fuse_ino_t LINEAR_DIR_INO = FUSE_ROOT_ID + 8;
+    const fuse_ino_t FIRST_FRAME_INO = FUSE_ROOT_ID + 16;
+
+    const char* STATS_NAME = ".stats";
+    const char* TRACE_NAME = ".trace.json";
+    const char* CONTACT_SHEET_NAME = "contact_sheet.jpg";
+    const char* FRAME_STATS_CSV_NAME = "frame_stats.csv";
+    const char* FRAME_STATS_JSON_NAME = "frame_stats.json";
+    const char* PROXY_DIR_NAME = "proxy";
+    const char* PREVIEW_DIR_NAME = "preview";
+    const char* LINEAR_DIR_NAME = "linear";
+
+    const int DEFAULT_PROXY_FACTOR = 2;
+    const int DEFAULT_JPEG_BINNING = 2;
+    const int DEFAULT_CONTACT_SHEET_FRAMES = 100;
+
+    struct Options {
+        const char* container = nullptr;
+        unsigned int cacheFrames = 8;
+        int previewSize = motioncam::FrameRenderer::DEFAULT_PREVIEW_SIZE;
+        int proxy = DEFAULT_PROXY_FACTOR;
+        int jpeg = DEFAULT_JPEG_BINNING;
+        int jpegQuality = motioncam::PreviewRenderer::DEFAULT_JPEG_QUALITY;
+        int linear = 0;
+        int defects = 0;
+        int contactSheet = DEFAULT_CONTACT_SHEET_FRAMES;
+        unsigned int contactStep = 0;
+        int contactUnique = 0;
+        int frameStats = 1;
+        int exactStats = 0;
+        double timeout = 3600.0;
+        int stats = 0;
+        int trace = 0;
+    };
+
+    const struct fuse_opt OPTION_SPEC[] = {
+        { "cache_frames=%u", offsetof(Options, cacheFrames), 0 },
+        { "preview_size=%d", offsetof(Options, previewSize), 0 },
+        { "proxy=%d", offsetof(Options, proxy), 0 },
+        { "jpeg=%d", offsetof(Options, jpeg), 0 },
+        { "jpeg_quality=%d", offsetof(Options, jpegQuality), 0 },
+        { "linear", offsetof(Options, linear), 1 },
+        { "defects=%d", offsetof(Options, defects), 0 },
+        { "contact_sheet=%d", offsetof(Options, contactSheet), 0 },
+        { "contact_step=%u", offsetof(Options, contactStep), 0 },
+        { "contact_unique", offsetof(Options, contactUnique), 1 },
+        { "frame_stats=%d", offsetof(Options, frameStats), 0 },
+        { "exact_stats", offsetof(Options, exactStats), 1 },
+        { "timeout=%lf", offsetof(Options, timeout), 0 },
+        { "stats", offsetof(Options, stats), 1 },
+        { "trace", offsetof(Options, trace), 1 },
+        FUSE_OPT_END
+    };
+
+    struct VirtualFile {
+        std::string name;
+        fuse_ino_t ino;
+    };
+
+    // Subdirectory of the root with the frames of a view
+    struct Directory {
+        std::string name;
+        fuse_ino_t ino;
+        View view;
+    };
+
+    struct Context {
+        std::unique_ptr<McrawFileSystem> fs;
+        double timeout;
+        struct timespec mtime;
+
+        // Listed after "." and "..", before the frames
+        std::vector<VirtualFile> virtualFiles;
+        std::vector<Directory> directories;
+    };
+
+    Context& GetContext(fuse_req_t req) {
+        return *static_cast<Context*>(fuse_req_userdata(req));
+    }
+
+    fuse_ino_t FrameIno(const Context& context, View view, size_t index) {
+        return FIRST_FRAME_INO + static_cast<fuse_ino_t>(view) * context.fs->numFrames() + index;
+    }
+
+    bool FindFrame(const Context& context, fuse_ino_t ino, View& outView, size_t& outIndex) {
+        if(ino < FIRST_FRAME_INO)
+            return false;
+
+        const size_t numFrames = context.fs->numFrames();
+        const size_t view = (ino - FIRST_FRAME_INO) / numFrames;
+
+        if(view >= static_cast<size_t>(View::Count) || !context.fs->hasView(static_cast<View>(view)))
+            return false;
+
+        outView = static_cast<View>(view);
+        outIndex = (ino - FIRST_FRAME_INO) % numFrames;
+
+        return true;
+    }
+
+    bool IsFrame(const Context& context, fuse_ino_t ino) {
+        View view;
+        size_t index;
+
+        return FindFrame(context, ino, view, index);
+    }
+
+    // Frames whose size can change once they have been read, see McrawFileSystem::hasFixedSize()
+    bool IsVariableFrame(const Context& context, fuse_ino_t ino) {
+        View view;
+        size_t index;
+
+        return FindFrame(context, ino, view, index) && !McrawFileSystem::hasFixedSize(view);
+    }
+
+    // Path of a frame relative to the mount point, for messages
+    std::string FramePath(const Context& context, View view, size_t index) {
+        for(const auto& directory : context.directories) {
+            if(directory.view == view)
+                return directory.name + "/" + McrawFileSystem::frameName(index, view);
+        }
+
+        return McrawFileSystem::frameName(index, view);
+    }
+
+    const Directory* FindDirectory(const Context& context, fuse_ino_t ino) {
+        for(const auto& directory : context.directories) {
+            if(directory.ino == ino)
+                return &directory;
+        }
+
+        return nullptr;
+    }
+
+    bool IsDirectory(const Context& context, fuse_ino_t ino) {
+        return ino == FUSE_ROOT_ID || FindDirectory(context, ino) != nullptr;
+    }
+
+    const VirtualFile* FindVirtualFile(const Context& context, fuse_ino_t ino) {
+        for(const auto& file : context.virtualFiles) {
+            if(file.ino == ino)
+                return &file;
+        }
+
+        return nullptr;
+    }
+
+    StatsFormat StatsFormatOf(fuse_ino_t ino) {
+        return ino == FRAME_STATS_CSV_INO ? StatsFormat::Csv : StatsFormat::Json;
+    }
+
+    // Contents of a virtual file at the time it is opened
+    std::string VirtualFileContents(const Context& context, fuse_ino_t ino) {
+        if(ino == STATS_INO)
+            return stats::ToJson(stats::TakeSnapshot());
+
+        if(ino == TRACE_INO)
+            return trace::ToJson();
+
+        if(ino == CONTACT_SHEET_INO) {
+            auto data = context.fs->getContactSheet();
+            return std::string(data->begin(), data->end());
+        }
+
+        if(ino == FRAME_STATS_CSV_INO || ino == FRAME_STATS_JSON_INO) {
+            auto data = context.fs->getFrameStats(StatsFormatOf(ino));
+            return std::string(data->begin(), data->end());
+        }
+
+        return std::string();
+    }
+
+    uint64_t VirtualFileSize(const Context& context, fuse_ino_t ino) {
+        // Too slow to render for a stat
+        if(ino == CONTACT_SHEET_INO)
+            return context.fs->contactSheetSize();
+
+        if(ino == FRAME_STATS_CSV_INO || ino == FRAME_STATS_JSON_INO)
+            return context.fs->frameStatsSize(StatsFormatOf(ino));
+
+        return VirtualFileContents(context, ino).size();
+    }
+
+    // readdir offsets: 0 ".", 1 "..", the virtual files and directories in the root, then one
+    // per frame
+    off_t FirstFrameOffset(const Context& context, fuse_ino_t ino) {
+        if(ino != FUSE_ROOT_ID)
+            return 2;
+
+        return 2 + static_cast<off_t>(context.virtualFiles.size() + context.directories.size());
+    }
+
+    bool FillAttributes(const Context& context, fuse_ino_t ino, struct stat& st) {
+        std::memset(&st, 0, sizeof(st));
+
+        st.st_ino = ino;
+        st.st_uid = getuid();
+        st.st_gid = getgid();
+        st.st_atim = context.mtime;
+        st.st_mtim = context.mtime;
+        st.st_ctim = context.mtime;
+
+        View view;
+        size_t index;
+
+        if(ino == FUSE_ROOT_ID) {
+            st.st_mode = S_IFDIR | 0555;
+            st.st_nlink = 2 + context.directories.size();
+        }
+        else if(FindDirectory(context, ino)) {
+            st.st_mode = S_IFDIR | 0555;
+            st.st_nlink = 2;
+        }
+        else if(FindFrame(context, ino, view, index)) {
+            st.st_mode = S_IFREG | 0444;
+            st.st_nlink = 1;
+            st.st_size = static_cast<off_t>(context.fs->frameFileSize(index, view));
+            st.st_blocks = (st.st_size + 511) / 512;
+        }
+        else if(FindVirtualFile(context, ino)) {
+            // Only a guess, the contents change all the time and are read with direct I/O
+            st.st_mode = S_IFREG | 0444;
+            st.st_nlink = 1;
+            st.st_size = static_cast<off_t>(VirtualFileSize(context, ino));
+        }
+        else {
+            return false;
+        }
+
+        return true;
+    }
+
+    //
+    // Low level operations
+    //
+
+    void Init(void* userdata, struct fuse_conn_info* conn) {
+        (void) userdata;
+
+        // Hand read buffers to the kernel with splice() instead of copying them into the request
+        if(conn->capable & FUSE_CAP_SPLICE_WRITE)
+            conn->want |= FUSE_CAP_SPLICE_WRITE;
+
+        if(conn->capable & FUSE_CAP_SPLICE_MOVE)
+            conn->want |= FUSE_CAP_SPLICE_MOVE;
+
+        // Nothing ever changes, don't drop cached pages when attributes are refreshed
+        conn->want &= ~FUSE_CAP_AUTO_INVAL_DATA;
+    }
+
+    void Lookup(fuse_req_t req, fuse_ino_t parent, const char* name) {
+        const Context& context = GetContext(req);
+
+        struct fuse_entry_param entry;
+        std::memset(&entry, 0, sizeof(entry));
+
+        entry.attr_timeout = context.timeout;
+        entry.entry_timeout = context.timeout;
+
+        const Directory* directory = FindDirectory(context, parent);
+        const View view = directory ? directory->view : View::Frame;
+        size_t index;
+
+        if(parent != FUSE_ROOT_ID && !directory) {
+            fuse_reply_err(req, ENOTDIR);
+            return;
+        }
+
+        if(context.fs->findFrame(name, index, view)) {
+            entry.ino = FrameIno(context, view, index);
+
+            if(!McrawFileSystem::hasFixedSize(view))
+                entry.attr_timeout = 0;
+        }
+        else if(parent == FUSE_ROOT_ID) {
+            for(const auto& file : context.virtualFiles) {
+                if(file.name == name) {
+                    entry.ino = file.ino;
+
+                    // The size changes with the contents
+                    entry.attr_timeout = 0;
+                }
+            }
+
+            for(const auto& subdirectory : context.directories) {
+                if(subdirectory.name == name)
+                    entry.ino = subdirectory.ino;
+            }
+        }
+
+        if(entry.ino == 0) {
+            fuse_reply_err(req, ENOENT);
+            return;
+        }
+
+        FillAttributes(context, entry.ino, entry.attr);
+
+        fuse_reply_entry(req, &entry);
+    }
+
+    void GetAttr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+        (void) fi;
+
+        const Context& context = GetContext(req);
+        struct stat st;
+
+        if(!FillAttributes(context, ino, st)) {
+            fuse_reply_err(req, ENOENT);
+            return;
+        }
+
+        const bool variableSize = FindVirtualFile(context, ino) || IsVariableFrame(context, ino);
+
+        fuse_reply_attr(req, &st, variableSize ? 0 : context.timeout);
+    }
+
+    void ReadDir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi) {
+        (void) fi;
+
+        const Context& context = GetContext(req);
+        const Directory* directory = FindDirectory(context, ino);
+
+        if(!IsDirectory(context, ino)) {
+            fuse_reply_err(req, ENOTDIR);
+            return;
+        }
+
+        const View view = directory ? directory->view : View::Frame;
+        const off_t firstFrameOffset = FirstFrameOffset(context, ino);
+        const off_t numEntries = firstFrameOffset + static_cast<off_t>(context.fs->numFrames());
+
+        std::vector<char> buffer(size);
+        size_t used = 0;
+
+        for(off_t i = offset; i < numEntries; i++) {
+            struct stat st;
+            std::string name;
+
+            if(i == 0) {
+                name = ".";
+                FillAttributes(context, ino, st);
+            }
+            else if(i == 1) {
+                // Directories are only ever one level down
+                name = "..";
+                FillAttributes(context, FUSE_ROOT_ID, st);
+            }
+            else if(i < firstFrameOffset && static_cast<size_t>(i - 2) < context.virtualFiles.size()) {
+                const VirtualFile& file = context.virtualFiles[static_cast<size_t>(i - 2)];
+
+                name = file.name;
+                FillAttributes(context, file.ino, st);
+            }
+            else if(i < firstFrameOffset) {
+                const Directory& subdirectory = context.directories[static_cast<size_t>(i - 2) - context.virtualFiles.size()];
+
+                name = subdirectory.name;
+                FillAttributes(context, subdirectory.ino, st);
+            }
+            else {
+                const size_t index = static_cast<size_t>(i - firstFrameOffset);
+
+                name = McrawFileSystem::frameName(index, view);
+                FillAttributes(context, FrameIno(context, view, index), st);
+            }
+
+            const size_t entrySize = fuse_add_direntry(req, buffer.data() + used, size - used, name.c_str(), &st, i + 1);
+            if(entrySize > size - used)
+                break;
+
+            used += entrySize;
+        }
+
+        fuse_reply_buf(req, buffer.data(), used);
+    }
+
+    void Open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+        const Context& context = GetContext(req);
+        const bool isVirtual = FindVirtualFile(context, ino) != nullptr;
+
+        if(!IsFrame(context, ino) && !isVirtual) {
+            fuse_reply_err(req, IsDirectory(context, ino) ? EISDIR : ENOENT);
+            return;
+        }
+
+        if((fi->flags & O_ACCMODE) != O_RDONLY) {
+            fuse_reply_err(req, EROFS);
+            return;
+        }
+
+        if(isVirtual) {
+            // Every open sees a new snapshot, which the file handle keeps until it is released
+            try {
+                fi->fh = reinterpret_cast<uint64_t>(new std::string(VirtualFileContents(context, ino)));
+            }
+            catch(const std::exception& e) {
+                std::fprintf(stderr, "mcrawfs-fuse: failed to read %s: %s\n", FindVirtualFile(context, ino)->name.c_str(), e.what());
+
+                fuse_reply_err(req, EIO);
+                return;
+            }
+
+            fi->direct_io = 1;
+
+            fuse_reply_open(req, fi);
+            return;
+        }
+
+        if(IsVariableFrame(context, ino)) {
+            // Reads past the real end of the file are cut short rather than padded by the kernel
+            fi->direct_io = 1;
+
+            fuse_reply_open(req, fi);
+            return;
+        }
+
+        // Contents are immutable, let the page cache survive across opens
+        fi->keep_cache = 1;
+
+        fuse_reply_open(req, fi);
+    }
+
+    void ReadVirtualFile(fuse_req_t req, size_t size, off_t offset, struct fuse_file_info* fi) {
+        const std::string& contents = *reinterpret_cast<const std::string*>(fi->fh);
+
+        if(offset < 0 || static_cast<uint64_t>(offset) >= contents.size()) {
+            fuse_reply_buf(req, nullptr, 0);
+            return;
+        }
+
+        fuse_reply_buf(req, contents.data() + offset, std::min(size, contents.size() - static_cast<size_t>(offset)));
+    }
+
+    void Read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t offset, struct fuse_file_info* fi) {
+        Context& context = GetContext(req);
+
+        if(FindVirtualFile(context, ino)) {
+            ReadVirtualFile(req, size, offset, fi);
+            return;
+        }
+
+        View view;
+        size_t index;
+
+        if(!FindFrame(context, ino, view, index)) {
+            fuse_reply_err(req, ENOENT);
+            return;
+        }
+
+        motioncam::fuse::FileData data;
+
+        try {
+            data = context.fs->getFrame(index, view);
+        }
+        catch(const std::exception& e) {
+            std::fprintf(stderr, "mcrawfs-fuse: failed to read %s: %s\n", FramePath(context, view, index).c_str(), e.what());
+
+            fuse_reply_err(req, EIO);
+            return;
+        }
+
+        if(offset < 0 || static_cast<uint64_t>(offset) >= data->size()) {
+            fuse_reply_buf(req, nullptr, 0);
+            return;
+        }
+
+        const size_t length = std::min(size, data->size() - static_cast<size_t>(offset));
+
+        // data stays alive until the reply has been written (or spliced) to the kernel
+        struct fuse_bufvec buffer = FUSE_BUFVEC_INIT(length);
+        buffer.buf[0].mem = const_cast<uint8_t*>(data->data() + offset);
+
+        stats::ScopedTimer timer(stats::Stage::Copy);
+        trace::ScopedEvent event("reply");
+
+        fuse_reply_data(req, &buffer, FUSE_BUF_SPLICE_MOVE);
+
+        stats::Add(stats::Counter::BytesServed, length);
+    }
+
+    void Release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info* fi) {
+        const Context& context = GetContext(req);
+
+        if(FindVirtualFile(context, ino))
+            delete reinterpret_cast<std::string*>(fi->fh);
+
+        fuse_reply_err(req, 0);
+    }
+
+    void StatFs(fuse_req_t req, fuse_ino_t ino) {
+        (void) ino;
+
+        const Context& context = GetContext(req);
+
+        struct statvfs st;
+        std::memset(&st, 0, sizeof(st));
+
+        st.f_bsize = 4096;
+        st.f_frsize = 4096;
+        st.f_blocks = (context.fs->totalFileSize() + 4095) / 4096;
+        size_t numViews = 0;
+
+        for(size_t view = 0; view < static_cast<size_t>(View::Count); view++)
+            numViews += context.fs->hasView(static_cast<View>(view)) ? 1 : 0;
+
+        st.f_files = numViews * context.fs->numFrames() + context.virtualFiles.size() + context.directories.size() + 1;
+        st.f_namemax = 255;
+
+        fuse_reply_statfs(req, &st);
+    }
+
+    int ParseOption(void* data, const char* arg, int key, struct fuse_args* outargs) {
+        (void) outargs;
+
+        Options* options = static_cast<Options*>(data);
+
+        // The first plain argument is the container, the mount point is left for fuse_parse_cmdline()
+        if(key == FUSE_OPT_KEY_NONOPT && options->container == nullptr) {
+            options->container = strdup(arg);
+            return 0;
+        }
+
+        return 1;
+    }
+
+    void PrintUsage(const char* program) {
+        std::printf("usage: %s [options] <file.mcraw> <mountpoint>\n\n", program);
+        std::printf("mcrawfs options:\n");
+        std::printf("    -o cache_frames=N      number of rendered frames to keep in memory (default: 8)\n");
+        std::printf("    -o preview_size=N      long edge of the preview in each DNG, 0 for none (default: %d)\n", motioncam::FrameRenderer::DEFAULT_PREVIEW_SIZE);
+        std::printf("    -o proxy=N             binning of the frames in /proxy, 2 or 4, 0 for none (default: %d)\n", DEFAULT_PROXY_FACTOR);
+        std::printf("    -o jpeg=N              binning of the JPEGs in /preview, 1, 2 or 4, 0 for none (default: %d)\n", DEFAULT_JPEG_BINNING);
+        std::printf("    -o jpeg_quality=N      quality of the JPEGs in /preview (default: %d)\n", motioncam::PreviewRenderer::DEFAULT_JPEG_QUALITY);
+        std::printf("    -o linear              demosaiced linear DNGs in /linear\n");
+        std::printf("    -o defects=N           find hot and dead pixels in N frames and list them in the DNGs\n");
+        std::printf("    -o contact_sheet=N     thumbnails in /contact_sheet.jpg, 0 for none (default: %d)\n", DEFAULT_CONTACT_SHEET_FRAMES);
+        std::printf("    -o contact_step=N      put every Nth frame on the contact sheet instead\n");
+        std::printf("    -o contact_unique      leave repeated frames off the contact sheet\n");
+        std::printf("    -o frame_stats=0       leave out /frame_stats.csv and /frame_stats.json\n");
+        std::printf("    -o exact_stats         decode every frame for the frame statistics instead of estimating them\n");
+        std::printf("    -o timeout=SECONDS     entry/attribute cache timeout (default: 3600)\n");
+        std::printf("    -o stats               collect pipeline statistics and show them in /.stats\n");
+        std::printf("    -o trace               record a timeline of recent reads in /.trace.json\n\n");
+
+        fuse_cmdline_help();
+        fuse_lowlevel_help();
+    }
+}
+
+int main(int argc, char** argv) {
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts opts;
+    Options options;
+
+    if(fuse_opt_parse(&args, &options, OPTION_SPEC, ParseOption) != 0)
+        return 1;
+
+    if(fuse_parse_cmdline(&args, &opts) != 0)
+        return 1;
+
+    int result = 1;
+
+    if(opts.show_help) {
+        PrintUsage(argv[0]);
+        result = 0;
+    }
+    else if(opts.show_version) {
+        std::printf("FUSE library version %s\n", fuse_pkgversion());
+        fuse_lowlevel_version();
+        result = 0;
+    }
+    else if(!options.container || !opts.mountpoint) {
+        PrintUsage(argv[0]);
+    }
+    else {
+        Context context;
+        context.timeout = options.timeout;
+
+        if(options.stats) {
+            stats::SetEnabled(true);
+            context.virtualFiles.push_back({ STATS_NAME, STATS_INO });
+        }
+
+        if(options.trace) {
+            trace::SetEnabled(true);
+            context.virtualFiles.push_back({ TRACE_NAME, TRACE_INO });
+        }
+
+        if(options.jpeg > 0 && !motioncam::PreviewRenderer::supportsJpeg()) {
+            if(options.jpeg != DEFAULT_JPEG_BINNING)
+                std::fprintf(stderr, "%s: built without JPEG support, leaving out /%s\n", argv[0], PREVIEW_DIR_NAME);
+
+            options.jpeg = 0;
+        }
+
+        if(options.contactSheet > 0 && !motioncam::PreviewRenderer::supportsJpeg()) {
+            if(options.contactSheet != DEFAULT_CONTACT_SHEET_FRAMES)
+                std::fprintf(stderr, "%s: built without JPEG support, leaving out /%s\n", argv[0], CONTACT_SHEET_NAME);
+
+            options.contactSheet = 0;
+        }
+
+        try {
+            motioncam::fuse::FileSystemOptions fsOptions;
+
+            fsOptions.maxCacheFrames = options.cacheFrames;
+            fsOptions.previewSize = options.previewSize;
+            fsOptions.proxyFactor = options.proxy;
+            fsOptions.jpegBinning = options.jpeg;
+            fsOptions.jpegQuality = options.jpegQuality;
+            fsOptions.linear = options.linear != 0;
+            fsOptions.defectPixels = options.defects > 0;
+            fsOptions.defectPixelOptions.numFrames = static_cast<size_t>(std::max(0, options.defects));
+            fsOptions.contactSheet = options.contactSheet > 0;
+            fsOptions.contactSheetOptions.maxFrames = static_cast<size_t>(std::max(0, options.contactSheet));
+            fsOptions.contactSheetOptions.frameStep = options.contactStep;
+            fsOptions.contactSheetOptions.skipRepeats = options.contactUnique != 0;
+            fsOptions.contactSheetOptions.quality = options.jpegQuality;
+            fsOptions.frameStats = options.frameStats != 0;
+            fsOptions.frameStatsOptions.exact = options.exactStats != 0;
+
+            context.fs = std::make_unique<McrawFileSystem>(options.container, fsOptions);
+
+            if(options.proxy > 0)
+                context.directories.push_back({ PROXY_DIR_NAME, PROXY_DIR_INO, View::Proxy });
+
+            if(options.jpeg > 0)
+                context.directories.push_back({ PREVIEW_DIR_NAME, PREVIEW_DIR_INO, View::Preview });
+
+            if(options.linear)
+                context.directories.push_back({ LINEAR_DIR_NAME, LINEAR_DIR_INO, View::Linear });
+
+            if(options.contactSheet > 0)
+                context.virtualFiles.push_back({ CONTACT_SHEET_NAME, CONTACT_SHEET_INO });
+
+            if(options.frameStats) {
+                context.virtualFiles.push_back({ FRAME_STATS_CSV_NAME, FRAME_STATS_CSV_INO });
+                context.virtualFiles.push_back({ FRAME_STATS_JSON_NAME, FRAME_STATS_JSON_INO });
+            }
+        }
+        catch(const std::exception& e) {
+            std::fprintf(stderr, "%s: failed to open %s: %s\n", argv[0], options.container, e.what());
+        }
+
+        struct stat st;
+
+        if(context.fs && stat(options.container, &st) != 0) {
+            std::fprintf(stderr, "%s: failed to stat %s: %s\n", argv[0], options.container, std::strerror(errno));
+            context.fs.reset();
+        }
+
+        if(context.fs) {
+            context.mtime = st.st_mtim;
+
+            const std::string fsName = std::string("-ofsname=") + options.container + ",subtype=mcrawfs,ro";
+            fuse_opt_add_arg(&args, fsName.c_str());
+
+            struct fuse_lowlevel_ops ops;
+            std::memset(&ops, 0, sizeof(ops));
+
+            ops.init = Init;
+            ops.lookup = Lookup;
+            ops.getattr = GetAttr;
+            ops.readdir = ReadDir;
+            ops.open = Open;
+            ops.read = Read;
+            ops.release = Release;
+            ops.statfs = StatFs;
+
+            struct fuse_session* session = fuse_session_new(&args, &ops, sizeof(ops), &context);
+
+            if(session) {
+                if(fuse_set_signal_handlers(session) == 0) {
+                    if(fuse_session_mount(session, opts.mountpoint) == 0) {
+                        fuse_daemonize(opts.foreground);
+
+                        if(opts.singlethread) {
+                            result = fuse_session_loop(session);
+                        }
+                        else {
+                            struct fuse_loop_config* config = fuse_loop_cfg_create();
+
+                            fuse_loop_cfg_set_clone_fd(config, opts.clone_fd);
+                            fuse_loop_cfg_set_max_threads(config, opts.max_threads);
+
+                            result = fuse_session_loop_mt(session, config);
+
+                            fuse_loop_cfg_destroy(config);
+                        }
+
+                        fuse_session_unmount(session);
+                    }
+
+                    fuse_remove_signal_handlers(session);
+                }
+
+                fuse_session_destroy(session);
+            }
+        }
+    }
+
+    std::free(const_cast<char*>(options.container));
+    std::free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+
+    return result == 0 ? 0 : 1;
+}
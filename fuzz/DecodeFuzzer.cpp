@@ -0,0 +1,272 @@
+//
+// Differential fuzzer for the raw bitstream decoders.
+//
+// Every input is decoded by the scalar reference decoder, raw::Decode() for each instruction set
+// level the machine supports, raw::DecodeParallel() and raw::Validate(). They must all agree on
+// whether the frame is valid and, if it is, produce identical pixels. raw::DecodeBinned() has to
+// match raw::Bin() of the reference pixels. raw::DecodeWithStats() has to produce the same pixels
+// and statistics that match a per pixel count over them, raw::EstimateStats() has to agree on
+// the pixel counts and, for frames straight from the encoder, bound min and max.
+// raw::SummarizeBlocks() has to accept the frame and agree with the means of the estimate, and
+// both have to give the same results on the frame with its pixels stripped out.
+// raw::DecodeNormalized() has to match normalizing the reference pixels in every output format.
+// raw::DecodeLegacy() is run on the same bytes to check it doesn't crash.
+//
+// Input layout:
+//   byte 0      mode. Bit 0 clear: the rest of the input is used as an encoded frame as is.
+//               Bit 0 set: the rest is used as pixel data that is encoded with raw::Encode()
+//               and then has one byte corrupted if bit 1 is set. Bits 2-4 and 5-7 shift the
+//               pixel values left and right.
+//   bytes 1-2   width
+//   byte 3      height
+//
+
+#include "ReferenceDecoder.hpp"
+
+#include <motioncam/RawData.hpp>
+
+#if defined(MCRAWFS_SIMD_MULTIVERSION)
+#include "RawData_Targets.hpp"
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const size_t HEADER_SIZE = 4;
+
+    typedef size_t (*DecodeFunc)(uint16_t*, const int, const int, const uint8_t*, const size_t);
+
+    struct Decoder {
+        const char* name;
+        DecodeFunc decode;
+        bool supported;
+    };
+
+    size_t DecodeParallel(uint16_t* output, const int width, const int height, const uint8_t* input, const size_t len) {
+        return motioncam::raw::DecodeParallel(output, width, height, input, len, 3);
+    }
+
+    std::vector<Decoder> GetDecoders() {
+        std::vector<Decoder> decoders = {
+            { "raw::Decode", motioncam::raw::Decode, true },
+            { "raw::DecodeParallel", DecodeParallel, true }
+        };
+
+#if defined(MCRAWFS_SIMD_MULTIVERSION)
+        __builtin_cpu_init();
+
+        decoders.push_back({ "x86_64::Decode", motioncam::raw::x86_64::Decode, true });
+        decoders.push_back({ "x86_64_v2::Decode", motioncam::raw::x86_64_v2::Decode,
+            __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt") });
+        decoders.push_back({ "x86_64_v3::Decode", motioncam::raw::x86_64_v3::Decode,
+            __builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma") });
+#endif
+
+        return decoders;
+    }
+
+    [[noreturn]] void Fail(const char* name, const char* what, int width, int height) {
+        std::fprintf(stderr, "%s: %s (%dx%d)\n", name, what, width, height);
+        std::abort();
+    }
+
+    // Build a valid frame from the fuzzer's bytes so the decoders see more than the header checks
+    void MakeEncodedFrame(std::vector<uint8_t>& output, const uint8_t mode, const int width, const int height, const uint8_t* data, const size_t size) {
+        std::vector<uint16_t> pixels(static_cast<size_t>(width) * height);
+
+        // Narrow or widen the values so every block bit width gets exercised
+        const int shiftLeft = (mode >> 2) & 0x07;
+        const int shiftRight = (mode >> 5) & 0x07;
+
+        for(size_t i = 0; i < pixels.size(); i++)
+            pixels[i] = size > 0 ? static_cast<uint16_t>((data[i % size] >> shiftRight) << shiftLeft) : 0;
+
+        motioncam::raw::Encode(output, pixels.data(), width, height);
+
+        if((mode & 0x02) && size > 0 && !output.empty())
+            output[(data[0] * 257 + size) % output.size()] ^= data[size - 1] | 0x01;
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const std::vector<Decoder> decoders = GetDecoders();
+
+    if(size < HEADER_SIZE)
+        return 0;
+
+    const uint8_t mode = data[0];
+    const int width = 2 + ((data[1] | (data[2] << 8)) % 510);
+    const int height = 2 + (data[3] % 62);
+
+    data += HEADER_SIZE;
+    size -= HEADER_SIZE;
+
+    std::vector<uint8_t> input;
+
+    if(mode & 0x01)
+        MakeEncodedFrame(input, mode, width, height, data, size);
+    else
+        input.assign(data, data + size);
+
+    const size_t numPixels = static_cast<size_t>(width) * height;
+
+    std::vector<uint16_t> expected(numPixels, 0xAAAA);
+    const size_t expectedResult = motioncam::fuzz::ReferenceDecode(expected.data(), width, height, input.data(), input.size());
+
+    if(motioncam::raw::Validate(width, height, input.data(), input.size()) != (expectedResult > 0))
+        Fail("raw::Validate", "disagrees with reference decoder", width, height);
+
+    std::vector<uint16_t> output;
+
+    for(const auto& decoder : decoders) {
+        if(!decoder.supported)
+            continue;
+
+        // A different fill value than the reference so pixels that are never written show up
+        output.assign(numPixels, 0x5555);
+
+        const size_t result = decoder.decode(output.data(), width, height, input.data(), input.size());
+
+        if(result != expectedResult)
+            Fail(decoder.name, "result differs from reference decoder", width, height);
+
+        if(result > 0 && output != expected)
+            Fail(decoder.name, "pixels differ from reference decoder", width, height);
+    }
+
+    // Binning while unpacking gives the same pixels as binning the decoded frame
+    for(int factor : { 2, 4 }) {
+        const size_t numBinned = static_cast<size_t>(motioncam::raw::BinnedSize(width, factor)) * motioncam::raw::BinnedSize(height, factor);
+
+        if(numBinned == 0 || expectedResult == 0)
+            continue;
+
+        std::vector<uint16_t> binned(numBinned);
+        motioncam::raw::Bin(binned.data(), expected.data(), width, height, factor);
+
+        output.assign(numBinned, 0x5555);
+
+        if(motioncam::raw::DecodeBinned(output.data(), width, height, input.data(), input.size(), factor) != numBinned)
+            Fail("raw::DecodeBinned", "result differs from reference decoder", width, height);
+
+        if(output != binned)
+            Fail("raw::DecodeBinned", "pixels differ from binned reference", width, height);
+    }
+
+    // Statistics gathered while decoding match counting them afterwards
+    if(expectedResult > 0) {
+        motioncam::raw::FrameStats stats;
+        motioncam::raw::FrameStats expectedStats;
+
+        // Somewhere in the range of the pixels so clipping and the last bin both see use
+        stats.clipLevel = expectedStats.clipLevel = static_cast<uint16_t>(0x0100 << (mode & 0x07));
+        stats.histogramShift = expectedStats.histogramShift = (mode >> 3) & 0x0F;
+
+        motioncam::fuzz::ReferenceStats(expected.data(), width, height, expectedStats);
+
+        output.assign(numPixels, 0x5555);
+
+        if(motioncam::raw::DecodeWithStats(output.data(), width, height, input.data(), input.size(), stats) != expectedResult)
+            Fail("raw::DecodeWithStats", "result differs from reference decoder", width, height);
+
+        if(output != expected)
+            Fail("raw::DecodeWithStats", "pixels differ from reference decoder", width, height);
+
+        if(!motioncam::fuzz::StatsEqual(stats, expectedStats))
+            Fail("raw::DecodeWithStats", "statistics differ from reference", width, height);
+
+        motioncam::raw::FrameStats estimate;
+
+        if(!motioncam::raw::EstimateStats(width, height, input.data(), input.size(), estimate))
+            Fail("raw::EstimateStats", "rejected a valid frame", width, height);
+
+        // Corrupt blocks can wrap around, their references say nothing about the pixels
+        const bool encoded = (mode & 0x03) == 0x01;
+
+        for(int p = 0; p < 4; p++) {
+            if(estimate.count[p] != expectedStats.count[p])
+                Fail("raw::EstimateStats", "pixel counts differ from reference", width, height);
+
+            if(encoded && (estimate.min[p] > expectedStats.min[p] || estimate.max[p] < expectedStats.max[p]))
+                Fail("raw::EstimateStats", "min or max is out of bounds", width, height);
+        }
+
+        motioncam::raw::BlockSummary summary;
+
+        if(!motioncam::raw::SummarizeBlocks(width, height, input.data(), input.size(), summary))
+            Fail("raw::SummarizeBlocks", "rejected a valid frame", width, height);
+
+        for(int p = 0; p < 4; p++) {
+            const double mean = estimate.count[p] > 0 ? static_cast<double>(estimate.sum[p]) / static_cast<double>(estimate.count[p]) : 0.0;
+
+            if(std::abs(summary.mean[p] - mean) > 0.01 * std::max(1.0, mean))
+                Fail("raw::SummarizeBlocks", "means differ from raw::EstimateStats", width, height);
+        }
+
+        if(summary.shadows > summary.highlights)
+            Fail("raw::SummarizeBlocks", "shadows are above highlights", width, height);
+
+        // The same frame without its pixels, the way Decoder::loadBlockHeaders() reads it
+        const size_t headersOffset = motioncam::raw::BlockHeadersOffset(input.data());
+
+        if(headersOffset >= motioncam::raw::FRAME_HEADER_SIZE && headersOffset <= input.size()) {
+            std::vector<uint8_t> stripped(input.begin(), input.begin() + motioncam::raw::FRAME_HEADER_SIZE);
+            stripped.insert(stripped.end(), input.begin() + static_cast<std::ptrdiff_t>(headersOffset), input.end());
+
+            motioncam::raw::StripPixels(stripped.data());
+
+            motioncam::raw::FrameStats strippedEstimate;
+            motioncam::raw::BlockSummary strippedSummary;
+
+            if(!motioncam::raw::EstimateStats(width, height, stripped.data(), stripped.size(), strippedEstimate) ||
+               std::memcmp(&strippedEstimate, &estimate, sizeof(estimate)) != 0)
+                Fail("raw::EstimateStats", "stripped frame gives different results", width, height);
+
+            if(!motioncam::raw::SummarizeBlocks(width, height, stripped.data(), stripped.size(), strippedSummary) ||
+               std::memcmp(&strippedSummary, &summary, sizeof(summary)) != 0)
+                Fail("raw::SummarizeBlocks", "stripped frame gives different results", width, height);
+        }
+    }
+
+    // Normalizing as the pixels are stored matches normalizing the reference pixels
+    if(expectedResult > 0) {
+        motioncam::raw::Normalization normalization;
+
+        // Black levels that differ per colour and a white level that clips some pixels
+        for(int p = 0; p < 4; p++)
+            normalization.blackLevel[p] = static_cast<float>((mode * (p + 1) * 7) & 0xFF);
+
+        normalization.whiteLevel = static_cast<float>(0x0100 << (mode & 0x07));
+
+        const motioncam::raw::OutputFormat formats[] = {
+            motioncam::raw::OutputFormat::UInt16, motioncam::raw::OutputFormat::Half, motioncam::raw::OutputFormat::Float
+        };
+
+        for(const auto format : formats) {
+            normalization.format = format;
+
+            const size_t numBytes = numPixels * motioncam::raw::BytesPerPixel(format);
+
+            std::vector<uint8_t> normalized(numBytes, 0x55);
+            std::vector<uint8_t> expectedNormalized(numBytes, 0);
+
+            motioncam::fuzz::ReferenceNormalize(expectedNormalized.data(), expected.data(), width, height, normalization);
+
+            if(motioncam::raw::DecodeNormalized(normalized.data(), width, height, input.data(), input.size(), normalization, 1 + (mode & 0x01)) != expectedResult)
+                Fail("raw::DecodeNormalized", "result differs from reference decoder", width, height);
+
+            if(normalized != expectedNormalized)
+                Fail("raw::DecodeNormalized", "pixels differ from normalized reference", width, height);
+        }
+    }
+
+    // The legacy decoder has no reference, just make sure it stays within its buffers
+    output.assign(numPixels, 0);
+    motioncam::raw::DecodeLegacy(output.data(), width, height, input.data(), input.size());
+
+    return 0;
+}
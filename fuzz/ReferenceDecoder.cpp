@@ -0,0 +1,329 @@
+#include "ReferenceDecoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace motioncam {
+    namespace fuzz {
+
+    namespace {
+    const int ENCODING_BLOCK = 64;
+    const int HEADER_LENGTH = 2;
+    const int METADATA_OFFSET = 16;
+
+    // Bytes used by a block of each bit width. 7 bits are stored as 8, 9 as 10 and 11-16 as 16.
+    size_t BlockLength(int bits) {
+        if(bits == 7)
+            bits = 8;
+        else if(bits == 9)
+            bits = 10;
+        else if(bits > 10)
+            bits = 16;
+
+        return static_cast<size_t>(bits) * ENCODING_BLOCK / 8;
+    }
+
+    uint32_t Read32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    // Value i of a block is in lane (i % 8) of its 8 byte group, see RawData_Encoder.cpp
+    void DecodeBlock(uint16_t* v, const int bits, const uint8_t* b) {
+        switch(bits) {
+            case 0:
+                for(int i = 0; i < 64; i++)
+                    v[i] = 0;
+                break;
+
+            case 1:
+                for(int k = 0; k < 8; k++)
+                    for(int j = 0; j < 8; j++)
+                        v[k*8 + j] = (b[j] >> k) & 0x01;
+                break;
+
+            case 2:
+                for(int h = 0; h < 2; h++)
+                    for(int k = 0; k < 4; k++)
+                        for(int j = 0; j < 8; j++)
+                            v[h*32 + k*8 + j] = (b[h*8 + j] >> (k*2)) & 0x03;
+                break;
+
+            case 3:
+                for(int j = 0; j < 8; j++) {
+                    const int b0 = b[j], b1 = b[j + 8], b2 = b[j + 16];
+
+                    v[j]      = b0 & 0x07;
+                    v[j + 8]  = (b0 >> 3) & 0x07;
+                    v[j + 16] = ((b0 >> 6) & 0x03) | (((b2 >> 6) & 0x01) << 2);
+                    v[j + 24] = b1 & 0x07;
+                    v[j + 32] = (b1 >> 3) & 0x07;
+                    v[j + 40] = ((b1 >> 6) & 0x03) | (((b2 >> 7) & 0x01) << 2);
+                    v[j + 48] = b2 & 0x07;
+                    v[j + 56] = (b2 >> 3) & 0x07;
+                }
+                break;
+
+            case 4:
+                for(int h = 0; h < 4; h++)
+                    for(int j = 0; j < 8; j++) {
+                        v[h*16 + j]     = b[h*8 + j] & 0x0F;
+                        v[h*16 + 8 + j] = b[h*8 + j] >> 4;
+                    }
+                break;
+
+            case 5:
+                for(int j = 0; j < 8; j++) {
+                    const int b0 = b[j], b1 = b[j + 8], b2 = b[j + 16], b3 = b[j + 24], b4 = b[j + 32];
+
+                    v[j]      = b0 & 0x1F;
+                    v[j + 8]  = b1 & 0x1F;
+                    v[j + 16] = b2 & 0x1F;
+                    v[j + 24] = b3 & 0x1F;
+                    v[j + 32] = b4 & 0x1F;
+                    v[j + 40] = (b0 >> 5) | (((b3 >> 5) & 0x03) << 3);
+                    v[j + 48] = (b1 >> 5) | (((b4 >> 5) & 0x03) << 3);
+                    v[j + 56] = (b2 >> 5) | (((b3 >> 7) & 0x01) << 3) | (((b4 >> 7) & 0x01) << 4);
+                }
+                break;
+
+            case 6:
+                for(int j = 0; j < 8; j++) {
+                    for(int m = 0; m < 6; m++)
+                        v[j + m*8] = b[j + m*8] & 0x3F;
+
+                    v[j + 48] = (b[j]      >> 6) | ((b[j + 8]  >> 6) << 2) | ((b[j + 16] >> 6) << 4);
+                    v[j + 56] = (b[j + 24] >> 6) | ((b[j + 32] >> 6) << 2) | ((b[j + 40] >> 6) << 4);
+                }
+                break;
+
+            case 7:
+            case 8:
+                for(int i = 0; i < 64; i++)
+                    v[i] = b[i];
+                break;
+
+            case 9:
+            case 10:
+                for(int h = 0; h < 2; h++) {
+                    const uint8_t* p = b + h*40;
+
+                    for(int m = 0; m < 4; m++)
+                        for(int j = 0; j < 8; j++)
+                            v[h*32 + m*8 + j] = p[m*8 + j] | (((p[32 + j] >> (m*2)) & 0x03) << 8);
+                }
+                break;
+
+            default:
+                for(int i = 0; i < 64; i++)
+                    v[i] = b[i*2] | (b[i*2 + 1] << 8);
+                break;
+        }
+    }
+
+    bool DecodeMetadata(const uint8_t* input, size_t offset, const size_t len, const size_t numValues, std::vector<uint16_t>& out) {
+        if(offset + 4 > len || Read32(input + offset) < numValues)
+            return false;
+
+        offset += 4;
+        out.clear();
+
+        uint16_t block[ENCODING_BLOCK];
+
+        while(out.size() < numValues) {
+            if(offset + HEADER_LENGTH > len)
+                return false;
+
+            const int bits = input[offset] >> 4;
+            const uint16_t reference = ((input[offset] & 0x0F) << 8) | input[offset + 1];
+
+            offset += HEADER_LENGTH;
+
+            if(offset + BlockLength(bits) > len)
+                return false;
+
+            DecodeBlock(block, bits, input + offset);
+            offset += BlockLength(bits);
+
+            for(int i = 0; i < ENCODING_BLOCK; i++)
+                out.push_back(static_cast<uint16_t>(block[i] + reference));
+        }
+
+        return true;
+    }
+
+    // Half precision bits of a value in [0, 1], rounded to nearest with ties to even
+    uint16_t ToHalf(const float value) {
+        const double v = value;
+
+        // Subnormals are multiples of 2^-24
+        if(v < std::ldexp(1.0, -14))
+            return static_cast<uint16_t>(std::nearbyint(std::ldexp(v, 24)));
+
+        int exponent = 0;
+        std::frexp(v, &exponent);
+        exponent -= 1;
+
+        int mantissa = static_cast<int>(std::nearbyint((std::ldexp(v, -exponent) - 1.0) * 1024.0));
+
+        if(mantissa == 1024) {
+            mantissa = 0;
+            exponent++;
+        }
+
+        return static_cast<uint16_t>(((exponent + 15) << 10) | mantissa);
+    }
+    }
+
+    size_t ReferenceDecode(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len)
+    {
+        if(width <= 0 || height <= 0 || len < METADATA_OFFSET)
+            return 0;
+
+        const uint32_t encodedWidth  = Read32(input);
+        const uint32_t encodedHeight = Read32(input + 4);
+        const uint32_t bitsOffset    = Read32(input + 8);
+        const uint32_t refsOffset    = Read32(input + 12);
+
+        if(bitsOffset > len || refsOffset > len)
+            return 0;
+
+        if(encodedWidth % ENCODING_BLOCK != 0 || encodedWidth < static_cast<uint32_t>(width) || encodedHeight < static_cast<uint32_t>(height))
+            return 0;
+
+        const size_t blocksPerGroup = encodedWidth / ENCODING_BLOCK * 4;
+        const size_t numGroups = (height + 3) / 4;
+        const size_t numBlocks = blocksPerGroup * numGroups;
+
+        // Cheap size check so huge headers don't allocate, same as raw::Decode()
+        if(numBlocks / ENCODING_BLOCK * HEADER_LENGTH * 2 > len)
+            return 0;
+
+        std::vector<uint16_t> bits, refs;
+
+        if(!DecodeMetadata(input, bitsOffset, len, numBlocks, bits) || !DecodeMetadata(input, refsOffset, len, numBlocks, refs))
+            return 0;
+
+        size_t end = METADATA_OFFSET;
+
+        for(size_t i = 0; i < numBlocks; i++) {
+            if(bits[i] > 16)
+                return 0;
+
+            end += BlockLength(bits[i]);
+        }
+
+        if(end > len)
+            return 0;
+
+        // Every block holds one colour channel of two rows: channel c covers row (c / 2) and
+        // (c / 2) + 2, columns with parity (c % 2)
+        std::vector<uint16_t> frame(static_cast<size_t>(encodedWidth) * numGroups * 4);
+        uint16_t block[ENCODING_BLOCK];
+
+        size_t offset = METADATA_OFFSET;
+        size_t blockIdx = 0;
+
+        for(size_t group = 0; group < numGroups; group++) {
+            for(uint32_t x = 0; x < encodedWidth; x += ENCODING_BLOCK) {
+                for(int c = 0; c < 4; c++, blockIdx++) {
+                    DecodeBlock(block, bits[blockIdx], input + offset);
+                    offset += BlockLength(bits[blockIdx]);
+
+                    for(int i = 0; i < ENCODING_BLOCK; i++) {
+                        const size_t row = group*4 + (c / 2) + (i / 32) * 2;
+                        const size_t col = x + (i % 32) * 2 + (c % 2);
+
+                        frame[row * encodedWidth + col] = static_cast<uint16_t>(block[i] + refs[blockIdx]);
+                    }
+                }
+            }
+        }
+
+        for(int y = 0; y < height; y++)
+            std::memcpy(output + static_cast<size_t>(y) * width, frame.data() + static_cast<size_t>(y) * encodedWidth, width * sizeof(uint16_t));
+
+        return static_cast<size_t>(width) * height;
+    }
+
+    void ReferenceStats(
+        const uint16_t* image,
+        const int width,
+        const int height,
+        raw::FrameStats& stats)
+    {
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                const int p = (y % 2) * 2 + (x % 2);
+                const uint16_t value = image[static_cast<size_t>(y) * width + x];
+
+                if(value < stats.min[p])
+                    stats.min[p] = value;
+
+                if(value > stats.max[p])
+                    stats.max[p] = value;
+
+                stats.sum[p] += value;
+                stats.count[p]++;
+
+                if(value >= stats.clipLevel)
+                    stats.clipped[p]++;
+
+                const int bin = value >> stats.histogramShift;
+                stats.histogram[p][bin < raw::FrameStats::HISTOGRAM_BINS ? bin : raw::FrameStats::HISTOGRAM_BINS - 1]++;
+            }
+        }
+    }
+
+    void ReferenceNormalize(
+        void* output,
+        const uint16_t* image,
+        const int width,
+        const int height,
+        const raw::Normalization& normalization)
+    {
+        const float max = normalization.format == raw::OutputFormat::UInt16 ? 65535.0f : 1.0f;
+
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                const int p = (y % 2) * 2 + (x % 2);
+                const size_t i = static_cast<size_t>(y) * width + x;
+
+                const float black = normalization.blackLevel[p];
+                const float scale = max / std::max(1.0f, normalization.whiteLevel - black);
+
+                float value = (static_cast<float>(image[i]) - black) * scale;
+
+                if(value < 0.0f)
+                    value = 0.0f;
+                if(value > max)
+                    value = max;
+
+                if(normalization.format == raw::OutputFormat::Float)
+                    static_cast<float*>(output)[i] = value;
+                else if(normalization.format == raw::OutputFormat::Half)
+                    static_cast<uint16_t*>(output)[i] = ToHalf(value);
+                else
+                    static_cast<uint16_t*>(output)[i] = static_cast<uint16_t>(std::nearbyint(value));
+            }
+        }
+    }
+
+    bool StatsEqual(const raw::FrameStats& a, const raw::FrameStats& b) {
+        for(int p = 0; p < 4; p++) {
+            if(a.min[p] != b.min[p] || a.max[p] != b.max[p] || a.sum[p] != b.sum[p] || a.count[p] != b.count[p] || a.clipped[p] != b.clipped[p])
+                return false;
+
+            if(std::memcmp(a.histogram[p], b.histogram[p], sizeof(a.histogram[p])) != 0)
+                return false;
+        }
+
+        return true;
+    }
+}}
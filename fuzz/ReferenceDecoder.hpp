@@ -0,0 +1,39 @@
+#ifndef ReferenceDecoder_hpp
+#define ReferenceDecoder_hpp
+
+#include <motioncam/RawData.hpp>
+
+#include <stddef.h>
+#include <cstdint>
+
+namespace motioncam {
+    namespace fuzz {
+        // Plain scalar implementation of raw::Decode() written from the bitstream layout (see
+        // RawData_Encoder.cpp) rather than from the SIMD code. Slow, only used to check the others.
+        size_t ReferenceDecode(
+            uint16_t* output,
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len);
+
+        // Plain per pixel version of raw::AccumulateStats()
+        void ReferenceStats(
+            const uint16_t* image,
+            const int width,
+            const int height,
+            raw::FrameStats& stats);
+
+        // Plain per pixel version of raw::Normalize(), with its own conversion to half precision
+        void ReferenceNormalize(
+            void* output,
+            const uint16_t* image,
+            const int width,
+            const int height,
+            const raw::Normalization& normalization);
+
+        bool StatsEqual(const raw::FrameStats& a, const raw::FrameStats& b);
+    }
+}
+
+#endif /* ReferenceDecoder_hpp */
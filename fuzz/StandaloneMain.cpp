@@ -0,0 +1,67 @@
+//
+// Driver for compilers without libFuzzer. Replays the given files, or with -runs=N feeds N
+// pseudo random inputs. Build with Clang to get coverage guided fuzzing instead.
+//
+//   decode_fuzzer [-runs=N] [-seed=N] [file ...]
+//
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+int main(int argc, char** argv) {
+    unsigned long runs = 0;
+    unsigned long seed = 1;
+    int numFiles = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(std::strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = std::strtoul(argv[i] + 6, nullptr, 10);
+            continue;
+        }
+
+        if(std::strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = std::strtoul(argv[i] + 6, nullptr, 10);
+            continue;
+        }
+
+        std::ifstream file(argv[i], std::ios::binary);
+        if(!file) {
+            std::fprintf(stderr, "Failed to open %s\n", argv[i]);
+            return 1;
+        }
+
+        const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+        ++numFiles;
+    }
+
+    std::mt19937 rng(static_cast<uint32_t>(seed));
+    std::vector<uint8_t> data;
+
+    for(unsigned long run = 0; run < runs; run++) {
+        data.resize(4 + rng() % 8192);
+
+        for(auto& byte : data)
+            byte = static_cast<uint8_t>(rng());
+
+        // Mostly structured inputs, random bytes rarely get past the header checks
+        if(run % 4 != 0)
+            data[0] |= 0x01;
+
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+
+    std::printf("Executed %d files and %lu random inputs\n", numFiles, runs);
+
+    return 0;
+}
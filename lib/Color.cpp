@@ -0,0 +1,80 @@
+#include "Color.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace motioncam {
+    namespace color {
+        namespace {
+            // XYZ (D50) to linear sRGB, the connection space of the forward matrices
+            const float XYZ_D50_TO_SRGB[9] = {
+                 3.1338561f, -1.6168667f, -0.4906146f,
+                -0.9787684f,  1.9161415f,  0.0334540f,
+                 0.0719453f, -0.2289914f,  1.4052427f
+            };
+
+            void Multiply(const float* a, const float* b, float* out) {
+                for(int i = 0; i < 3; i++) {
+                    for(int j = 0; j < 3; j++)
+                        out[i*3 + j] = a[i*3] * b[j] + a[i*3 + 1] * b[3 + j] + a[i*3 + 2] * b[6 + j];
+                }
+            }
+        }
+
+        CFA CFAFromArrangement(const std::string& sensorArrangement) {
+            if(sensorArrangement == "rggb")
+                return { 0, 1, 1, 2 };
+            else if(sensorArrangement == "bggr")
+                return { 2, 1, 1, 0 };
+            else if(sensorArrangement == "grbg")
+                return { 1, 0, 2, 1 };
+
+            // gbrg
+            return { 1, 2, 0, 1 };
+        }
+
+        std::array<float, 9> CameraToSrgb(const ContainerMetadata& containerMetadata) {
+            const auto& forwardMatrix = containerMetadata.forwardMatrix1;
+            std::array<float, 9> matrix = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+            if(forwardMatrix.size() >= 9 &&
+               std::any_of(forwardMatrix.begin(), forwardMatrix.begin() + 9, [](float value) { return value != 0; }))
+            {
+                Multiply(XYZ_D50_TO_SRGB, forwardMatrix.data(), matrix.data());
+            }
+
+            return matrix;
+        }
+
+        std::vector<uint8_t> SrgbGammaTable() {
+            std::vector<uint8_t> table(GAMMA_TABLE_SIZE);
+
+            for(int i = 0; i < GAMMA_TABLE_SIZE; i++) {
+                const double linear = static_cast<double>(i) / (GAMMA_TABLE_SIZE - 1);
+                const double srgb = linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+
+                table[i] = static_cast<uint8_t>(std::lround(std::clamp(srgb, 0.0, 1.0) * 255.0));
+            }
+
+            return table;
+        }
+
+        void FrameMatrix(
+            const std::array<float, 9>& cameraToSrgb,
+            const ContainerMetadata& containerMetadata,
+            const FrameMetadata& metadata,
+            float* outMatrix)
+        {
+            // Scale to [0, 1] and white balance, then convert to sRGB in one matrix
+            const double black = containerMetadata.blackLevel.empty() ? 0.0 : containerMetadata.blackLevel[0];
+            const float range = static_cast<float>(std::max(1.0, containerMetadata.whiteLevel - black));
+
+            for(int i = 0; i < 3; i++) {
+                for(int c = 0; c < 3; c++) {
+                    const float neutral = metadata.asShotNeutral.size() > static_cast<size_t>(c) && metadata.asShotNeutral[c] > 0 ? metadata.asShotNeutral[c] : 1.0f;
+                    outMatrix[i*3 + c] = cameraToSrgb[i*3 + c] / (neutral * range);
+                }
+            }
+        }
+    }
+}
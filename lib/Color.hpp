@@ -0,0 +1,38 @@
+#ifndef Color_hpp
+#define Color_hpp
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Metadata.hpp>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    namespace color {
+        // Entries in SrgbGammaTable(), linear values in [0, 1] are looked up at
+        // value * (GAMMA_TABLE_SIZE - 1) + 0.5
+        const int GAMMA_TABLE_SIZE = 4096;
+
+        // Colour (0 red, 1 green, 2 blue) of each pixel of a 2x2 quad, in row order
+        CFA CFAFromArrangement(const std::string& sensorArrangement);
+
+        // White balanced camera RGB to linear sRGB, through the D65 forward matrix. Without a
+        // forward matrix the camera colours are shown as they are.
+        std::array<float, 9> CameraToSrgb(const ContainerMetadata& containerMetadata);
+
+        // Linear to 8 bit sRGB
+        std::vector<uint8_t> SrgbGammaTable();
+
+        // cameraToSrgb scaled for a frame, so it takes raw camera RGB less the black level and
+        // gives linear sRGB where the white level is 1
+        void FrameMatrix(
+            const std::array<float, 9>& cameraToSrgb,
+            const ContainerMetadata& containerMetadata,
+            const FrameMetadata& metadata,
+            float* outMatrix);
+    }
+}
+
+#endif /* Color_hpp */
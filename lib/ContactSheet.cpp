@@ -0,0 +1,217 @@
+#include "Jpeg.hpp"
+
+#include <motioncam/ContactSheet.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace motioncam {
+    namespace {
+        // Grey behind and between the thumbnails
+        const uint8_t BACKGROUND = 32;
+
+        // Averages scale x scale blocks of an RGB image. Partial blocks at the right and bottom
+        // edges are dropped.
+        void Downscale(const uint8_t* input, int width, int height, int scale, uint8_t* output) {
+            const int outWidth = width / scale;
+            const int outHeight = height / scale;
+            const uint32_t area = static_cast<uint32_t>(scale * scale);
+
+            std::vector<uint32_t> sums(3 * static_cast<size_t>(outWidth));
+
+            for(int y = 0; y < outHeight; y++) {
+                std::fill(sums.begin(), sums.end(), 0);
+
+                for(int row = y * scale; row < (y + 1) * scale; row++) {
+                    const uint8_t* in = input + static_cast<size_t>(row) * width * 3;
+
+                    for(int x = 0; x < outWidth; x++) {
+                        for(int i = 0; i < scale; i++) {
+                            sums[3*x + 0] += in[0];
+                            sums[3*x + 1] += in[1];
+                            sums[3*x + 2] += in[2];
+
+                            in += 3;
+                        }
+                    }
+                }
+
+                uint8_t* out = output + static_cast<size_t>(y) * outWidth * 3;
+
+                for(size_t i = 0; i < sums.size(); i++)
+                    out[i] = static_cast<uint8_t>((sums[i] + area / 2) / area);
+            }
+        }
+    }
+
+    ContactSheet::ContactSheet(SegmentedDecoder& decoder, const ContactSheetOptions& options) :
+        mOptions(options),
+        mPrototype(decoder.clone()),
+        mRenderer(ContainerMetadata::parse(decoder.getContainerMetadata()), options.binning)
+    {
+        if(mOptions.binning != 2 && mOptions.binning != 4)
+            throw MotionCamException("Invalid binning (" + std::to_string(mOptions.binning) + ")");
+
+        if(mOptions.thumbnailSize <= 0 || mOptions.spacing < 0)
+            throw MotionCamException("Invalid contact sheet size");
+
+        const size_t numFrames = decoder.getFrames().size();
+
+        if(numFrames == 0)
+            throw IOException("Container has no frames");
+
+        size_t step = mOptions.frameStep;
+
+        if(step == 0)
+            step = std::max<size_t>(1, (numFrames + mOptions.maxFrames - 1) / std::max<size_t>(1, mOptions.maxFrames));
+
+        if(mOptions.skipRepeats) {
+            const auto timestamps = decoder.getFrames();
+
+            std::unordered_set<uint64_t> fingerprints;
+            std::vector<uint8_t> buffer;
+            std::string frameMetadata;
+
+            for(size_t i = 0; i < numFrames; i += step) {
+                decoder.loadBlockHeaders(timestamps[i], buffer, frameMetadata);
+
+                const FrameMetadata metadata = FrameMetadata::parse(frameMetadata);
+
+                if(fingerprints.insert(Decoder::fingerprint(buffer, metadata.compressionType)).second)
+                    mFrames.push_back(i);
+            }
+        }
+        else {
+            for(size_t i = 0; i < numFrames; i += step)
+                mFrames.push_back(i);
+        }
+
+        mColumns = mOptions.columns == 0 ? mFrames.size() : std::min(mOptions.columns, mFrames.size());
+
+        // Every cell is the size of the thumbnail of the first frame
+        const FrameMetadata metadata = FrameMetadata::parse(decoder.loadFrameMetadataAt(mFrames[0]));
+        const int previewWidth = mRenderer.width(metadata);
+        const int previewHeight = mRenderer.height(metadata);
+
+        if(previewWidth <= 0 || previewHeight <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        mScale = (std::max(previewWidth, previewHeight) + mOptions.thumbnailSize - 1) / mOptions.thumbnailSize;
+        mCellWidth = previewWidth / mScale;
+        mCellHeight = previewHeight / mScale;
+
+        const size_t rows = (mFrames.size() + mColumns - 1) / mColumns;
+
+        mWidth = static_cast<int>(mColumns) * (mCellWidth + mOptions.spacing) + mOptions.spacing;
+        mHeight = static_cast<int>(rows) * (mCellHeight + mOptions.spacing) + mOptions.spacing;
+    }
+
+    void ContactSheet::renderCell(SegmentedDecoder& decoder, size_t cell, uint8_t* output) const {
+        const size_t index = mFrames[cell];
+        const FrameMetadata metadata = FrameMetadata::parse(decoder.loadFrameMetadataAt(index));
+
+        const int previewWidth = mRenderer.width(metadata);
+        const int previewHeight = mRenderer.height(metadata);
+
+        if(previewWidth <= 0 || previewHeight <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        std::vector<uint8_t> preview(3 * static_cast<size_t>(previewWidth) * previewHeight);
+
+        size_t segmentIndex = 0;
+        Decoder& segment = decoder.decoderFor(index, segmentIndex);
+
+        // The threads are already busy with other frames
+        mRenderer.render(segment, segmentIndex, metadata, preview.data(), 1);
+
+        const int thumbnailWidth = previewWidth / mScale;
+        const int thumbnailHeight = previewHeight / mScale;
+
+        std::vector<uint8_t> thumbnail(3 * static_cast<size_t>(thumbnailWidth) * thumbnailHeight);
+        Downscale(preview.data(), previewWidth, previewHeight, mScale, thumbnail.data());
+
+        // Centre the thumbnail in its cell, cropping it if it is larger
+        const int copyWidth = std::min(thumbnailWidth, mCellWidth);
+        const int copyHeight = std::min(thumbnailHeight, mCellHeight);
+
+        const int cellX = static_cast<int>(cell % mColumns) * (mCellWidth + mOptions.spacing) + mOptions.spacing;
+        const int cellY = static_cast<int>(cell / mColumns) * (mCellHeight + mOptions.spacing) + mOptions.spacing;
+
+        const int srcX = (thumbnailWidth - copyWidth) / 2;
+        const int srcY = (thumbnailHeight - copyHeight) / 2;
+        const int dstX = cellX + (mCellWidth - copyWidth) / 2;
+        const int dstY = cellY + (mCellHeight - copyHeight) / 2;
+
+        for(int y = 0; y < copyHeight; y++) {
+            std::memcpy(
+                output + (static_cast<size_t>(dstY + y) * mWidth + dstX) * 3,
+                thumbnail.data() + (static_cast<size_t>(srcY + y) * thumbnailWidth + srcX) * 3,
+                3 * static_cast<size_t>(copyWidth));
+        }
+    }
+
+    void ContactSheet::render(uint8_t* output) const {
+        trace::ScopedEvent event("contact_sheet");
+
+        std::memset(output, BACKGROUND, 3 * static_cast<size_t>(mWidth) * mHeight);
+
+        unsigned int numThreads = mOptions.numThreads;
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        numThreads = static_cast<unsigned int>(std::min<size_t>(numThreads, mFrames.size()));
+
+        // Cells don't overlap, so the threads write straight into output
+        std::atomic<size_t> nextCell(0);
+        std::mutex errorLock;
+        std::exception_ptr error;
+
+        auto work = [&] {
+            try {
+                auto decoder = mPrototype->clone();
+
+                for(size_t cell = nextCell++; cell < mFrames.size(); cell = nextCell++)
+                    renderCell(*decoder, cell, output);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(errorLock);
+                if(!error)
+                    error = std::current_exception();
+
+                // Leave the remaining frames
+                nextCell = mFrames.size();
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for(unsigned int i = 1; i < numThreads; i++)
+            threads.emplace_back(work);
+
+        work();
+
+        for(auto& thread : threads)
+            thread.join();
+
+        if(error)
+            std::rethrow_exception(error);
+    }
+
+    void ContactSheet::renderJpeg(std::vector<uint8_t>& output) const {
+        if(!PreviewRenderer::supportsJpeg())
+            throw MotionCamException("Built without JPEG support");
+
+        std::vector<uint8_t> rgb(3 * static_cast<size_t>(mWidth) * mHeight);
+
+        render(rgb.data());
+
+        trace::ScopedEvent event("jpeg");
+        jpeg::Encode(rgb.data(), mWidth, mHeight, mOptions.quality, output);
+    }
+} // namespace motioncam
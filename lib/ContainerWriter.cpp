@@ -0,0 +1,111 @@
+#include <motioncam/ContainerWriter.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+    #define FTELL _ftelli64
+#elif defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+    #define FTELL ftello
+#else
+    #error Unknown platform
+#endif
+
+namespace motioncam {
+    ContainerWriter::ContainerWriter(const std::string& path, const std::string& containerMetadata) :
+        mFile(std::fopen(path.c_str(), "wb"))
+    {
+        if(!mFile)
+            throw IOException("Failed to open " + path);
+
+        Header header{};
+
+        std::memcpy(header.ident, CONTAINER_ID, sizeof(CONTAINER_ID));
+        header.version = CONTAINER_VERSION;
+
+        write(&header, sizeof(Header));
+        writeItem(Type::METADATA, containerMetadata.data(), containerMetadata.size());
+    }
+
+    void ContainerWriter::writeFrame(const Timestamp timestamp, const std::vector<uint8_t>& buffer, const std::string& metadata) {
+        mOffsets.push_back({ tell(), timestamp });
+
+        writeItem(Type::BUFFER, buffer.data(), buffer.size());
+        writeItem(Type::METADATA, metadata.data(), metadata.size());
+    }
+
+    void ContainerWriter::writeAudio(const AudioChunk& chunk) {
+        writeAudio(chunk.first, chunk.second.data(), chunk.second.size() * sizeof(int16_t));
+    }
+
+    void ContainerWriter::writeAudio(const RawAudioChunk& chunk) {
+        writeAudio(chunk.first, chunk.second.data(), chunk.second.size());
+    }
+
+    void ContainerWriter::writeAudio(const Timestamp timestamp, const void* data, size_t size) {
+        mAudioOffsets.push_back({ tell(), timestamp });
+
+        writeItem(Type::AUDIO_DATA, data, size);
+
+        if(timestamp >= 0) {
+            AudioMetadata metadata{ timestamp };
+            writeItem(Type::AUDIO_DATA_METADATA, &metadata, sizeof(AudioMetadata));
+        }
+    }
+
+    void ContainerWriter::finish() {
+        if(!mFile)
+            throw IOException("Container already finished");
+
+        // Audio index has to come after the last frame, that's where Decoder looks for it
+        if(!mAudioOffsets.empty()) {
+            AudioIndex audioIndex{};
+
+            audioIndex.numOffsets = static_cast<int64_t>(mAudioOffsets.size());
+            audioIndex.startTimestampMs = mAudioOffsets.front().timestamp >= 0 ? mAudioOffsets.front().timestamp / 1000000 : 0;
+
+            Item item{ Type::AUDIO_INDEX, static_cast<uint32_t>(sizeof(AudioIndex) + sizeof(BufferOffset) * mAudioOffsets.size()) };
+
+            write(&item, sizeof(Item));
+            write(&audioIndex, sizeof(AudioIndex));
+            write(mAudioOffsets.data(), sizeof(BufferOffset) * mAudioOffsets.size());
+        }
+
+        // Buffer index data followed by the fixed size index at the very end of the file
+        Item indexDataItem{ Type::BUFFER_INDEX_DATA, static_cast<uint32_t>(sizeof(BufferOffset) * mOffsets.size()) };
+        write(&indexDataItem, sizeof(Item));
+
+        BufferIndex index{};
+
+        index.magicNumber = INDEX_MAGIC_NUMBER;
+        index.numOffsets = static_cast<int32_t>(mOffsets.size());
+        index.indexDataOffset = tell();
+
+        write(mOffsets.data(), sizeof(BufferOffset) * mOffsets.size());
+        writeItem(Type::BUFFER_INDEX, &index, sizeof(BufferIndex));
+
+        if(std::fflush(mFile.get()) != 0)
+            throw IOException("Failed to write data");
+
+        mFile.reset();
+    }
+
+    void ContainerWriter::writeItem(Type type, const void* data, size_t size) {
+        Item item{ type, static_cast<uint32_t>(size) };
+
+        write(&item, sizeof(Item));
+        write(data, size);
+    }
+
+    void ContainerWriter::write(const void* data, size_t size) {
+        if(!mFile)
+            throw IOException("Container already finished");
+
+        if(size > 0 && std::fwrite(data, size, 1, mFile.get()) != 1)
+            throw IOException("Failed to write data");
+    }
+
+    int64_t ContainerWriter::tell() const {
+        return static_cast<int64_t>(FTELL(mFile.get()));
+    }
+} // namespace motioncam
@@ -1,25 +1,32 @@
 #include <motioncam/Decoder.hpp>
+#include <motioncam/Metadata.hpp>
 #include <motioncam/RawData.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
 
+#include "IoUring.hpp"
+#include "Recovery.hpp"
+
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstring>
 
 #if defined(_WIN32)
     #define FSEEK _fseeki64
     #define FTELL _ftelli64
+    #define FILENO _fileno
 #elif defined(__unix__) || defined(__linux__) || defined(__APPLE__)
     #define _FILE_OFFSET_BITS 64
     
     #define FSEEK fseeko
     #define FTELL ftello
+    #define FILENO fileno
 #else
     #error Unknown platform
 #endif
 
 namespace motioncam {
-    constexpr int MOTIONCAM_COMPRESSION_TYPE_LEGACY = 6;
-    constexpr int MOTIONCAM_COMPRESSION_TYPE = 7;
-
     namespace {
         class AudioChunkLoaderImpl : public AudioChunkLoader {
             public:
@@ -39,7 +46,28 @@ namespace motioncam {
             }
         }
     
-        bool loadAudioChunk(FILE* f, const BufferOffset& o, AudioChunk& outChunk) {
+        // Lower bound without a data dependent branch in the loop, the compiler turns the
+        // select into a conditional move so lookups don't pay for mispredictions
+        size_t LowerBound(std::span<const Timestamp> timestamps, const Timestamp timestamp) {
+            const Timestamp* base = timestamps.data();
+            size_t n = timestamps.size();
+
+            if(n == 0)
+                return 0;
+
+            while(n > 1) {
+                const size_t half = n / 2;
+
+                base = base[half] < timestamp ? base + half : base;
+                n -= half;
+            }
+
+            return static_cast<size_t>(base - timestamps.data()) + (*base < timestamp);
+        }
+
+        // Reads an audio chunk into samples of T, AudioChunk or the bytes as stored for RawAudioChunk
+        template<typename T>
+        bool loadAudioChunk(FILE* f, const BufferOffset& o, std::pair<Timestamp, std::vector<T>>& outChunk) {
             if(FSEEK(f, o.offset, SEEK_SET) != 0)
                 return false;
             
@@ -51,9 +79,9 @@ namespace motioncam {
                 throw IOException("Invalid audio data");
             
             // Read into temporary buffer
-            std::vector<int16_t> tmp;
+            std::vector<T> tmp;
 
-            tmp.resize((audioDataItem.size + 1) / 2);
+            tmp.resize((audioDataItem.size + sizeof(T) - 1) / sizeof(T));
             read(f, (void*)tmp.data(), audioDataItem.size);
 
             // Metadata should follow (this was added later so some files may not have it)
@@ -75,6 +103,28 @@ namespace motioncam {
         }
     }
     //
+
+    bool FindNearestTimestamp(std::span<const Timestamp> timestamps, const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex) {
+        if(timestamps.empty() || tolerance < 0)
+            return false;
+
+        // First timestamp not before the one we want, the nearest is either it or the one before
+        size_t index = LowerBound(timestamps, timestamp);
+
+        if(index == timestamps.size() || (index > 0 && timestamp - timestamps[index - 1] <= timestamps[index] - timestamp))
+            --index;
+
+        const Timestamp distance = timestamps[index] > timestamp ? timestamps[index] - timestamp : timestamp - timestamps[index];
+
+        if(distance > tolerance)
+            return false;
+
+        outIndex = index;
+
+        return true;
+    }
+
+    //
     
     AudioChunkLoaderImpl::AudioChunkLoaderImpl(FILE* f, const std::vector<BufferOffset>& offsets) :
         mFile(f), mOffsets(offsets), mIdx(0) {
@@ -94,14 +144,14 @@ namespace motioncam {
 
     //
 
-    Decoder::Decoder(FILE* file) : mFile(file) {
+    Decoder::Decoder(FILE* file) : mFile(file), mRecovered(false) {
         if(!mFile)
             throw IOException("Invalid file");
             
         init();
     }
 
-    Decoder::Decoder(const std::string& path) : mFile(std::fopen(path.c_str(), "rb")) {
+    Decoder::Decoder(const std::string& path) : mFile(std::fopen(path.c_str(), "rb")), mRecovered(false) {
         if(!mFile)
             throw IOException("Failed to open " + path);
             
@@ -134,24 +184,49 @@ namespace motioncam {
         // Keep the camera metadata
         mMetadata = std::string(metadataJson.begin(), metadataJson.end());
   
-        readIndex();
+        const int64_t dataStart = FTELL(mFile.get());
+
+        if(readIndex())
+            readExtra();
+        else
+            recoverIndex(dataStart);
 
-        reindexOffsets();
+        // Frames are bounded by whatever item comes next in the file, batched reads use this to
+        // read a whole frame without knowing its size
+        mItemOffsets.insert(mItemOffsets.end(), mFrameOffsets.begin(), mFrameOffsets.end());
 
-        readExtra();
+        for(const auto& o : mAudioOffsets)
+            mItemOffsets.push_back(o.offset);
+
+        std::sort(mItemOffsets.begin(), mItemOffsets.end());
         
         // Create audio loader
         mAudioLoader = std::make_unique<AudioChunkLoaderImpl>(mFile.get(), mAudioOffsets);
     }
     
-    const std::vector<Timestamp> Decoder::getFrames() const {
-        return mFrameList;
+    std::span<const Timestamp> Decoder::getFrames() const {
+        return mFrameTimestamps;
+    }
+
+    size_t Decoder::numFrames() const {
+        return mFrameTimestamps.size();
+    }
+
+    Timestamp Decoder::getFrameTimestamp(size_t index) const {
+        if(index >= mFrameTimestamps.size())
+            throw IOException("Frame not found (index: " + std::to_string(index) + ")");
+
+        return mFrameTimestamps[index];
     }
     
     const std::string Decoder::getContainerMetadata() const {
         return mMetadata;
     }
 
+    bool Decoder::isRecovered() const {
+        return mRecovered;
+    }
+
     void Decoder::loadAudio(std::vector<AudioChunk>& outAudioChunks) {
         for(const auto& o : mAudioOffsets) {
             AudioChunk chunk;
@@ -163,16 +238,37 @@ namespace motioncam {
         }
     }
     
+    void Decoder::loadRawAudio(std::vector<RawAudioChunk>& outAudioChunks) {
+        for(const auto& o : mAudioOffsets) {
+            RawAudioChunk chunk;
+
+            if(!loadAudioChunk(mFile.get(), o, chunk))
+                continue;
+
+            outAudioChunks.push_back(std::move(chunk));
+        }
+    }
+
     AudioChunkLoader& Decoder::loadAudio() const {
         return *mAudioLoader;
     }
 
+    bool Decoder::findNearestFrame(const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex) const {
+        return FindNearestTimestamp(mFrameTimestamps, timestamp, tolerance, outIndex);
+    }
+
     const std::string Decoder::loadFrameMetadata(const Timestamp timestamp) {
-        if(mFrameOffsetMap.find(timestamp) == mFrameOffsetMap.end())
-            throw IOException("Frame not found (timestamp: " + std::to_string(timestamp) + ")");
-        
-        int64_t offset = mFrameOffsetMap.at(timestamp).offset;
-        
+        return readFrameMetadata(frameOffset(timestamp));
+    }
+
+    const std::string Decoder::loadFrameMetadataAt(const size_t index) {
+        return readFrameMetadata(frameOffset(index));
+    }
+
+    const std::string Decoder::readFrameMetadata(int64_t offset) {
+        stats::ScopedTimer timer(stats::Stage::Read);
+        trace::ScopedEvent event("read_metadata");
+
         if(FSEEK(mFile.get(), offset, SEEK_SET) != 0)
             throw IOException("Invalid offset");
         
@@ -182,10 +278,10 @@ namespace motioncam {
         if(bufferItem.type != Type::BUFFER)
             throw IOException("Invalid buffer type");
 
-        mTmpBuffer.resize(bufferItem.size);
+        // Only the metadata after the pixels is needed
+        if(FSEEK(mFile.get(), bufferItem.size, SEEK_CUR) != 0)
+            throw IOException("Invalid offset");
 
-        read(mTmpBuffer.data(), bufferItem.size);
-                
         // Get metadata
         Item metadataItem{};
         read(&metadataItem, sizeof(Item));
@@ -195,16 +291,150 @@ namespace motioncam {
 
         std::vector<uint8_t> metadataJson(metadataItem.size);
         read(metadataJson.data(), metadataItem.size);
-        
+
+        stats::Add(stats::Counter::BytesRead, 2 * sizeof(Item) + metadataItem.size);
+
         return std::string(metadataJson.begin(), metadataJson.end());
     }
 
-    void Decoder::loadFrame(const Timestamp timestamp, std::vector<uint8_t>& outData, int width, int height, int compressionType) {
-        if(mFrameOffsetMap.find(timestamp) == mFrameOffsetMap.end())
-            throw IOException("Frame not found (timestamp: " + std::to_string(timestamp) + ")");
+    void Decoder::loadCompressedFrame(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata) {
+        const int64_t offset = frameOffset(timestamp);
+
+        stats::ScopedTimer timer(stats::Stage::Read);
+        trace::ScopedEvent event("read_compressed", timestamp);
         
-        int64_t offset = mFrameOffsetMap.at(timestamp).offset;
+        if(FSEEK(mFile.get(), offset, SEEK_SET) != 0)
+            throw IOException("Invalid offset");
+        
+        Item bufferItem{};
+        read(&bufferItem, sizeof(Item));
+
+        if(bufferItem.type != Type::BUFFER)
+            throw IOException("Invalid buffer type");
+
+        outBuffer.resize(bufferItem.size);
+
+        read(outBuffer.data(), bufferItem.size);
+        
+        // Get metadata
+        Item metadataItem{};
+        read(&metadataItem, sizeof(Item));
         
+        if(metadataItem.type != Type::METADATA)
+            throw IOException("Invalid metadata");
+
+        outMetadata.resize(metadataItem.size);
+        read(outMetadata.data(), metadataItem.size);
+
+        stats::Add(stats::Counter::BytesRead, 2 * sizeof(Item) + bufferItem.size + metadataItem.size);
+    }
+
+    void Decoder::loadBlockHeaders(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata) {
+        const int64_t offset = frameOffset(timestamp);
+
+        stats::ScopedTimer timer(stats::Stage::Read);
+        trace::ScopedEvent event("read_block_headers", timestamp);
+
+        if(FSEEK(mFile.get(), offset, SEEK_SET) != 0)
+            throw IOException("Invalid offset");
+
+        Item bufferItem{};
+        read(&bufferItem, sizeof(Item));
+
+        if(bufferItem.type != Type::BUFFER)
+            throw IOException("Invalid buffer type");
+
+        const int64_t bufferOffset = offset + static_cast<int64_t>(sizeof(Item));
+
+        // The metadata after the frame says whether it has block headers at all
+        if(FSEEK(mFile.get(), bufferOffset + bufferItem.size, SEEK_SET) != 0)
+            throw IOException("Invalid offset");
+
+        Item metadataItem{};
+        read(&metadataItem, sizeof(Item));
+
+        if(metadataItem.type != Type::METADATA)
+            throw IOException("Invalid metadata");
+
+        outMetadata.resize(metadataItem.size);
+        read(outMetadata.data(), metadataItem.size);
+
+        size_t headersOffset = 0;
+
+        if(FrameMetadata::parse(outMetadata).compressionType == MOTIONCAM_COMPRESSION_TYPE && bufferItem.size >= raw::FRAME_HEADER_SIZE) {
+            outBuffer.resize(raw::FRAME_HEADER_SIZE);
+
+            if(FSEEK(mFile.get(), bufferOffset, SEEK_SET) != 0)
+                throw IOException("Invalid offset");
+
+            read(outBuffer.data(), raw::FRAME_HEADER_SIZE);
+
+            headersOffset = raw::BlockHeadersOffset(outBuffer.data());
+        }
+
+        // Anything else is read whole and left to the decoder to accept or reject
+        if(headersOffset >= raw::FRAME_HEADER_SIZE && headersOffset <= bufferItem.size) {
+            outBuffer.resize(raw::FRAME_HEADER_SIZE + bufferItem.size - headersOffset);
+
+            if(FSEEK(mFile.get(), bufferOffset + static_cast<int64_t>(headersOffset), SEEK_SET) != 0)
+                throw IOException("Invalid offset");
+
+            read(outBuffer.data() + raw::FRAME_HEADER_SIZE, outBuffer.size() - raw::FRAME_HEADER_SIZE);
+            raw::StripPixels(outBuffer.data());
+        }
+        else {
+            outBuffer.resize(bufferItem.size);
+
+            if(FSEEK(mFile.get(), bufferOffset, SEEK_SET) != 0)
+                throw IOException("Invalid offset");
+
+            read(outBuffer.data(), bufferItem.size);
+        }
+
+        stats::Add(stats::Counter::BytesRead, 2 * sizeof(Item) + outBuffer.size() + metadataItem.size);
+    }
+
+    void Decoder::loadFrame(const Timestamp timestamp, std::vector<uint8_t>& outData, int width, int height, int compressionType) {
+        outData.resize(sizeof(uint16_t) * width*height);
+
+        loadFrame(timestamp, reinterpret_cast<uint16_t*>(outData.data()), width, height, compressionType);
+    }
+
+    void Decoder::loadFrame(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType) {
+        trace::ScopedEvent event("load_frame", timestamp);
+
+        readFrame(frameOffset(timestamp), outData, width, height, compressionType);
+    }
+
+    void Decoder::loadFrameAt(const size_t index, uint16_t* outData, int width, int height, int compressionType) {
+        trace::ScopedEvent event("load_frame", index < mFrameTimestamps.size() ? mFrameTimestamps[index] : -1);
+
+        readFrame(frameOffset(index), outData, width, height, compressionType);
+    }
+
+    void Decoder::loadProxy(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType, int factor) {
+        trace::ScopedEvent event("load_proxy", timestamp);
+
+        readFrame(frameOffset(timestamp), outData, width, height, compressionType, factor);
+    }
+
+    void Decoder::loadProxyAt(const size_t index, uint16_t* outData, int width, int height, int compressionType, int factor) {
+        trace::ScopedEvent event("load_proxy", index < mFrameTimestamps.size() ? mFrameTimestamps[index] : -1);
+
+        readFrame(frameOffset(index), outData, width, height, compressionType, factor);
+    }
+
+    void Decoder::loadFrameAt(const size_t index, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads) {
+        trace::ScopedEvent event("load_frame", index < mFrameTimestamps.size() ? mFrameTimestamps[index] : -1);
+
+        readBuffer(frameOffset(index));
+        uncompress(mTmpBuffer, outData, width, height, compressionType, normalization, numThreads);
+    }
+
+    void Decoder::readBuffer(int64_t offset) {
+        stats::ScopedTimer timer(stats::Stage::Read);
+        trace::ScopedEvent event("read");
+
         if(FSEEK(mFile.get(), offset, SEEK_SET) != 0)
             throw IOException("Invalid offset");
 
@@ -218,16 +448,198 @@ namespace motioncam {
 
         read(mTmpBuffer.data(), bufferItem.size);
 
-        // Decompress the buffer
-        const size_t outputSizeBytes = sizeof(uint16_t) * width*height;
-        outData.resize(outputSizeBytes);
-        
+        stats::Add(stats::Counter::BytesRead, sizeof(Item) + bufferItem.size);
+    }
+
+    void Decoder::readFrame(int64_t offset, uint16_t* outData, int width, int height, int compressionType, int factor) {
+        readBuffer(offset);
+
+        if(factor > 1)
+            uncompressProxy(mTmpBuffer, outData, width, height, compressionType, factor);
+        else
+            uncompress(mTmpBuffer, outData, width, height, compressionType);
+    }
+
+    void Decoder::loadCompressedFrames(std::span<const Timestamp> timestamps, const CompressedFrameCallback& onFrame, unsigned int queueDepth) {
+        std::unique_ptr<IoUring> ring = IoUring::create(std::max(1u, queueDepth));
+
+        if(!ring) {
+            std::vector<uint8_t> buffer;
+            std::string metadata;
+
+            for(size_t i = 0; i < timestamps.size(); i++) {
+                loadCompressedFrame(timestamps[i], buffer, metadata);
+
+                if(!onFrame(i, buffer, metadata))
+                    return;
+            }
+
+            return;
+        }
+
+        // Each read lands the BUFFER item header in `header` and the frame data, the METADATA
+        // item and possibly some of the next item in `data`
+        struct Read {
+            size_t index;
+            Item header;
+            std::vector<uint8_t> data;
+            IoUring::Segment segments[2];
+            std::chrono::steady_clock::time_point queued;
+            int64_t traceStart;
+        };
+
+        const int fd = FILENO(mFile.get());
+
+        std::vector<Read> reads(ring->entries());
+        std::vector<size_t> freeReads;
+
+        for(size_t i = 0; i < reads.size(); i++)
+            freeReads.push_back(reads.size() - 1 - i);
+
+        size_t next = 0;
+        size_t inFlight = 0;
+        bool stop = false;
+
+        auto queue = [&](Read& r, size_t slot) {
+            const int64_t offset = frameOffset(timestamps[r.index]);
+            const int64_t end = frameEnd(offset);
+
+            if(end - offset < static_cast<int64_t>(2 * sizeof(Item)))
+                throw IOException("Invalid offset");
+
+            r.data.resize(static_cast<size_t>(end - offset) - sizeof(Item));
+
+            r.segments[0] = { &r.header, sizeof(Item) };
+            r.segments[1] = { r.data.data(), r.data.size() };
+
+            if(stats::Enabled())
+                r.queued = std::chrono::steady_clock::now();
+
+            r.traceStart = trace::Now();
+
+            ring->queueRead(fd, r.segments, 2, static_cast<uint64_t>(offset), slot);
+        };
+
+        auto complete = [&](Read& r, int32_t result) {
+            if(result < 0)
+                throw IOException(std::string("Failed to read data: ") + std::strerror(-result));
+
+            if(r.traceStart > 0)
+                trace::Record("read", r.traceStart, timestamps[r.index]);
+
+            // Time from queueing the read to seeing it complete
+            if(stats::Enabled() && r.queued.time_since_epoch().count() > 0) {
+                const auto elapsed = std::chrono::steady_clock::now() - r.queued;
+
+                stats::Record(stats::Stage::Read, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+                stats::Add(stats::Counter::BytesRead, static_cast<uint64_t>(result));
+            }
+
+            const size_t dataRead = static_cast<size_t>(result) > sizeof(Item) ? static_cast<size_t>(result) - sizeof(Item) : 0;
+            std::string metadata;
+
+            // Parse the items out of what was read, anything unexpected goes through the regular path
+            bool valid = r.header.type == Type::BUFFER && r.header.size <= dataRead && dataRead - r.header.size >= sizeof(Item);
+
+            if(valid) {
+                Item metadataItem{};
+                std::memcpy(&metadataItem, r.data.data() + r.header.size, sizeof(Item));
+
+                const size_t metadataStart = r.header.size + sizeof(Item);
+
+                valid = metadataItem.type == Type::METADATA && metadataItem.size <= dataRead - metadataStart;
+
+                if(valid) {
+                    const char* json = reinterpret_cast<const char*>(r.data.data() + metadataStart);
+
+                    metadata.assign(json, json + metadataItem.size);
+                    r.data.resize(r.header.size);
+                }
+            }
+
+            if(!valid)
+                loadCompressedFrame(timestamps[r.index], r.data, metadata);
+
+            if(!onFrame(r.index, r.data, metadata))
+                stop = true;
+        };
+
+        // The kernel may still be writing into the buffers of reads that haven't completed
+        auto drain = [&]() {
+            IoUring::Completion completion;
+
+            while(inFlight > 0) {
+                ring->submit(1);
+
+                while(ring->nextCompletion(completion))
+                    --inFlight;
+            }
+        };
+
+        try {
+            while(!stop && (next < timestamps.size() || inFlight > 0)) {
+                while(next < timestamps.size() && !freeReads.empty()) {
+                    const size_t slot = freeReads.back();
+
+                    reads[slot].index = next++;
+                    queue(reads[slot], slot);
+
+                    freeReads.pop_back();
+                    ++inFlight;
+                }
+
+                ring->submit(1);
+
+                IoUring::Completion completion;
+
+                while(!stop && ring->nextCompletion(completion)) {
+                    --inFlight;
+                    freeReads.push_back(static_cast<size_t>(completion.userData));
+
+                    complete(reads[completion.userData], completion.result);
+                }
+            }
+        }
+        catch(...) {
+            drain();
+            throw;
+        }
+
+        drain();
+    }
+
+    int64_t Decoder::frameOffset(const Timestamp timestamp) const {
+        const size_t index = LowerBound(mFrameTimestamps, timestamp);
+
+        if(index >= mFrameTimestamps.size() || mFrameTimestamps[index] != timestamp)
+            throw IOException("Frame not found (timestamp: " + std::to_string(timestamp) + ")");
+
+        return mFrameOffsets[index];
+    }
+
+    int64_t Decoder::frameOffset(const size_t index) const {
+        if(index >= mFrameOffsets.size())
+            throw IOException("Frame not found (index: " + std::to_string(index) + ")");
+
+        return mFrameOffsets[index];
+    }
+
+    int64_t Decoder::frameEnd(int64_t offset) const {
+        const auto it = std::upper_bound(mItemOffsets.begin(), mItemOffsets.end(), offset);
+
+        return it == mItemOffsets.end() ? offset : *it;
+    }
+
+    void Decoder::uncompress(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType) {
+        stats::ScopedTimer timer(stats::Stage::Decode);
+        trace::ScopedEvent event("decode");
+
         if(compressionType == MOTIONCAM_COMPRESSION_TYPE) {
-            if(raw::Decode(reinterpret_cast<uint16_t*>(outData.data()), width, height, mTmpBuffer.data(), mTmpBuffer.size()) <= 0)
+            if(raw::Decode(outData, width, height, buffer.data(), buffer.size()) <= 0)
                 throw IOException("Failed to uncompress frame");
         }
         else if(compressionType == MOTIONCAM_COMPRESSION_TYPE_LEGACY) {
-            if(raw::DecodeLegacy(reinterpret_cast<uint16_t*>(outData.data()), width, height, mTmpBuffer.data(), mTmpBuffer.size()) <= 0)
+            if(raw::DecodeLegacy(outData, width, height, buffer.data(), buffer.size()) <= 0)
                 throw IOException("Failed to uncompress legacy frame");
         }
         else {
@@ -235,55 +647,187 @@ namespace motioncam {
         }
     }
 
-    void Decoder::readIndex() {
+    void Decoder::uncompress(const std::vector<uint8_t>& buffer, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads) {
+        if(compressionType != MOTIONCAM_COMPRESSION_TYPE) {
+            // Legacy frames aren't decoded a row at a time, normalize them afterwards
+            std::vector<uint16_t> frame(static_cast<size_t>(std::max(0, width)) * std::max(0, height));
+
+            uncompress(buffer, frame.data(), width, height, compressionType);
+
+            trace::ScopedEvent event("normalize");
+            raw::Normalize(outData, frame.data(), width, height, normalization);
+
+            return;
+        }
+
+        stats::ScopedTimer timer(stats::Stage::Decode);
+        trace::ScopedEvent event("decode_normalized");
+
+        if(raw::DecodeNormalized(outData, width, height, buffer.data(), buffer.size(), normalization, numThreads) <= 0)
+            throw IOException("Failed to uncompress frame");
+    }
+
+    void Decoder::uncompress(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType, raw::FrameStats& stats) {
+        if(compressionType != MOTIONCAM_COMPRESSION_TYPE) {
+            // Legacy frames aren't decoded a row at a time, count them afterwards
+            uncompress(buffer, outData, width, height, compressionType);
+
+            trace::ScopedEvent event("stats");
+            raw::AccumulateStats(outData, width, height, stats);
+
+            return;
+        }
+
+        stats::ScopedTimer timer(stats::Stage::Decode);
+        trace::ScopedEvent event("decode_stats");
+
+        if(raw::DecodeWithStats(outData, width, height, buffer.data(), buffer.size(), stats) <= 0)
+            throw IOException("Failed to uncompress frame");
+    }
+
+    bool Decoder::estimateStats(const std::vector<uint8_t>& buffer, int width, int height, int compressionType, raw::FrameStats& stats) {
+        if(compressionType != MOTIONCAM_COMPRESSION_TYPE)
+            return false;
+
+        trace::ScopedEvent event("estimate_stats");
+
+        if(!raw::EstimateStats(width, height, buffer.data(), buffer.size(), stats))
+            throw IOException("Failed to read frame headers");
+
+        return true;
+    }
+
+    bool Decoder::summarizeBlocks(const std::vector<uint8_t>& buffer, int width, int height, int compressionType, raw::BlockSummary& summary) {
+        if(compressionType != MOTIONCAM_COMPRESSION_TYPE)
+            return false;
+
+        trace::ScopedEvent event("summarize_blocks");
+
+        if(!raw::SummarizeBlocks(width, height, buffer.data(), buffer.size(), summary))
+            throw IOException("Failed to read frame headers");
+
+        return true;
+    }
+
+    uint64_t Decoder::fingerprint(const std::vector<uint8_t>& buffer, int compressionType) {
+        if(compressionType != MOTIONCAM_COMPRESSION_TYPE)
+            return raw::HashFrame(buffer.data(), buffer.size());
+
+        const uint64_t fingerprint = raw::Fingerprint(buffer.data(), buffer.size());
+
+        if(fingerprint == 0)
+            throw IOException("Failed to read frame headers");
+
+        return fingerprint;
+    }
+
+    void Decoder::uncompressProxy(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType, int factor) {
+        if(raw::BinnedSize(width, factor) <= 0 || raw::BinnedSize(height, factor) <= 0)
+            throw IOException("Invalid proxy size");
+
+        if(compressionType == MOTIONCAM_COMPRESSION_TYPE) {
+            stats::ScopedTimer timer(stats::Stage::Decode);
+            trace::ScopedEvent event("decode_binned");
+
+            if(raw::DecodeBinned(outData, width, height, buffer.data(), buffer.size(), factor) <= 0)
+                throw IOException("Failed to uncompress frame");
+        }
+        else {
+            // The legacy format has no blocks to bin from, decode the whole frame first
+            std::vector<uint16_t> frame(static_cast<size_t>(width) * height);
+
+            uncompress(buffer, frame.data(), width, height, compressionType);
+
+            trace::ScopedEvent event("bin");
+            raw::Bin(outData, frame.data(), width, height, factor);
+        }
+    }
+
+    bool Decoder::readIndex() {
+        // Anything wrong with the index at the end of the file means it has to be rebuilt
+        if(FSEEK(mFile.get(), 0, SEEK_END) != 0)
+            throw IOException("Failed to get file size");
+
+        const int64_t fileSize = FTELL(mFile.get());
+
         // Seek to index item
         if(FSEEK(mFile.get(), -static_cast<long>(sizeof(BufferIndex) + sizeof(Item)), SEEK_END) != 0)
-            throw IOException("Failed to get end chunk");
+            return false;
 
         Item bufferIndexItem{};
-        read(&bufferIndexItem, sizeof(Item));
+        if(std::fread(&bufferIndexItem, sizeof(Item), 1, mFile.get()) != 1)
+            return false;
         
         if(bufferIndexItem.type != Type::BUFFER_INDEX)
-            throw IOException("Invalid file");
+            return false;
         
         BufferIndex index{};
-        read(&index, sizeof(BufferIndex));
+        if(std::fread(&index, sizeof(BufferIndex), 1, mFile.get()) != 1)
+            return false;
         
         // Check validity of index
-        if(index.magicNumber != INDEX_MAGIC_NUMBER)
-            throw IOException("Corrupted file");
+        if(index.magicNumber != INDEX_MAGIC_NUMBER || index.numOffsets < 0)
+            return false;
+
+        if(index.indexDataOffset < 0 || index.indexDataOffset + static_cast<int64_t>(sizeof(BufferOffset)) * index.numOffsets > fileSize)
+            return false;
         
-        mOffsets.resize(index.numOffsets);
+        std::vector<BufferOffset> offsets(index.numOffsets);
         
         // Read the index
-        if(FSEEK(mFile.get(), index.indexDataOffset, SEEK_SET) != 0) {
-            throw IOException("Invalid index");
-            return;
-        }
+        if(FSEEK(mFile.get(), index.indexDataOffset, SEEK_SET) != 0)
+            return false;
         
-        read(mOffsets.data(), sizeof(BufferOffset), mOffsets.size());
+        if(std::fread(offsets.data(), sizeof(BufferOffset), offsets.size(), mFile.get()) != offsets.size())
+            return false;
+
+        mItemOffsets.push_back(index.indexDataOffset);
+
+        reindexOffsets(offsets);
+
+        return true;
+    }
+
+    void Decoder::recoverIndex(int64_t start) {
+        RecoveredIndex index = RecoverIndex(mFile.get(), start);
+
+        if(index.frames.empty())
+            throw IOException("Invalid file");
+
+        mAudioOffsets = std::move(index.audio);
+        mItemOffsets.push_back(index.end);
+        mRecovered = true;
+
+        reindexOffsets(index.frames);
     }
     
-    void Decoder::reindexOffsets() {
+    void Decoder::reindexOffsets(std::vector<BufferOffset>& offsets) {
         // Sort offsets so they are in order of timestamps
-        std::sort(mOffsets.begin(), mOffsets.end(), [](const auto& a, const auto&b) {
+        std::sort(offsets.begin(), offsets.end(), [](const auto& a, const auto&b) {
             return a.timestamp < b.timestamp;
         });
         
-        mFrameList.clear();
-        mFrameOffsetMap.clear();
+        mFrameTimestamps.clear();
+        mFrameOffsets.clear();
+
+        mFrameTimestamps.reserve(offsets.size());
+        mFrameOffsets.reserve(offsets.size());
         
-        for(const auto& i : mOffsets) {
-            mFrameList.push_back(i.timestamp);
-            mFrameOffsetMap.insert({ i.timestamp, i });
+        for(const auto& i : offsets) {
+            // Keep the first frame of a duplicated timestamp, like the map did
+            if(!mFrameTimestamps.empty() && mFrameTimestamps.back() == i.timestamp)
+                continue;
+
+            mFrameTimestamps.push_back(i.timestamp);
+            mFrameOffsets.push_back(i.offset);
         }
     }
     
     void Decoder::readExtra() {
-        if(mOffsets.empty())
+        if(mFrameOffsets.empty())
             return;
         
-        auto curOffset = mOffsets[mOffsets.size() - 1].offset;
+        auto curOffset = mFrameOffsets.back();
 
         if(FSEEK(mFile.get(), curOffset, SEEK_SET) != 0)
             return;
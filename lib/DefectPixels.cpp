@@ -0,0 +1,247 @@
+#include "Color.hpp"
+
+#include <motioncam/DefectPixels.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace motioncam {
+    namespace {
+        // FixBadPixelsList from the DNG specification, and the version it first appeared in
+        const uint32_t OPCODE_FIX_BAD_PIXELS_LIST = 5;
+        const uint32_t OPCODE_DNG_VERSION = 0x01030000;
+        const uint32_t OPCODE_FLAG_OPTIONAL = 1;
+
+        // Reflects coordinates past the edges back in, which keeps their place in the CFA quad
+        int Mirror(int i, const int size) {
+            if(i < 0)
+                i = -i;
+            else if(i >= size)
+                i = 2 * (size - 1) - i;
+
+            return std::clamp(i, 0, size - 1);
+        }
+
+        void WriteBigEndian(std::vector<uint8_t>& out, const uint32_t value) {
+            out.push_back(static_cast<uint8_t>(value >> 24));
+            out.push_back(static_cast<uint8_t>(value >> 16));
+            out.push_back(static_cast<uint8_t>(value >> 8));
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        //
+        // Appends the pixels of a frame that are more than threshold above or below all four
+        // neighbours two pixels away, the nearest of the same colour
+        //
+        void FindOutliers(const uint16_t* image, const int width, const int height, const int32_t threshold, std::vector<uint32_t>& out) {
+            const ptrdiff_t stride = width;
+
+            for(int y = 0; y < height; y++) {
+                const uint16_t* up = image + Mirror(y - 2, height) * stride;
+                const uint16_t* row = image + y * stride;
+                const uint16_t* down = image + Mirror(y + 2, height) * stride;
+
+                auto check = [&](const int x, const int32_t left, const int32_t right) {
+                    const int32_t lowest = std::min(std::min(left, right), std::min<int32_t>(up[x], down[x]));
+                    const int32_t highest = std::max(std::max(left, right), std::max<int32_t>(up[x], down[x]));
+                    const int32_t value = row[x];
+
+                    if(value > highest + threshold || value < lowest - threshold)
+                        out.push_back(static_cast<uint32_t>(y * stride + x));
+                };
+
+                // Only the two columns at each edge need mirroring
+                const int innerStart = std::min(2, width);
+                const int innerEnd = std::max(innerStart, width - 2);
+
+                for(int x = 0; x < innerStart; x++)
+                    check(x, row[Mirror(x - 2, width)], row[Mirror(x + 2, width)]);
+
+                for(int x = innerStart; x < innerEnd; x++)
+                    check(x, row[x - 2], row[x + 2]);
+
+                for(int x = innerEnd; x < width; x++)
+                    check(x, row[Mirror(x - 2, width)], row[Mirror(x + 2, width)]);
+            }
+        }
+    }
+
+    std::vector<DefectPixel> FindDefectPixels(SegmentedDecoder& decoder, const DefectPixelOptions& options) {
+        trace::ScopedEvent event("defect_pixels");
+
+        const ContainerMetadata containerMetadata = ContainerMetadata::parse(decoder.getContainerMetadata());
+        const size_t numFrames = decoder.getFrames().size();
+
+        if(numFrames == 0)
+            throw IOException("Container has no frames");
+
+        // Every frame must be the size of the first one
+        const FrameMetadata firstMetadata = FrameMetadata::parse(decoder.loadFrameMetadataAt(0));
+        const int width = firstMetadata.width;
+        const int height = firstMetadata.height;
+
+        if(width <= 0 || height <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        std::vector<size_t> frames;
+        const size_t numSamples = std::clamp<size_t>(options.numFrames, 1, numFrames);
+
+        for(size_t i = 0; i < numSamples; i++)
+            frames.push_back(i * numFrames / numSamples);
+
+        double black = 0;
+        for(const auto level : containerMetadata.blackLevel)
+            black += static_cast<double>(level) / static_cast<double>(containerMetadata.blackLevel.size());
+
+        const double white = containerMetadata.whiteLevel > 0 ? containerMetadata.whiteLevel : 65535.0;
+        const auto threshold = static_cast<int32_t>(std::max(1.0, std::round(options.threshold * (white - black))));
+
+        unsigned int numThreads = options.numThreads;
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        numThreads = static_cast<unsigned int>(std::min<size_t>(numThreads, frames.size()));
+
+        // Number of frames each pixel stood out in, only for the few that did
+        std::unordered_map<uint32_t, uint32_t> counts;
+        size_t framesUsed = 0;
+
+        std::atomic<size_t> nextFrame(0);
+        std::mutex lock;
+        std::exception_ptr error;
+
+        auto work = [&] {
+            try {
+                auto clone = decoder.clone();
+
+                std::vector<uint16_t> image(static_cast<size_t>(width) * static_cast<size_t>(height));
+                std::vector<uint32_t> outliers;
+
+                for(size_t i = nextFrame++; i < frames.size(); i = nextFrame++) {
+                    const FrameMetadata metadata = FrameMetadata::parse(clone->loadFrameMetadataAt(frames[i]));
+
+                    if(metadata.width != width || metadata.height != height)
+                        continue;
+
+                    clone->loadFrameAt(frames[i], image.data(), width, height, metadata.compressionType);
+
+                    outliers.clear();
+                    FindOutliers(image.data(), width, height, threshold, outliers);
+
+                    std::lock_guard<std::mutex> guard(lock);
+
+                    for(const auto pixel : outliers)
+                        counts[pixel]++;
+
+                    framesUsed++;
+                }
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> guard(lock);
+                if(!error)
+                    error = std::current_exception();
+
+                // Leave the remaining frames
+                nextFrame = frames.size();
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for(unsigned int i = 1; i < numThreads; i++)
+            threads.emplace_back(work);
+
+        work();
+
+        for(auto& thread : threads)
+            thread.join();
+
+        if(error)
+            std::rethrow_exception(error);
+
+        const auto minCount = static_cast<uint32_t>(std::max(1.0, std::ceil(options.minFraction * static_cast<double>(framesUsed))));
+
+        std::vector<std::pair<uint32_t, uint32_t>> found;
+
+        for(const auto& [pixel, count] : counts) {
+            if(count >= minCount)
+                found.emplace_back(count, pixel);
+        }
+
+        if(found.size() > options.maxPixels) {
+            std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+
+            found.resize(options.maxPixels);
+        }
+
+        // Pixel indices are in row order
+        std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+        std::vector<DefectPixel> defects;
+        defects.reserve(found.size());
+
+        for(const auto& entry : found)
+            defects.push_back({ static_cast<int>(entry.second % width), static_cast<int>(entry.second / width) });
+
+        return defects;
+    }
+
+    void FixDefectPixels(uint16_t* image, int width, int height, const std::vector<DefectPixel>& defects) {
+        const ptrdiff_t stride = width;
+
+        for(const auto& defect : defects) {
+            if(defect.x < 0 || defect.x >= width || defect.y < 0 || defect.y >= height)
+                continue;
+
+            const uint32_t sum =
+                image[defect.y * stride + Mirror(defect.x - 2, width)] +
+                image[defect.y * stride + Mirror(defect.x + 2, width)] +
+                image[Mirror(defect.y - 2, height) * stride + defect.x] +
+                image[Mirror(defect.y + 2, height) * stride + defect.x];
+
+            image[defect.y * stride + defect.x] = static_cast<uint16_t>((sum + 2) / 4);
+        }
+    }
+
+    std::vector<uint8_t> FixBadPixelsOpcodes(const std::vector<DefectPixel>& defects, const ContainerMetadata& containerMetadata) {
+        const CFA cfa = color::CFAFromArrangement(containerMetadata.sensorArrangement);
+
+        // Which of RGGB, GRBG, GBRG and BGGR the pattern is
+        uint32_t bayerPhase = 0;
+
+        if(cfa[0] == 2)
+            bayerPhase = 3;
+        else if(cfa[0] == 1)
+            bayerPhase = cfa[1] == 0 ? 1 : 2;
+
+        std::vector<uint8_t> out;
+        out.reserve(32 + 8 * defects.size());
+
+        // One opcode: its ID, version, flags and size of its parameters
+        WriteBigEndian(out, 1);
+        WriteBigEndian(out, OPCODE_FIX_BAD_PIXELS_LIST);
+        WriteBigEndian(out, OPCODE_DNG_VERSION);
+        WriteBigEndian(out, OPCODE_FLAG_OPTIONAL);
+        WriteBigEndian(out, static_cast<uint32_t>(12 + 8 * defects.size()));
+
+        // Bayer phase, bad points and bad rectangles
+        WriteBigEndian(out, bayerPhase);
+        WriteBigEndian(out, static_cast<uint32_t>(defects.size()));
+        WriteBigEndian(out, 0);
+
+        for(const auto& defect : defects) {
+            WriteBigEndian(out, static_cast<uint32_t>(defect.y));
+            WriteBigEndian(out, static_cast<uint32_t>(defect.x));
+        }
+
+        return out;
+    }
+} // namespace motioncam
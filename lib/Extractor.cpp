@@ -0,0 +1,351 @@
+#include <motioncam/Extractor.hpp>
+#include <motioncam/BoundedQueue.hpp>
+#include <motioncam/Decoder.hpp>
+#include <motioncam/FrameRenderer.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/SegmentedDecoder.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+    #include <direct.h>
+    #include <malloc.h>
+#elif defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #error Unknown platform
+#endif
+
+namespace motioncam {
+    namespace {
+        // Covers the logical block size of any device O_DIRECT is used on
+        const size_t IO_ALIGNMENT = 4096;
+
+        struct AlignedFree {
+            void operator()(uint8_t* data) const {
+#if defined(_WIN32)
+                _aligned_free(data);
+#else
+                std::free(data);
+#endif
+            }
+        };
+
+        typedef std::unique_ptr<uint8_t, AlignedFree> AlignedBuffer;
+
+        AlignedBuffer AllocateAligned(size_t size) {
+#if defined(_WIN32)
+            void* data = _aligned_malloc(size, IO_ALIGNMENT);
+#else
+            void* data = nullptr;
+            if(posix_memalign(&data, IO_ALIGNMENT, size) != 0)
+                data = nullptr;
+#endif
+            if(!data)
+                throw std::bad_alloc();
+
+            return AlignedBuffer(static_cast<uint8_t*>(data));
+        }
+
+        size_t AlignUp(size_t size) {
+            return (size + IO_ALIGNMENT - 1) & ~(IO_ALIGNMENT - 1);
+        }
+
+        struct ExtractJob {
+            size_t index;
+            Timestamp timestamp;
+            std::vector<uint8_t> buffer;
+            std::string metadata;
+
+            // The DNG, padded to IO_ALIGNMENT so it can be written with O_DIRECT
+            AlignedBuffer dng;
+            size_t dngSize;
+        };
+
+        std::string FramePath(const std::string& outputDir, size_t index) {
+            std::string path(outputDir);
+
+            if(!path.empty() && path.back() != '/')
+                path += '/';
+
+            return path + "frame_" + std::to_string(index) + ".dng";
+        }
+
+        void CreateDirectory(const std::string& path) {
+#if defined(_WIN32)
+            const int result = _mkdir(path.c_str());
+#else
+            const int result = mkdir(path.c_str(), 0755);
+#endif
+            if(result != 0 && errno != EEXIST)
+                throw IOException("Failed to create " + path + ": " + std::strerror(errno));
+        }
+
+#if defined(_WIN32)
+        void WriteFile(const std::string& path, const uint8_t* data, size_t size, bool directIO) {
+            (void) directIO;
+
+            unique_file file(std::fopen(path.c_str(), "wb"));
+            if(!file)
+                throw IOException("Failed to create " + path);
+
+            if(std::fwrite(data, 1, size, file.get()) != size)
+                throw IOException("Failed to write " + path);
+
+            if(std::fclose(file.release()) != 0)
+                throw IOException("Failed to write " + path);
+        }
+#else
+        class FileDescriptor {
+        public:
+            FileDescriptor(int fd) : mFd(fd) {}
+            ~FileDescriptor() { if(mFd >= 0) close(mFd); }
+
+            FileDescriptor(const FileDescriptor&) = delete;
+            FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+            int get() const { return mFd; }
+
+            int release() {
+                const int fd = mFd;
+                mFd = -1;
+                return fd;
+            }
+
+        private:
+            int mFd;
+        };
+
+        int OpenForWriting(const std::string& path, bool directIO, bool& outDirect) {
+            const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+            outDirect = false;
+
+#if defined(O_DIRECT)
+            if(directIO) {
+                const int fd = open(path.c_str(), flags | O_DIRECT, 0644);
+
+                // Not every file system supports O_DIRECT (tmpfs for one), fall back to buffered writes
+                if(fd >= 0 || errno != EINVAL) {
+                    outDirect = fd >= 0;
+                    return fd;
+                }
+            }
+#endif
+
+            const int fd = open(path.c_str(), flags, 0644);
+
+#if defined(F_NOCACHE)
+            if(fd >= 0 && directIO)
+                outDirect = fcntl(fd, F_NOCACHE, 1) == 0;
+#endif
+
+            return fd;
+        }
+
+        // data must be aligned and hold AlignUp(size) bytes
+        void WriteFile(const std::string& path, const uint8_t* data, size_t size, bool directIO) {
+            bool direct = false;
+            FileDescriptor fd(OpenForWriting(path, directIO, direct));
+
+            if(fd.get() < 0)
+                throw IOException("Failed to create " + path + ": " + std::strerror(errno));
+
+            // O_DIRECT only takes whole blocks, write the padding and truncate it afterwards
+            const size_t writeSize = direct ? AlignUp(size) : size;
+            size_t written = 0;
+
+            while(written < writeSize) {
+                const ssize_t result = pwrite(fd.get(), data + written, writeSize - written, static_cast<off_t>(written));
+
+                if(result < 0 && errno == EINTR)
+                    continue;
+
+                if(result <= 0)
+                    throw IOException("Failed to write " + path + ": " + std::strerror(errno));
+
+                written += static_cast<size_t>(result);
+            }
+
+            if(writeSize != size && ftruncate(fd.get(), static_cast<off_t>(size)) != 0)
+                throw IOException("Failed to write " + path + ": " + std::strerror(errno));
+
+            if(close(fd.release()) != 0)
+                throw IOException("Failed to write " + path + ": " + std::strerror(errno));
+        }
+#endif
+    }
+
+    void Extract(const std::string& inputPath, const std::string& outputDir, const ExtractOptions& options) {
+        // The same merged sequence of segments the file system shows
+        SegmentedDecoder decoder(inputPath);
+        std::vector<DefectPixel> defects;
+
+        if(options.defectPixels)
+            defects = FindDefectPixels(decoder, options.defectPixelOptions);
+
+        const FrameRenderer renderer(ContainerMetadata::parse(decoder.getContainerMetadata()), options.previewSize, 1, defects);
+
+        const auto frames = decoder.getFrames();
+
+        CreateDirectory(outputDir);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        unsigned int numWorkers = options.numWorkers;
+        if(numWorkers == 0)
+            numWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+        const unsigned int numWriters = std::max(1u, options.numWriters);
+
+        BoundedQueue<ExtractJob> readQueue(options.queueDepth);
+        BoundedQueue<ExtractJob> writeQueue(options.queueDepth);
+
+        std::mutex errorLock;
+        std::exception_ptr error;
+
+        auto fail = [&](std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lock(errorLock);
+                if(!error)
+                    error = e;
+            }
+
+            readQueue.close();
+            writeQueue.close();
+        };
+
+        // Read compressed frames, many at a time where the platform allows it (SegmentedDecoder is
+        // not thread safe so only this thread touches it)
+        std::thread reader([&] {
+            trace::SetThreadName("reader");
+
+            try {
+                decoder.loadCompressedFrames(frames, [&](size_t index, std::vector<uint8_t>& buffer, std::string& metadata) {
+                    ExtractJob job{ index, frames[index], std::move(buffer), std::move(metadata), {}, 0 };
+
+                    return readQueue.push(std::move(job));
+                }, options.readDepth);
+            }
+            catch(...) {
+                fail(std::current_exception());
+            }
+
+            readQueue.close();
+        });
+
+        // Decode straight into the DNG on all workers
+        std::atomic<unsigned int> activeWorkers(numWorkers);
+        std::vector<std::thread> workers;
+
+        for(unsigned int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([&, i] {
+                ExtractJob job;
+
+                trace::SetThreadName("worker " + std::to_string(i));
+
+                try {
+                    while(readQueue.pop(job)) {
+                        if(stats::Enabled())
+                            stats::SetGauge(stats::Gauge::DecodeQueue, static_cast<int64_t>(readQueue.size()));
+
+                        {
+                            trace::ScopedEvent event("render", job.timestamp);
+
+                            const FrameMetadata metadata = FrameMetadata::parse(job.metadata);
+
+                            job.dngSize = renderer.dngSize(metadata);
+                            job.dng = AllocateAligned(AlignUp(job.dngSize));
+
+                            renderer.render(job.buffer, metadata, job.dng.get());
+
+                            // Padding isn't part of the file but gets written with O_DIRECT
+                            std::memset(job.dng.get() + job.dngSize, 0, AlignUp(job.dngSize) - job.dngSize);
+                        }
+
+                        // Compressed data isn't needed anymore, don't hold on to it while queued
+                        std::vector<uint8_t>().swap(job.buffer);
+
+                        if(!writeQueue.push(std::move(job)))
+                            break;
+                    }
+                }
+                catch(...) {
+                    fail(std::current_exception());
+                }
+
+                if(--activeWorkers == 0)
+                    writeQueue.close();
+            });
+        }
+
+        // Write files in whatever order they finish, several at once to keep the device queue full
+        std::mutex progressLock;
+        size_t framesWritten = 0;
+        uint64_t bytesWritten = 0;
+
+        std::vector<std::thread> writers;
+
+        for(unsigned int i = 0; i < numWriters; i++) {
+            writers.emplace_back([&, i] {
+                ExtractJob job;
+
+                trace::SetThreadName("writer " + std::to_string(i));
+
+                try {
+                    while(writeQueue.pop(job)) {
+                        if(stats::Enabled())
+                            stats::SetGauge(stats::Gauge::WriteQueue, static_cast<int64_t>(writeQueue.size()));
+
+                        {
+                            stats::ScopedTimer timer(stats::Stage::Write);
+                            trace::ScopedEvent event("write", job.timestamp);
+                            WriteFile(FramePath(outputDir, job.index), job.dng.get(), job.dngSize, options.directIO);
+                        }
+
+                        stats::Add(stats::Counter::BytesServed, job.dngSize);
+                        job.dng.reset();
+
+                        std::lock_guard<std::mutex> lock(progressLock);
+
+                        ++framesWritten;
+                        bytesWritten += job.dngSize;
+
+                        if(options.progress) {
+                            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                            options.progress({ framesWritten, frames.size(), bytesWritten, elapsed.count() });
+                        }
+                    }
+                }
+                catch(...) {
+                    fail(std::current_exception());
+                }
+            });
+        }
+
+        reader.join();
+        for(auto& worker : workers)
+            worker.join();
+        for(auto& writer : writers)
+            writer.join();
+
+        if(error)
+            std::rethrow_exception(error);
+
+        if(framesWritten != frames.size())
+            throw IOException("Failed to extract all frames");
+    }
+} // namespace motioncam
@@ -0,0 +1,373 @@
+#include "Color.hpp"
+
+#include <motioncam/FrameRenderer.hpp>
+#include <motioncam/RawData.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <tiny_dng_writer.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace motioncam {
+    namespace {
+        size_t ImageSize(const FrameMetadata& metadata) {
+            return sizeof(uint16_t) * static_cast<size_t>(metadata.width) * static_cast<size_t>(metadata.height);
+        }
+
+        struct PreviewGeometry {
+            int width = 0;
+            int height = 0;
+
+            // Preview pixels are the average of step x step 2x2 CFA quads
+            int step = 0;
+        };
+
+        PreviewGeometry GetPreviewGeometry(const FrameMetadata& metadata, int previewSize) {
+            const int quadsX = metadata.width / 2;
+            const int quadsY = metadata.height / 2;
+
+            if(previewSize <= 0 || quadsX <= 0 || quadsY <= 0)
+                return {};
+
+            const int step = (std::max(quadsX, quadsY) + previewSize - 1) / previewSize;
+
+            PreviewGeometry geometry{ quadsX / step, quadsY / step, step };
+
+            if(geometry.width <= 0 || geometry.height <= 0)
+                return {};
+
+            return geometry;
+        }
+
+        size_t PreviewSize(const PreviewGeometry& geometry) {
+            return 3 * static_cast<size_t>(geometry.width) * static_cast<size_t>(geometry.height);
+        }
+    }
+
+    FrameRenderer::FrameRenderer(const ContainerMetadata& containerMetadata) :
+        FrameRenderer(containerMetadata, DEFAULT_PREVIEW_SIZE)
+    {
+    }
+
+    FrameRenderer::FrameRenderer(
+        const ContainerMetadata& containerMetadata,
+        int previewSize,
+        int binning,
+        const std::vector<DefectPixel>& defects) :
+        mContainerMetadata(containerMetadata),
+        mCFA(color::CFAFromArrangement(containerMetadata.sensorArrangement)),
+        mPreviewSize(previewSize),
+        mBinning(binning),
+        mPreviewMatrix(color::CameraToSrgb(containerMetadata)),
+        mGammaTable(color::SrgbGammaTable()),
+        mOpcodeList1(binning == 1 && !defects.empty() ? FixBadPixelsOpcodes(defects, containerMetadata) : std::vector<uint8_t>())
+    {
+        if(mBinning != 1 && mBinning != 2 && mBinning != 4)
+            throw MotionCamException("Invalid binning (" + std::to_string(mBinning) + ")");
+
+        // tinydng reads a fixed number of values from each of these
+        if(mContainerMetadata.blackLevel.size() < 4)
+            throw MotionCamException("Invalid metadata (blackLevel)");
+
+        if(mContainerMetadata.colorMatrix1.size() < 9 ||
+           mContainerMetadata.colorMatrix2.size() < 9 ||
+           mContainerMetadata.forwardMatrix1.size() < 9 ||
+           mContainerMetadata.forwardMatrix2.size() < 9)
+        {
+            throw MotionCamException("Invalid metadata (color matrices)");
+        }
+    }
+
+    FrameMetadata FrameRenderer::outputMetadata(const FrameMetadata& metadata) const {
+        FrameMetadata output = metadata;
+
+        if(mBinning > 1) {
+            output.width = raw::BinnedSize(metadata.width, mBinning);
+            output.height = raw::BinnedSize(metadata.height, mBinning);
+        }
+
+        return output;
+    }
+
+    size_t FrameRenderer::dngSize(const FrameMetadata& metadata) const {
+        const FrameMetadata output = outputMetadata(metadata);
+        std::vector<uint8_t> header;
+
+        return writeHeader(output, header).imageOffset + ImageSize(output);
+    }
+
+    void FrameRenderer::render(Decoder& decoder, const Timestamp timestamp, const FrameMetadata& metadata, uint8_t* output) const {
+        const FrameMetadata outMetadata = outputMetadata(metadata);
+        const Layout layout = beginRender(outMetadata, output);
+
+        // The image data offset is 16 byte aligned so it can be decoded into directly
+        auto* image = reinterpret_cast<uint16_t*>(output + layout.imageOffset);
+
+        if(mBinning > 1)
+            decoder.loadProxy(timestamp, image, metadata.width, metadata.height, metadata.compressionType, mBinning);
+        else
+            decoder.loadFrame(timestamp, image, metadata.width, metadata.height, metadata.compressionType);
+
+        writePreview(outMetadata, layout, output);
+    }
+
+    void FrameRenderer::renderAt(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output) const {
+        const FrameMetadata outMetadata = outputMetadata(metadata);
+        const Layout layout = beginRender(outMetadata, output);
+
+        auto* image = reinterpret_cast<uint16_t*>(output + layout.imageOffset);
+
+        if(mBinning > 1)
+            decoder.loadProxyAt(index, image, metadata.width, metadata.height, metadata.compressionType, mBinning);
+        else
+            decoder.loadFrameAt(index, image, metadata.width, metadata.height, metadata.compressionType);
+
+        writePreview(outMetadata, layout, output);
+    }
+
+    void FrameRenderer::render(const std::vector<uint8_t>& compressed, const FrameMetadata& metadata, uint8_t* output) const {
+        const FrameMetadata outMetadata = outputMetadata(metadata);
+        const Layout layout = beginRender(outMetadata, output);
+
+        auto* image = reinterpret_cast<uint16_t*>(output + layout.imageOffset);
+
+        if(mBinning > 1)
+            Decoder::uncompressProxy(compressed, image, metadata.width, metadata.height, metadata.compressionType, mBinning);
+        else
+            Decoder::uncompress(compressed, image, metadata.width, metadata.height, metadata.compressionType);
+
+        writePreview(outMetadata, layout, output);
+    }
+
+    void FrameRenderer::render(const uint16_t* image, const FrameMetadata& metadata, uint8_t* output) const {
+        const FrameMetadata outMetadata = outputMetadata(metadata);
+        const Layout layout = beginRender(outMetadata, output);
+
+        if(mBinning > 1)
+            raw::Bin(reinterpret_cast<uint16_t*>(output + layout.imageOffset), image, metadata.width, metadata.height, mBinning);
+        else
+            std::memcpy(output + layout.imageOffset, image, ImageSize(metadata));
+
+        writePreview(outMetadata, layout, output);
+    }
+
+    void FrameRenderer::render(const uint8_t* source, const FrameMetadata& sourceMetadata, const FrameMetadata& metadata, uint8_t* output) const {
+        const FrameMetadata outMetadata = outputMetadata(metadata);
+        const FrameMetadata sourceOutMetadata = outputMetadata(sourceMetadata);
+
+        if(outMetadata.width != sourceOutMetadata.width || outMetadata.height != sourceOutMetadata.height)
+            throw MotionCamException("Repeated frame has a different size");
+
+        // The tags of the two frames can differ in length, so their image data can start at different offsets
+        std::vector<uint8_t> sourceHeader;
+        const Layout sourceLayout = writeHeader(sourceOutMetadata, sourceHeader);
+
+        const Layout layout = beginRender(outMetadata, output);
+
+        std::memcpy(output + layout.imageOffset, source + sourceLayout.imageOffset, ImageSize(outMetadata));
+
+        writePreview(outMetadata, layout, output);
+    }
+
+    void FrameRenderer::render(Decoder& decoder, const Timestamp timestamp, const FrameMetadata& metadata, std::vector<uint8_t>& output) const {
+        output.resize(dngSize(metadata));
+
+        render(decoder, timestamp, metadata, output.data());
+    }
+
+    void FrameRenderer::renderAt(Decoder& decoder, const size_t index, const FrameMetadata& metadata, std::vector<uint8_t>& output) const {
+        output.resize(dngSize(metadata));
+
+        renderAt(decoder, index, metadata, output.data());
+    }
+
+    FrameRenderer::Layout FrameRenderer::beginRender(const FrameMetadata& metadata, uint8_t* output) const {
+        std::vector<uint8_t> header;
+        const Layout layout = writeHeader(metadata, header);
+
+        std::memcpy(output, header.data(), header.size());
+
+        // The preview is filled in once the image is there, clear the padding after it
+        std::memset(output + header.size(), 0, layout.imageOffset - header.size());
+
+        return layout;
+    }
+
+    void FrameRenderer::writePreview(const FrameMetadata& metadata, const Layout& layout, uint8_t* output) const {
+        const PreviewGeometry geometry = GetPreviewGeometry(metadata, mPreviewSize);
+
+        if(geometry.step == 0)
+            return;
+
+        trace::ScopedEvent event("dng_preview");
+
+        float matrix[9];
+        color::FrameMatrix(mPreviewMatrix, mContainerMetadata, metadata, matrix);
+
+        // Each quad has two greens, each colour is the mean of its samples less the black level
+        float weight[4];
+        float black[4];
+
+        for(int i = 0; i < 4; i++) {
+            const int samples = static_cast<int>(std::count(mCFA.begin(), mCFA.begin() + 4, mCFA[i]));
+
+            weight[i] = 1.0f / static_cast<float>(samples * geometry.step * geometry.step);
+            black[i] = static_cast<float>(mContainerMetadata.blackLevel[i]) / static_cast<float>(samples);
+        }
+
+        const auto* image = reinterpret_cast<const uint16_t*>(output + layout.imageOffset);
+        uint8_t* preview = output + layout.previewOffset;
+
+        const size_t width = static_cast<size_t>(metadata.width);
+        const size_t step = static_cast<size_t>(geometry.step);
+        const size_t columns = 2 * step * static_cast<size_t>(geometry.width);
+
+        // Sum the even and odd rows of each band of quads column by column first, that walks the
+        // image in order and vectorises
+        std::vector<uint32_t> evenRows(columns);
+        std::vector<uint32_t> oddRows(columns);
+
+        for(int y = 0; y < geometry.height; y++) {
+            std::fill(evenRows.begin(), evenRows.end(), 0);
+            std::fill(oddRows.begin(), oddRows.end(), 0);
+
+            for(size_t qy = 0; qy < step; qy++) {
+                const uint16_t* row0 = image + 2 * (y * step + qy) * width;
+                const uint16_t* row1 = row0 + width;
+
+                for(size_t i = 0; i < columns; i++) {
+                    evenRows[i] += row0[i];
+                    oddRows[i] += row1[i];
+                }
+            }
+
+            for(int x = 0; x < geometry.width; x++) {
+                uint64_t sums[4] = {};
+
+                for(size_t i = 2 * x * step; i < 2 * (x + 1) * step; i += 2) {
+                    sums[0] += evenRows[i];
+                    sums[1] += evenRows[i + 1];
+                    sums[2] += oddRows[i];
+                    sums[3] += oddRows[i + 1];
+                }
+
+                float camera[3] = {};
+
+                for(int i = 0; i < 4; i++)
+                    camera[mCFA[i]] += static_cast<float>(sums[i]) * weight[i] - black[i];
+
+                for(int i = 0; i < 3; i++) {
+                    const float value = matrix[i*3] * camera[0] + matrix[i*3 + 1] * camera[1] + matrix[i*3 + 2] * camera[2];
+                    const int index = static_cast<int>(std::clamp(value, 0.0f, 1.0f) * (color::GAMMA_TABLE_SIZE - 1) + 0.5f);
+
+                    *preview++ = mGammaTable[index];
+                }
+            }
+        }
+    }
+
+    FrameRenderer::Layout FrameRenderer::writeHeader(const FrameMetadata& metadata, std::vector<uint8_t>& header) const {
+        stats::ScopedTimer timer(stats::Stage::Render);
+        trace::ScopedEvent event("dng_header");
+
+        if(metadata.width <= 0 || metadata.height <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        if(metadata.asShotNeutral.size() < 3)
+            throw MotionCamException("Invalid metadata (asShotNeutral)");
+
+        const PreviewGeometry geometry = GetPreviewGeometry(metadata, mPreviewSize);
+
+        // With a preview it is IFD0 with the camera profile, the raw image is its SubIFD
+        tinydngwriter::DNGImage preview;
+        tinydngwriter::DNGImage dng;
+
+        tinydngwriter::DNGImage& profile = geometry.step > 0 ? preview : dng;
+
+        // Image data is written in host byte order
+        profile.SetBigEndian(false);
+        profile.SetDNGVersion(1, 4, 0, 0);
+        profile.SetDNGBackwardVersion(1, 1, 0, 0);
+
+        profile.SetColorMatrix1(3, mContainerMetadata.colorMatrix1.data());
+        profile.SetColorMatrix2(3, mContainerMetadata.colorMatrix2.data());
+
+        profile.SetForwardMatrix1(3, mContainerMetadata.forwardMatrix1.data());
+        profile.SetForwardMatrix2(3, mContainerMetadata.forwardMatrix2.data());
+
+        profile.SetAsShotNeutral(3, metadata.asShotNeutral.data());
+
+        profile.SetCalibrationIlluminant1(21);
+        profile.SetCalibrationIlluminant2(17);
+
+        profile.SetUniqueCameraModel("MotionCam");
+
+        if(geometry.step > 0) {
+            const unsigned short bitsPerSample[3] = { 8, 8, 8 };
+
+            preview.SetSubfileType(true);
+            preview.SetImageDataSize(static_cast<unsigned int>(PreviewSize(geometry)));
+            preview.SetImageWidth(geometry.width);
+            preview.SetImageLength(geometry.height);
+            preview.SetPlanarConfig(tinydngwriter::PLANARCONFIG_CONTIG);
+            preview.SetPhotometric(tinydngwriter::PHOTOMETRIC_RGB);
+            preview.SetRowsPerStrip(geometry.height);
+            preview.SetSamplesPerPixel(3);
+            preview.SetBitsPerSample(3, bitsPerSample);
+            preview.SetCompression(tinydngwriter::COMPRESSION_NONE);
+
+            // sRGB
+            preview.SetCustomFieldULong(tinydngwriter::TIFFTAG_PREVIEW_COLOR_SPACE, 2);
+
+            dng.SetBigEndian(false);
+        }
+
+        dng.SetImageDataSize(static_cast<unsigned int>(ImageSize(metadata)));
+        dng.SetImageWidth(metadata.width);
+        dng.SetImageLength(metadata.height);
+        dng.SetPlanarConfig(tinydngwriter::PLANARCONFIG_CONTIG);
+        dng.SetPhotometric(tinydngwriter::PHOTOMETRIC_CFA);
+        dng.SetRowsPerStrip(metadata.height);
+        dng.SetSamplesPerPixel(1);
+        dng.SetCFARepeatPatternDim(2, 2);
+
+        dng.SetBlackLevelRepeatDim(2, 2);
+        dng.SetBlackLevel(4, mContainerMetadata.blackLevel.data());
+        dng.SetWhiteLevel(static_cast<short>(mContainerMetadata.whiteLevel));
+        dng.SetCompression(tinydngwriter::COMPRESSION_NONE);
+
+        dng.SetCFAPattern(4, mCFA);
+
+        // Rectangular
+        dng.SetCFALayout(1);
+
+        dng.SetBitsPerSample();
+
+        dng.SetSubfileType();
+        dng.SetActiveArea({ 0, 0, static_cast<uint32_t>(metadata.height), static_cast<uint32_t>(metadata.width) });
+
+        if(!mOpcodeList1.empty())
+            dng.SetOpcodeList1(mOpcodeList1);
+
+        const tinydngwriter::DNGWriter writer(false);
+
+        std::string err;
+        unsigned int previewOffset = 0;
+        unsigned int stripOffset = 0;
+
+        if(geometry.step > 0) {
+            if(!writer.WriteHeader(&preview, &dng, &err, &header, &previewOffset, &stripOffset))
+                throw MotionCamException("Failed to write DNG: " + err);
+        }
+        else {
+            if(!writer.WriteHeader(&dng, &err, &header, &stripOffset))
+                throw MotionCamException("Failed to write DNG: " + err);
+
+            previewOffset = stripOffset;
+        }
+
+        return { previewOffset, stripOffset };
+    }
+}
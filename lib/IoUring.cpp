@@ -0,0 +1,231 @@
+#include "IoUring.hpp"
+
+#include <motioncam/Decoder.hpp>
+
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define MOTIONCAM_HAS_IO_URING 1
+    #endif
+#endif
+
+#if defined(MOTIONCAM_HAS_IO_URING)
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace motioncam {
+    namespace {
+        int Setup(unsigned int entries, struct io_uring_params* params) {
+            return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+        }
+
+        int Enter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+            return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+        }
+
+        template<typename T>
+        T* At(void* base, uint32_t offset) {
+            return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+        }
+
+        void* Map(int fd, size_t size, off_t offset) {
+            void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+            return ptr == MAP_FAILED ? nullptr : ptr;
+        }
+    }
+
+    IoUring::IoUring() :
+        mFd(-1),
+        mSqRing(nullptr),
+        mSqRingSize(0),
+        mCqRing(nullptr),
+        mCqRingSize(0),
+        mSqes(nullptr),
+        mSqesSize(0),
+        mSqHead(nullptr),
+        mSqTail(nullptr),
+        mSqMask(nullptr),
+        mSqArray(nullptr),
+        mSqEntries(0),
+        mCqHead(nullptr),
+        mCqTail(nullptr),
+        mCqMask(nullptr),
+        mCqes(nullptr),
+        mPending(0)
+    {
+    }
+
+    std::unique_ptr<IoUring> IoUring::create(unsigned int entries) {
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+
+        std::unique_ptr<IoUring> ring(new IoUring());
+
+        ring->mFd = Setup(entries > 0 ? entries : 1, &params);
+        if(ring->mFd < 0)
+            return nullptr;
+
+        // IORING_OP_READV is all we use, available since the first io_uring kernels
+        ring->mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        ring->mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            if(ring->mCqRingSize > ring->mSqRingSize)
+                ring->mSqRingSize = ring->mCqRingSize;
+
+            ring->mCqRingSize = ring->mSqRingSize;
+        }
+
+        ring->mSqRing = Map(ring->mFd, ring->mSqRingSize, IORING_OFF_SQ_RING);
+        if(!ring->mSqRing)
+            return nullptr;
+
+        if(params.features & IORING_FEAT_SINGLE_MMAP) {
+            ring->mCqRing = ring->mSqRing;
+        }
+        else {
+            ring->mCqRing = Map(ring->mFd, ring->mCqRingSize, IORING_OFF_CQ_RING);
+            if(!ring->mCqRing)
+                return nullptr;
+        }
+
+        ring->mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        ring->mSqes = Map(ring->mFd, ring->mSqesSize, IORING_OFF_SQES);
+        if(!ring->mSqes)
+            return nullptr;
+
+        ring->mSqHead = At<unsigned int>(ring->mSqRing, params.sq_off.head);
+        ring->mSqTail = At<unsigned int>(ring->mSqRing, params.sq_off.tail);
+        ring->mSqMask = At<unsigned int>(ring->mSqRing, params.sq_off.ring_mask);
+        ring->mSqArray = At<unsigned int>(ring->mSqRing, params.sq_off.array);
+        ring->mSqEntries = params.sq_entries;
+
+        ring->mCqHead = At<unsigned int>(ring->mCqRing, params.cq_off.head);
+        ring->mCqTail = At<unsigned int>(ring->mCqRing, params.cq_off.tail);
+        ring->mCqMask = At<unsigned int>(ring->mCqRing, params.cq_off.ring_mask);
+        ring->mCqes = At<void>(ring->mCqRing, params.cq_off.cqes);
+
+        return ring;
+    }
+
+    IoUring::~IoUring() {
+        if(mSqes)
+            munmap(mSqes, mSqesSize);
+
+        if(mCqRing && mCqRing != mSqRing)
+            munmap(mCqRing, mCqRingSize);
+
+        if(mSqRing)
+            munmap(mSqRing, mSqRingSize);
+
+        if(mFd >= 0)
+            close(mFd);
+    }
+
+    static_assert(sizeof(IoUring::Segment) == sizeof(struct iovec) &&
+                  offsetof(IoUring::Segment, data) == offsetof(struct iovec, iov_base) &&
+                  offsetof(IoUring::Segment, size) == offsetof(struct iovec, iov_len),
+                  "Segment must match struct iovec");
+
+    bool IoUring::queueRead(int fd, const Segment* segments, unsigned int count, uint64_t offset, uint64_t userData) {
+        const unsigned int tail = *mSqTail;
+        const unsigned int head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+
+        if(tail - head >= mSqEntries)
+            return false;
+
+        const unsigned int index = tail & *mSqMask;
+        struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(mSqes) + index;
+
+        std::memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(segments));
+        sqe->len = count;
+        sqe->off = offset;
+        sqe->user_data = userData;
+
+        mSqArray[index] = index;
+
+        // The kernel must see the entry before the new tail
+        __atomic_store_n(mSqTail, tail + 1, __ATOMIC_RELEASE);
+
+        ++mPending;
+
+        return true;
+    }
+
+    void IoUring::submit(unsigned int minComplete) {
+        const unsigned int flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        while(true) {
+            const int result = Enter(mFd, mPending, minComplete, flags);
+
+            if(result >= 0) {
+                mPending -= static_cast<unsigned int>(result) < mPending ? static_cast<unsigned int>(result) : mPending;
+
+                // Everything submitted and waited for
+                if(mPending == 0)
+                    return;
+
+                continue;
+            }
+
+            if(errno == EINTR)
+                continue;
+
+            throw IOException(std::string("io_uring_enter failed: ") + std::strerror(errno));
+        }
+    }
+
+    bool IoUring::nextCompletion(Completion& outCompletion) {
+        const unsigned int head = *mCqHead;
+        const unsigned int tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+
+        if(head == tail)
+            return false;
+
+        const struct io_uring_cqe* cqe = static_cast<const struct io_uring_cqe*>(mCqes) + (head & *mCqMask);
+
+        outCompletion.userData = cqe->user_data;
+        outCompletion.result = cqe->res;
+
+        // Done with the entry, the kernel may reuse it
+        __atomic_store_n(mCqHead, head + 1, __ATOMIC_RELEASE);
+
+        return true;
+    }
+}
+
+#else
+
+namespace motioncam {
+    std::unique_ptr<IoUring> IoUring::create(unsigned int entries) {
+        (void) entries;
+        return nullptr;
+    }
+
+    IoUring::~IoUring() {
+    }
+
+    bool IoUring::queueRead(int, const Segment*, unsigned int, uint64_t, uint64_t) {
+        return false;
+    }
+
+    void IoUring::submit(unsigned int) {
+    }
+
+    bool IoUring::nextCompletion(Completion&) {
+        return false;
+    }
+}
+
+#endif
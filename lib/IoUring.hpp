@@ -0,0 +1,76 @@
+#ifndef IoUring_hpp
+#define IoUring_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace motioncam {
+    //
+    // Minimal io_uring submission/completion queue pair for batched file reads, talking to the
+    // kernel directly so there is no liburing dependency. Only built on Linux, create() returns
+    // nullptr everywhere else and when the kernel doesn't allow io_uring (old kernels, seccomp
+    // filters in containers), callers then fall back to synchronous reads.
+    //
+    class IoUring {
+    public:
+        // Same layout as struct iovec
+        struct Segment {
+            void* data;
+            size_t size;
+        };
+
+        struct Completion {
+            uint64_t userData;
+            int32_t result;
+        };
+
+        static std::unique_ptr<IoUring> create(unsigned int entries);
+
+        ~IoUring();
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+
+        // Number of submission queue entries, keep at most this many reads in flight
+        unsigned int entries() const { return mSqEntries; }
+
+        // Queue a read that fills the segments in order, returns false if the submission queue is
+        // full. The segments must stay valid until the read completes.
+        bool queueRead(int fd, const Segment* segments, unsigned int count, uint64_t offset, uint64_t userData);
+
+        // Submit everything queued and wait for at least minComplete completions
+        void submit(unsigned int minComplete);
+
+        // Returns false if there are no more completions
+        bool nextCompletion(Completion& outCompletion);
+
+    private:
+        IoUring();
+
+    private:
+        int mFd;
+
+        void* mSqRing;
+        size_t mSqRingSize;
+        void* mCqRing;
+        size_t mCqRingSize;
+        void* mSqes;
+        size_t mSqesSize;
+
+        unsigned int* mSqHead;
+        unsigned int* mSqTail;
+        unsigned int* mSqMask;
+        unsigned int* mSqArray;
+        unsigned int mSqEntries;
+
+        unsigned int* mCqHead;
+        unsigned int* mCqTail;
+        unsigned int* mCqMask;
+        void* mCqes;
+
+        unsigned int mPending;
+    };
+}
+
+#endif /* IoUring_hpp */
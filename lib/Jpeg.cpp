@@ -0,0 +1,96 @@
+#include "Jpeg.hpp"
+
+#include <motioncam/Decoder.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(MOTIONCAM_HAS_JPEG)
+    #include <csetjmp>
+    #include <jpeglib.h>
+#endif
+
+namespace motioncam {
+    namespace jpeg {
+#if defined(MOTIONCAM_HAS_JPEG)
+        namespace {
+            // libjpeg exits the process on errors unless error_exit jumps out. Throwing from
+            // it isn't safe, libjpeg is C and may not unwind.
+            struct ErrorManager {
+                jpeg_error_mgr base;
+                std::jmp_buf jump;
+                char message[JMSG_LENGTH_MAX];
+            };
+
+            void ErrorExit(j_common_ptr info) {
+                auto* errors = reinterpret_cast<ErrorManager*>(info->err);
+
+                (*info->err->format_message)(info, errors->message);
+                std::longjmp(errors->jump, 1);
+            }
+        }
+
+        bool Supported() {
+            return true;
+        }
+
+        void Encode(const uint8_t* rgb, int width, int height, int quality, std::vector<uint8_t>& output) {
+            if(width <= 0 || height <= 0)
+                throw MotionCamException("Invalid JPEG size");
+
+            jpeg_compress_struct info;
+            ErrorManager errors;
+
+            // Owned by libjpeg, freed with free()
+            unsigned char* buffer = nullptr;
+            unsigned long size = 0;
+
+            info.err = jpeg_std_error(&errors.base);
+            errors.base.error_exit = ErrorExit;
+
+            if(setjmp(errors.jump)) {
+                jpeg_destroy_compress(&info);
+                std::free(buffer);
+
+                throw MotionCamException(std::string("Failed to encode JPEG: ") + errors.message);
+            }
+
+            jpeg_create_compress(&info);
+            jpeg_mem_dest(&info, &buffer, &size);
+
+            info.image_width = static_cast<JDIMENSION>(width);
+            info.image_height = static_cast<JDIMENSION>(height);
+            info.input_components = 3;
+            info.in_color_space = JCS_RGB;
+
+            jpeg_set_defaults(&info);
+            jpeg_set_quality(&info, std::clamp(quality, 1, 100), TRUE);
+
+            jpeg_start_compress(&info, TRUE);
+
+            const size_t stride = 3 * static_cast<size_t>(width);
+
+            while(info.next_scanline < info.image_height) {
+                JSAMPROW row = const_cast<JSAMPROW>(rgb + info.next_scanline * stride);
+                jpeg_write_scanlines(&info, &row, 1);
+            }
+
+            jpeg_finish_compress(&info);
+
+            output.assign(buffer, buffer + size);
+
+            jpeg_destroy_compress(&info);
+            std::free(buffer);
+        }
+#else
+        bool Supported() {
+            return false;
+        }
+
+        void Encode(const uint8_t*, int, int, int, std::vector<uint8_t>&) {
+            throw MotionCamException("Built without JPEG support");
+        }
+#endif
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef Jpeg_hpp
+#define Jpeg_hpp
+
+#include <cstdint>
+#include <vector>
+
+namespace motioncam {
+    namespace jpeg {
+        // False when built without libjpeg, Encode() throws then
+        bool Supported();
+
+        // Encodes interleaved 8 bit RGB as a baseline 4:2:0 JPEG. quality is 1 to 100.
+        void Encode(const uint8_t* rgb, int width, int height, int quality, std::vector<uint8_t>& output);
+    }
+}
+
+#endif /* Jpeg_hpp */
@@ -0,0 +1,407 @@
+#include "Color.hpp"
+
+#include <motioncam/LinearRenderer.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <simde/x86/sse4.1.h>
+#include <tiny_dng_writer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace motioncam {
+    namespace {
+        size_t ImageSize(const FrameMetadata& metadata) {
+            return 3 * sizeof(uint16_t) * static_cast<size_t>(metadata.width) * static_cast<size_t>(metadata.height);
+        }
+
+        // Reflects coordinates past the edges back in, which keeps their place in the CFA quad
+        int Mirror(int i, const int size) {
+            if(i < 0)
+                i = -i;
+            else if(i >= size)
+                i = 2 * (size - 1) - i;
+
+            // Only for images narrower than the kernel
+            return std::clamp(i, 0, size - 1);
+        }
+
+        // Sum of 16ths back to a pixel
+        uint16_t Round(const int32_t sum) {
+            return static_cast<uint16_t>(std::clamp((sum + 8) >> 4, 0, 65535));
+        }
+
+        //
+        // Malvar, He and Cutler's 5x5 kernels with the weights in 16ths. at(dx, dy) is the pixel
+        // at that offset, p the position of the pixel in the CFA quad. The colour the pixel has is
+        // copied, the others are the bilinear estimate corrected by the gradient of its own colour.
+        //
+        template<typename Sample>
+        inline void Interpolate(const Sample& at, const CFA& cfa, const int p, uint16_t* out) {
+            const int32_t centre = at(0, 0);
+
+            const int32_t row = at(-1, 0) + at(1, 0);
+            const int32_t column = at(0, -1) + at(0, 1);
+            const int32_t row2 = at(-2, 0) + at(2, 0);
+            const int32_t column2 = at(0, -2) + at(0, 2);
+            const int32_t diagonals = at(-1, -1) + at(1, -1) + at(-1, 1) + at(1, 1);
+
+            const int colour = cfa[p];
+
+            if(colour == 1) {
+                // Red and blue are the neighbours in the row and in the column
+                out[1] = static_cast<uint16_t>(centre);
+                out[cfa[p ^ 1]] = Round(10 * centre + 8 * row - 2 * (row2 + diagonals) + column2);
+                out[cfa[p ^ 2]] = Round(10 * centre + 8 * column - 2 * (column2 + diagonals) + row2);
+            }
+            else {
+                out[colour] = static_cast<uint16_t>(centre);
+                out[1] = Round(8 * centre + 4 * (row + column) - 2 * (row2 + column2));
+                out[cfa[p ^ 3]] = Round(12 * centre + 4 * diagonals - 3 * (row2 + column2));
+            }
+        }
+
+        // Rounds four sums of 16ths, packing them to 16 bits later saturates them
+        inline simde__m128i RoundLanes(const simde__m128i sum) {
+            return simde_mm_srai_epi32(simde_mm_add_epi32(sum, simde_mm_set1_epi32(8)), 4);
+        }
+
+        // Pixel at offset in a row as four 32 bit lanes, second picks the upper four of the eight
+        template<bool Second>
+        inline simde__m128i LoadLanes(const uint16_t* pixels) {
+            const simde__m128i v = simde_mm_loadu_si128(reinterpret_cast<const simde__m128i*>(pixels));
+
+            return Second ? simde_mm_unpackhi_epi16(v, simde_mm_setzero_si128()) : simde_mm_unpacklo_epi16(v, simde_mm_setzero_si128());
+        }
+
+        // The kernels of Interpolate() for four pixels with the multiplications as shifts
+        template<bool Second>
+        inline void EstimateLanes(const uint16_t* centre, const ptrdiff_t stride, simde__m128i* out) {
+            const simde__m128i c = LoadLanes<Second>(centre);
+            const simde__m128i horizontal = simde_mm_add_epi32(LoadLanes<Second>(centre - 1), LoadLanes<Second>(centre + 1));
+            const simde__m128i vertical = simde_mm_add_epi32(LoadLanes<Second>(centre - stride), LoadLanes<Second>(centre + stride));
+            const simde__m128i horizontal2 = simde_mm_add_epi32(LoadLanes<Second>(centre - 2), LoadLanes<Second>(centre + 2));
+            const simde__m128i vertical2 = simde_mm_add_epi32(LoadLanes<Second>(centre - 2 * stride), LoadLanes<Second>(centre + 2 * stride));
+            const simde__m128i diagonals = simde_mm_add_epi32(
+                simde_mm_add_epi32(LoadLanes<Second>(centre - stride - 1), LoadLanes<Second>(centre - stride + 1)),
+                simde_mm_add_epi32(LoadLanes<Second>(centre + stride - 1), LoadLanes<Second>(centre + stride + 1)));
+
+            const simde__m128i c8 = simde_mm_slli_epi32(c, 3);
+            const simde__m128i c10 = simde_mm_add_epi32(c8, simde_mm_slli_epi32(c, 1));
+            const simde__m128i cross2 = simde_mm_add_epi32(horizontal2, vertical2);
+
+            // 8c + 4(h + v) - 2(h2 + v2)
+            out[0] = RoundLanes(simde_mm_sub_epi32(
+                simde_mm_add_epi32(c8, simde_mm_slli_epi32(simde_mm_add_epi32(horizontal, vertical), 2)),
+                simde_mm_slli_epi32(cross2, 1)));
+
+            // 10c + 8h - 2(h2 + d) + v2
+            out[1] = RoundLanes(simde_mm_add_epi32(
+                simde_mm_sub_epi32(
+                    simde_mm_add_epi32(c10, simde_mm_slli_epi32(horizontal, 3)),
+                    simde_mm_slli_epi32(simde_mm_add_epi32(horizontal2, diagonals), 1)),
+                vertical2));
+
+            // 10c + 8v - 2(v2 + d) + h2
+            out[2] = RoundLanes(simde_mm_add_epi32(
+                simde_mm_sub_epi32(
+                    simde_mm_add_epi32(c10, simde_mm_slli_epi32(vertical, 3)),
+                    simde_mm_slli_epi32(simde_mm_add_epi32(vertical2, diagonals), 1)),
+                horizontal2));
+
+            // 12c + 4d - 3(h2 + v2)
+            out[3] = RoundLanes(simde_mm_sub_epi32(
+                simde_mm_add_epi32(simde_mm_add_epi32(c8, simde_mm_slli_epi32(c, 2)), simde_mm_slli_epi32(diagonals, 2)),
+                simde_mm_add_epi32(simde_mm_slli_epi32(cross2, 1), cross2)));
+        }
+
+        // The four estimates of every pixel of a row of a tile, before each pixel picks the two
+        // it needs by its place in the CFA quad
+        struct RowEstimates {
+            std::vector<uint16_t> green;
+            std::vector<uint16_t> row;
+            std::vector<uint16_t> column;
+            std::vector<uint16_t> diagonal;
+
+            RowEstimates() :
+                green(LinearRenderer::TILE_WIDTH),
+                row(LinearRenderer::TILE_WIDTH),
+                column(LinearRenderer::TILE_WIDTH),
+                diagonal(LinearRenderer::TILE_WIDTH)
+            {
+            }
+        };
+
+        // Demosaics the tile [x0, x1) x [y0, y1)
+        void DemosaicTile(
+            const uint16_t* image,
+            const int width,
+            const int height,
+            const CFA& cfa,
+            const int x0,
+            const int y0,
+            const int x1,
+            const int y1,
+            RowEstimates& estimates,
+            uint16_t* output)
+        {
+            const ptrdiff_t stride = width;
+
+            for(int y = y0; y < y1; y++) {
+                const uint16_t* in = image + y * stride;
+                uint16_t* out = output + 3 * (y * stride);
+
+                const int quadRow = (y & 1) << 1;
+
+                // The kernels reach two pixels out, only the edges of the image need mirroring
+                const bool innerRow = y >= 2 && y + 2 < height;
+                const int innerStart = innerRow ? std::clamp(2, x0, x1) : x1;
+                const int innerEnd = innerRow ? std::clamp(width - 2, innerStart, x1) : x1;
+
+                auto edge = [&](int x) {
+                    auto at = [&](int dx, int dy) {
+                        return static_cast<int32_t>(image[Mirror(y + dy, height) * stride + Mirror(x + dx, width)]);
+                    };
+
+                    Interpolate(at, cfa, quadRow | (x & 1), out + 3 * x);
+                };
+
+                for(int x = x0; x < innerStart; x++)
+                    edge(x);
+
+                // All four estimates for every pixel, eight at a time, then each pixel takes the
+                // two for its colour
+                uint16_t* green = estimates.green.data() - innerStart;
+                uint16_t* row = estimates.row.data() - innerStart;
+                uint16_t* column = estimates.column.data() - innerStart;
+                uint16_t* diagonal = estimates.diagonal.data() - innerStart;
+
+                uint16_t* planes[4] = { green, row, column, diagonal };
+                int x = innerStart;
+
+                for(; x + 8 <= innerEnd; x += 8) {
+                    simde__m128i first[4];
+                    simde__m128i second[4];
+
+                    EstimateLanes<false>(in + x, stride, first);
+                    EstimateLanes<true>(in + x, stride, second);
+
+                    for(int i = 0; i < 4; i++)
+                        simde_mm_storeu_si128(reinterpret_cast<simde__m128i*>(planes[i] + x), simde_mm_packus_epi32(first[i], second[i]));
+                }
+
+                for(; x < innerEnd; x++) {
+                    const uint16_t* centre = in + x;
+
+                    const int32_t c = centre[0];
+                    const int32_t horizontal = centre[-1] + centre[1];
+                    const int32_t vertical = centre[-stride] + centre[stride];
+                    const int32_t horizontal2 = centre[-2] + centre[2];
+                    const int32_t vertical2 = centre[-2 * stride] + centre[2 * stride];
+                    const int32_t diagonals = centre[-stride - 1] + centre[-stride + 1] + centre[stride - 1] + centre[stride + 1];
+
+                    green[x] = Round(8 * c + 4 * (horizontal + vertical) - 2 * (horizontal2 + vertical2));
+                    row[x] = Round(10 * c + 8 * horizontal - 2 * (horizontal2 + diagonals) + vertical2);
+                    column[x] = Round(10 * c + 8 * vertical - 2 * (vertical2 + diagonals) + horizontal2);
+                    diagonal[x] = Round(12 * c + 4 * diagonals - 3 * (horizontal2 + vertical2));
+                }
+
+                // Where each channel of the even and odd columns comes from
+                const uint16_t* source[2][3];
+
+                for(int i = 0; i < 2; i++) {
+                    const int p = quadRow | ((innerStart + i) & 1);
+
+                    source[i][cfa[p]] = in;
+
+                    if(cfa[p] == 1) {
+                        source[i][cfa[p ^ 1]] = row;
+                        source[i][cfa[p ^ 2]] = column;
+                    }
+                    else {
+                        source[i][1] = green;
+                        source[i][cfa[p ^ 3]] = diagonal;
+                    }
+                }
+
+                const uint16_t* r0 = source[0][0];
+                const uint16_t* g0 = source[0][1];
+                const uint16_t* b0 = source[0][2];
+                const uint16_t* r1 = source[1][0] + 1;
+                const uint16_t* g1 = source[1][1] + 1;
+                const uint16_t* b1 = source[1][2] + 1;
+
+                x = innerStart;
+
+                for(; x + 2 <= innerEnd; x += 2) {
+                    uint16_t* pixel = out + 3 * x;
+
+                    pixel[0] = r0[x];
+                    pixel[1] = g0[x];
+                    pixel[2] = b0[x];
+                    pixel[3] = r1[x];
+                    pixel[4] = g1[x];
+                    pixel[5] = b1[x];
+                }
+
+                if(x < innerEnd) {
+                    out[3 * x + 0] = r0[x];
+                    out[3 * x + 1] = g0[x];
+                    out[3 * x + 2] = b0[x];
+                }
+
+                for(int x = innerEnd; x < x1; x++)
+                    edge(x);
+            }
+        }
+    }
+
+    LinearRenderer::LinearRenderer(const ContainerMetadata& containerMetadata, const std::vector<DefectPixel>& defects) :
+        mContainerMetadata(containerMetadata),
+        mCFA(color::CFAFromArrangement(containerMetadata.sensorArrangement)),
+        mNormalization(raw::NormalizationFor(containerMetadata.blackLevel, containerMetadata.whiteLevel, raw::OutputFormat::UInt16)),
+        mDefects(defects)
+    {
+        if(mContainerMetadata.blackLevel.size() < 4)
+            throw MotionCamException("Invalid metadata (blackLevel)");
+
+        // tinydng reads a fixed number of values from each of these
+        if(mContainerMetadata.colorMatrix1.size() < 9 ||
+           mContainerMetadata.colorMatrix2.size() < 9 ||
+           mContainerMetadata.forwardMatrix1.size() < 9 ||
+           mContainerMetadata.forwardMatrix2.size() < 9)
+        {
+            throw MotionCamException("Invalid metadata (color matrices)");
+        }
+    }
+
+    size_t LinearRenderer::dngSize(const FrameMetadata& metadata) const {
+        std::vector<uint8_t> header;
+
+        return writeHeader(metadata, header) + ImageSize(metadata);
+    }
+
+    void LinearRenderer::render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads) const {
+        std::vector<uint8_t> header;
+        const size_t imageOffset = writeHeader(metadata, header);
+
+        std::memcpy(output, header.data(), header.size());
+        std::memset(output + header.size(), 0, imageOffset - header.size());
+
+        std::vector<uint16_t> image(static_cast<size_t>(metadata.width) * static_cast<size_t>(metadata.height));
+
+        decoder.loadFrameAt(index, image.data(), metadata.width, metadata.height, metadata.compressionType, mNormalization, numThreads);
+
+        FixDefectPixels(image.data(), metadata.width, metadata.height, mDefects);
+
+        demosaic(image.data(), metadata.width, metadata.height, reinterpret_cast<uint16_t*>(output + imageOffset), numThreads);
+    }
+
+    void LinearRenderer::render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, std::vector<uint8_t>& output, unsigned int numThreads) const {
+        output.resize(dngSize(metadata));
+
+        render(decoder, index, metadata, output.data(), numThreads);
+    }
+
+    void LinearRenderer::demosaic(const uint16_t* image, int width, int height, uint16_t* output, unsigned int numThreads) const {
+        trace::ScopedEvent event("demosaic");
+
+        if(width <= 0 || height <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        const int tilesX = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+        const int tilesY = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+        const int numTiles = tilesX * tilesY;
+
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        numThreads = std::min(numThreads, static_cast<unsigned int>(numTiles));
+
+        // Tiles don't overlap, so the threads write straight into output
+        std::atomic<int> nextTile(0);
+
+        auto work = [&] {
+            RowEstimates estimates;
+
+            for(int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                const int x0 = (tile % tilesX) * TILE_WIDTH;
+                const int y0 = (tile / tilesX) * TILE_HEIGHT;
+
+                DemosaicTile(image, width, height, mCFA, x0, y0, std::min(x0 + TILE_WIDTH, width), std::min(y0 + TILE_HEIGHT, height), estimates, output);
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for(unsigned int i = 1; i < numThreads; i++)
+            threads.emplace_back(work);
+
+        work();
+
+        for(auto& thread : threads)
+            thread.join();
+    }
+
+    size_t LinearRenderer::writeHeader(const FrameMetadata& metadata, std::vector<uint8_t>& header) const {
+        stats::ScopedTimer timer(stats::Stage::Render);
+        trace::ScopedEvent event("dng_header");
+
+        if(metadata.width <= 0 || metadata.height <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        if(metadata.asShotNeutral.size() < 3)
+            throw MotionCamException("Invalid metadata (asShotNeutral)");
+
+        tinydngwriter::DNGImage dng;
+
+        // Image data is written in host byte order
+        dng.SetBigEndian(false);
+        dng.SetDNGVersion(1, 4, 0, 0);
+        dng.SetDNGBackwardVersion(1, 1, 0, 0);
+
+        dng.SetColorMatrix1(3, mContainerMetadata.colorMatrix1.data());
+        dng.SetColorMatrix2(3, mContainerMetadata.colorMatrix2.data());
+
+        dng.SetForwardMatrix1(3, mContainerMetadata.forwardMatrix1.data());
+        dng.SetForwardMatrix2(3, mContainerMetadata.forwardMatrix2.data());
+
+        dng.SetAsShotNeutral(3, metadata.asShotNeutral.data());
+
+        dng.SetCalibrationIlluminant1(21);
+        dng.SetCalibrationIlluminant2(17);
+
+        dng.SetUniqueCameraModel("MotionCam");
+
+        const unsigned short bitsPerSample[3] = { 16, 16, 16 };
+
+        dng.SetImageDataSize(static_cast<unsigned int>(ImageSize(metadata)));
+        dng.SetImageWidth(metadata.width);
+        dng.SetImageLength(metadata.height);
+        dng.SetPlanarConfig(tinydngwriter::PLANARCONFIG_CONTIG);
+        dng.SetPhotometric(tinydngwriter::PHOTOMETRIC_LINEARRAW);
+        dng.SetRowsPerStrip(metadata.height);
+        dng.SetSamplesPerPixel(3);
+        dng.SetBitsPerSample(3, bitsPerSample);
+        dng.SetCompression(tinydngwriter::COMPRESSION_NONE);
+
+        // Normalized as it is decoded. Written as a short like FrameRenderer, 65535 is all ones.
+        dng.SetWhiteLevel(static_cast<short>(65535));
+
+        dng.SetSubfileType();
+        dng.SetActiveArea({ 0, 0, static_cast<uint32_t>(metadata.height), static_cast<uint32_t>(metadata.width) });
+
+        const tinydngwriter::DNGWriter writer(false);
+
+        std::string err;
+        unsigned int stripOffset = 0;
+
+        if(!writer.WriteHeader(&dng, &err, &header, &stripOffset))
+            throw MotionCamException("Failed to write DNG: " + err);
+
+        return stripOffset;
+    }
+}
@@ -0,0 +1,316 @@
+#include <motioncam/Metadata.hpp>
+#include <motioncam/Decoder.hpp>
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace motioncam {
+    namespace {
+        //
+        // Minimal JSON reader. The metadata written by MotionCam is small and flat so we only
+        // need enough to pull out numbers, strings and arrays of numbers from the top level object.
+        //
+
+        struct JsonValue {
+            enum class Kind { Null, Bool, Number, String, Array, Object };
+
+            Kind kind = Kind::Null;
+            double number = 0;
+            std::string string;
+            std::vector<JsonValue> array;
+            std::vector<std::pair<std::string, JsonValue>> object;
+
+            // Location of the value in the source text
+            size_t begin = 0;
+            size_t end = 0;
+
+            const JsonValue* find(const std::string& key) const {
+                for(const auto& kv : object) {
+                    if(kv.first == key)
+                        return &kv.second;
+                }
+
+                return nullptr;
+            }
+        };
+
+        class JsonReader {
+        public:
+            JsonReader(const std::string& json) : mJson(json), mPos(0) {}
+
+            JsonValue parse() {
+                JsonValue value = parseValue();
+
+                skipWhitespace();
+                if(mPos != mJson.size())
+                    throw MotionCamException("Invalid metadata (trailing data)");
+
+                return value;
+            }
+
+        private:
+            void skipWhitespace() {
+                while(mPos < mJson.size() && std::isspace(static_cast<unsigned char>(mJson[mPos])))
+                    ++mPos;
+            }
+
+            char peek() {
+                skipWhitespace();
+
+                if(mPos >= mJson.size())
+                    throw MotionCamException("Invalid metadata (unexpected end)");
+
+                return mJson[mPos];
+            }
+
+            void expect(char c) {
+                if(peek() != c)
+                    throw MotionCamException(std::string("Invalid metadata (expected '") + c + "')");
+
+                ++mPos;
+            }
+
+            void expectLiteral(const char* literal) {
+                const size_t len = std::strlen(literal);
+
+                if(mJson.compare(mPos, len, literal) != 0)
+                    throw MotionCamException("Invalid metadata (bad literal)");
+
+                mPos += len;
+            }
+
+            JsonValue parseValue() {
+                JsonValue value;
+
+                const char c = peek();
+                value.begin = mPos;
+
+                if(c == '{') {
+                    value.kind = JsonValue::Kind::Object;
+                    ++mPos;
+
+                    if(peek() != '}') {
+                        while(true) {
+                            std::string key = parseString();
+                            expect(':');
+                            value.object.emplace_back(std::move(key), parseValue());
+
+                            if(peek() == ',') {
+                                ++mPos;
+                                continue;
+                            }
+                            break;
+                        }
+                    }
+
+                    expect('}');
+                }
+                else if(c == '[') {
+                    value.kind = JsonValue::Kind::Array;
+                    ++mPos;
+
+                    if(peek() != ']') {
+                        while(true) {
+                            value.array.push_back(parseValue());
+
+                            if(peek() == ',') {
+                                ++mPos;
+                                continue;
+                            }
+                            break;
+                        }
+                    }
+
+                    expect(']');
+                }
+                else if(c == '"') {
+                    value.kind = JsonValue::Kind::String;
+                    value.string = parseString();
+                }
+                else if(c == 't') {
+                    value.kind = JsonValue::Kind::Bool;
+                    value.number = 1;
+                    expectLiteral("true");
+                }
+                else if(c == 'f') {
+                    value.kind = JsonValue::Kind::Bool;
+                    expectLiteral("false");
+                }
+                else if(c == 'n') {
+                    expectLiteral("null");
+                }
+                else {
+                    const char* start = mJson.c_str() + mPos;
+                    char* end = nullptr;
+
+                    value.kind = JsonValue::Kind::Number;
+                    value.number = std::strtod(start, &end);
+
+                    if(end == start)
+                        throw MotionCamException("Invalid metadata (bad number)");
+
+                    mPos += end - start;
+                }
+
+                value.end = mPos;
+
+                return value;
+            }
+
+            std::string parseString() {
+                expect('"');
+
+                std::string result;
+
+                while(mPos < mJson.size() && mJson[mPos] != '"') {
+                    char c = mJson[mPos++];
+
+                    if(c == '\\' && mPos < mJson.size()) {
+                        c = mJson[mPos++];
+
+                        switch(c) {
+                            case 'n': c = '\n'; break;
+                            case 't': c = '\t'; break;
+                            case 'r': c = '\r'; break;
+                            case 'b': c = '\b'; break;
+                            case 'f': c = '\f'; break;
+                            case 'u':
+                                // Metadata keys and values we read are plain ASCII, keep the escape as is
+                                result += "\\u";
+                                continue;
+                            default:
+                                break;
+                        }
+                    }
+
+                    result += c;
+                }
+
+                expect('"');
+
+                return result;
+            }
+
+        private:
+            const std::string& mJson;
+            size_t mPos;
+        };
+
+        JsonValue parseObject(const std::string& json) {
+            JsonValue root = JsonReader(json).parse();
+
+            if(root.kind != JsonValue::Kind::Object)
+                throw MotionCamException("Invalid metadata (expected object)");
+
+            return root;
+        }
+
+        double getNumber(const JsonValue& root, const std::string& key, double defaultValue = 0) {
+            const JsonValue* value = root.find(key);
+
+            if(!value || (value->kind != JsonValue::Kind::Number && value->kind != JsonValue::Kind::Bool))
+                return defaultValue;
+
+            return value->number;
+        }
+
+        std::string getString(const JsonValue& root, const std::string& key) {
+            const JsonValue* value = root.find(key);
+
+            if(!value || value->kind != JsonValue::Kind::String)
+                return "";
+
+            return value->string;
+        }
+
+        // Integers are read from the source text, doubles can't hold every nanosecond timestamp.
+        // MotionCam writes some of them as strings.
+        int64_t getInteger(const std::string& json, const JsonValue& root, const std::string& key, int64_t defaultValue = 0) {
+            const JsonValue* value = root.find(key);
+
+            if(!value)
+                return defaultValue;
+
+            std::string text;
+
+            if(value->kind == JsonValue::Kind::Number)
+                text = json.substr(value->begin, value->end - value->begin);
+            else if(value->kind == JsonValue::Kind::String)
+                text = value->string;
+            else
+                return defaultValue;
+
+            char* end = nullptr;
+            const long long result = std::strtoll(text.c_str(), &end, 10);
+
+            if(end == text.c_str())
+                return defaultValue;
+
+            return static_cast<int64_t>(result);
+        }
+
+        template<typename T>
+        std::vector<T> getArray(const JsonValue& root, const std::string& key) {
+            std::vector<T> result;
+            const JsonValue* value = root.find(key);
+
+            if(!value || value->kind != JsonValue::Kind::Array)
+                return result;
+
+            result.reserve(value->array.size());
+
+            for(const auto& v : value->array)
+                result.push_back(static_cast<T>(v.number));
+
+            return result;
+        }
+    }
+
+    ContainerMetadata ContainerMetadata::parse(const std::string& json) {
+        const JsonValue root = parseObject(json);
+        ContainerMetadata metadata;
+
+        metadata.blackLevel = getArray<uint16_t>(root, "blackLevel");
+        metadata.whiteLevel = getNumber(root, "whiteLevel");
+
+        // JSON key has a typo "sensorArrangment"
+        metadata.sensorArrangement = getString(root, "sensorArrangment");
+        if(metadata.sensorArrangement.empty())
+            metadata.sensorArrangement = getString(root, "sensorArrangement");
+
+        metadata.colorMatrix1 = getArray<float>(root, "colorMatrix1");
+        metadata.colorMatrix2 = getArray<float>(root, "colorMatrix2");
+        metadata.forwardMatrix1 = getArray<float>(root, "forwardMatrix1");
+        metadata.forwardMatrix2 = getArray<float>(root, "forwardMatrix2");
+
+        return metadata;
+    }
+
+    FrameMetadata FrameMetadata::parse(const std::string& json) {
+        const JsonValue root = parseObject(json);
+        FrameMetadata metadata;
+
+        metadata.width = static_cast<int>(getNumber(root, "width"));
+        metadata.height = static_cast<int>(getNumber(root, "height"));
+        metadata.asShotNeutral = getArray<float>(root, "asShotNeutral");
+        metadata.compressionType = static_cast<int>(getNumber(root, "compressionType"));
+        metadata.timestamp = getInteger(json, root, "timestamp", -1);
+
+        return metadata;
+    }
+
+    std::string replaceCompressionType(const std::string& json, int compressionType) {
+        const JsonValue root = parseObject(json);
+        const JsonValue* value = root.find("compressionType");
+
+        if(!value || value->kind != JsonValue::Kind::Number)
+            throw MotionCamException("Invalid metadata (missing compressionType)");
+
+        std::string result(json);
+        result.replace(value->begin, value->end - value->begin, std::to_string(compressionType));
+
+        return result;
+    }
+}
@@ -0,0 +1,233 @@
+#include "Color.hpp"
+#include "Jpeg.hpp"
+
+#include <motioncam/PreviewRenderer.hpp>
+#include <motioncam/RawData.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <simde/x86/sse2.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace motioncam {
+    namespace {
+        // Bands smaller than this aren't worth a thread
+        const int MIN_ROWS_PER_THREAD = 32;
+
+        //
+        // Maps the four raw pixels of a CFA quad straight to a gamma table index for each of R, G
+        // and B: index = offset + sum(weights[p] * pixel[p]). The black level, white balance,
+        // averaging the greens, the colour matrix and scaling to the table all fold into these.
+        //
+        struct QuadTransform {
+            float weights[3][4];
+            float offset[3];
+        };
+
+        // Turns rows [firstRow, lastRow) of quads into RGB
+        void RenderRows(
+            const uint16_t* image,
+            const int imageWidth,
+            uint8_t* output,
+            const int outWidth,
+            const int firstRow,
+            const int lastRow,
+            const QuadTransform& transform,
+            const uint8_t* gamma)
+        {
+            const float maxIndex = static_cast<float>(color::GAMMA_TABLE_SIZE - 1);
+
+            const simde__m128i mask = simde_mm_set1_epi32(0xFFFF);
+            const simde__m128 zero = simde_mm_setzero_ps();
+            const simde__m128 max = simde_mm_set1_ps(maxIndex);
+
+            simde__m128 weights[3][4];
+            simde__m128 offset[3];
+
+            for(int c = 0; c < 3; c++) {
+                for(int p = 0; p < 4; p++)
+                    weights[c][p] = simde_mm_set1_ps(transform.weights[c][p]);
+
+                offset[c] = simde_mm_set1_ps(transform.offset[c]);
+            }
+
+            alignas(16) int32_t indices[3][4];
+
+            for(int y = firstRow; y < lastRow; y++) {
+                const uint16_t* row0 = image + static_cast<size_t>(2 * y) * imageWidth;
+                const uint16_t* row1 = row0 + imageWidth;
+                uint8_t* out = output + static_cast<size_t>(y) * outWidth * 3;
+
+                int x = 0;
+
+                // Four quads at a time, the even and odd columns of each row split into 32 bit lanes
+                for(; x + 4 <= outWidth; x += 4) {
+                    const simde__m128i top = simde_mm_loadu_si128(reinterpret_cast<const simde__m128i*>(row0 + 2 * x));
+                    const simde__m128i bottom = simde_mm_loadu_si128(reinterpret_cast<const simde__m128i*>(row1 + 2 * x));
+
+                    const simde__m128 pixels[4] = {
+                        simde_mm_cvtepi32_ps(simde_mm_and_si128(top, mask)),
+                        simde_mm_cvtepi32_ps(simde_mm_srli_epi32(top, 16)),
+                        simde_mm_cvtepi32_ps(simde_mm_and_si128(bottom, mask)),
+                        simde_mm_cvtepi32_ps(simde_mm_srli_epi32(bottom, 16))
+                    };
+
+                    for(int c = 0; c < 3; c++) {
+                        simde__m128 value = offset[c];
+
+                        for(int p = 0; p < 4; p++)
+                            value = simde_mm_add_ps(value, simde_mm_mul_ps(weights[c][p], pixels[p]));
+
+                        value = simde_mm_min_ps(simde_mm_max_ps(value, zero), max);
+
+                        simde_mm_store_si128(reinterpret_cast<simde__m128i*>(indices[c]), simde_mm_cvttps_epi32(value));
+                    }
+
+                    for(int i = 0; i < 4; i++) {
+                        out[0] = gamma[indices[0][i]];
+                        out[1] = gamma[indices[1][i]];
+                        out[2] = gamma[indices[2][i]];
+
+                        out += 3;
+                    }
+                }
+
+                for(; x < outWidth; x++) {
+                    const uint16_t pixels[4] = { row0[2 * x], row0[2 * x + 1], row1[2 * x], row1[2 * x + 1] };
+
+                    for(int c = 0; c < 3; c++) {
+                        float value = transform.offset[c];
+
+                        for(int p = 0; p < 4; p++)
+                            value += transform.weights[c][p] * static_cast<float>(pixels[p]);
+
+                        *out++ = gamma[static_cast<int>(std::clamp(value, 0.0f, maxIndex))];
+                    }
+                }
+            }
+        }
+    }
+
+    PreviewRenderer::PreviewRenderer(const ContainerMetadata& containerMetadata, int binning) :
+        mContainerMetadata(containerMetadata),
+        mCFA(color::CFAFromArrangement(containerMetadata.sensorArrangement)),
+        mBinning(binning),
+        mCameraToSrgb(color::CameraToSrgb(containerMetadata)),
+        mGammaTable(color::SrgbGammaTable())
+    {
+        if(mBinning != 1 && mBinning != 2 && mBinning != 4)
+            throw MotionCamException("Invalid binning (" + std::to_string(mBinning) + ")");
+
+        if(mContainerMetadata.blackLevel.size() < 4)
+            throw MotionCamException("Invalid metadata (blackLevel)");
+    }
+
+    int PreviewRenderer::imageWidth(const FrameMetadata& metadata) const {
+        return mBinning > 1 ? raw::BinnedSize(metadata.width, mBinning) : metadata.width;
+    }
+
+    int PreviewRenderer::imageHeight(const FrameMetadata& metadata) const {
+        return mBinning > 1 ? raw::BinnedSize(metadata.height, mBinning) : metadata.height;
+    }
+
+    int PreviewRenderer::width(const FrameMetadata& metadata) const {
+        return imageWidth(metadata) / 2;
+    }
+
+    int PreviewRenderer::height(const FrameMetadata& metadata) const {
+        return imageHeight(metadata) / 2;
+    }
+
+    void PreviewRenderer::render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads) const {
+        if(width(metadata) <= 0 || height(metadata) <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        std::vector<uint16_t> image(static_cast<size_t>(imageWidth(metadata)) * imageHeight(metadata));
+
+        if(mBinning > 1)
+            decoder.loadProxyAt(index, image.data(), metadata.width, metadata.height, metadata.compressionType, mBinning);
+        else
+            decoder.loadFrameAt(index, image.data(), metadata.width, metadata.height, metadata.compressionType);
+
+        render(image.data(), metadata, output, numThreads);
+    }
+
+    void PreviewRenderer::render(const uint16_t* image, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads) const {
+        trace::ScopedEvent event("preview");
+
+        const int outWidth = width(metadata);
+        const int outHeight = height(metadata);
+
+        if(outWidth <= 0 || outHeight <= 0)
+            throw MotionCamException("Invalid metadata (frame size)");
+
+        float matrix[9];
+        color::FrameMatrix(mCameraToSrgb, mContainerMetadata, metadata, matrix);
+
+        // Greens are averaged, everything is scaled to the gamma table
+        const float scale = static_cast<float>(color::GAMMA_TABLE_SIZE - 1);
+        QuadTransform transform;
+
+        for(int c = 0; c < 3; c++) {
+            // Round to the nearest entry, the SIMD path truncates
+            transform.offset[c] = 0.5f;
+
+            for(int p = 0; p < 4; p++) {
+                const int samples = static_cast<int>(std::count(mCFA.begin(), mCFA.begin() + 4, mCFA[p]));
+                const float weight = scale * matrix[c*3 + mCFA[p]] / static_cast<float>(samples);
+
+                transform.weights[c][p] = weight;
+                transform.offset[c] -= weight * static_cast<float>(mContainerMetadata.blackLevel[p]);
+            }
+        }
+
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        numThreads = std::clamp<unsigned int>(static_cast<unsigned int>(outHeight / MIN_ROWS_PER_THREAD), 1, numThreads);
+
+        const int rowsPerThread = (outHeight + static_cast<int>(numThreads) - 1) / static_cast<int>(numThreads);
+        const int inWidth = imageWidth(metadata);
+
+        std::vector<std::thread> threads;
+
+        for(int firstRow = 0; firstRow < outHeight; firstRow += rowsPerThread) {
+            const int lastRow = std::min(firstRow + rowsPerThread, outHeight);
+
+            if(lastRow == outHeight) {
+                // Last band runs on the calling thread
+                RenderRows(image, inWidth, output, outWidth, firstRow, lastRow, transform, mGammaTable.data());
+                break;
+            }
+
+            threads.emplace_back(RenderRows, image, inWidth, output, outWidth, firstRow, lastRow, std::cref(transform), mGammaTable.data());
+        }
+
+        for(auto& thread : threads)
+            thread.join();
+    }
+
+    void PreviewRenderer::renderJpeg(
+        Decoder& decoder,
+        const size_t index,
+        const FrameMetadata& metadata,
+        std::vector<uint8_t>& output,
+        int quality,
+        unsigned int numThreads) const
+    {
+        if(!supportsJpeg())
+            throw MotionCamException("Built without JPEG support");
+
+        std::vector<uint8_t> rgb(3 * static_cast<size_t>(std::max(0, width(metadata))) * std::max(0, height(metadata)));
+
+        render(decoder, index, metadata, rgb.data(), numThreads);
+
+        trace::ScopedEvent event("jpeg");
+        jpeg::Encode(rgb.data(), width(metadata), height(metadata), quality, output);
+    }
+
+    bool PreviewRenderer::supportsJpeg() {
+        return jpeg::Supported();
+    }
+}
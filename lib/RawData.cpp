@@ -1,10 +1,14 @@
 #include <motioncam/RawData.hpp>
+#include <algorithm>
 #include <vector>
 #include <cstring>
 #include <cmath>
+#include <functional>
+#include <thread>
 
 #include <simde/x86/sse2.h>
 #include <simde/x86/sse4.1.h>
+#include <simde/x86/f16c.h>
 
 #if defined(__GNUC__)
 #  define RESTRICT __restrict__
@@ -412,13 +416,9 @@ namespace motioncam {
         uint16_t *RESTRICT output,
         const uint16_t bits,
         const uint8_t* input,
-        const size_t offset,
-        const size_t len)
+        const size_t offset)
     {
-        // Don't decode if past end of input
-        if(offset + ENCODING_BLOCK_LENGTH[bits] > len)
-            return len - offset;
-     
+        // Callers have already checked the block is within the input (see ReadLayout())
         input += offset;
 
         switch (bits) {
@@ -461,32 +461,60 @@ namespace motioncam {
     }
     
     INLINE
-    size_t DecodeMetadata(
+    uint32_t Read32(const uint8_t* input) {
+        return
+                 static_cast<uint32_t>(input[0])
+            |   (static_cast<uint32_t>(input[1]) << 8)
+            |   (static_cast<uint32_t>(input[2]) << 16)
+            |   (static_cast<uint32_t>(input[3]) << 24);
+    }
+
+    void ReadMetadataHeader(const uint8_t* input, uint32_t& encodedWidth, uint32_t& encodedHeight, uint32_t& bitsOffset, uint32_t& refsOffset) {
+        encodedWidth  = Read32(input);
+        encodedHeight = Read32(input + 4);
+        bitsOffset    = Read32(input + 8);
+        refsOffset    = Read32(input + 12);
+    }
+    
+    //
+    // Decodes the first numValues entries of a bits/refs stream. Returns false if the stream is
+    // shorter than that or runs past the end of the input.
+    //
+    
+    bool DecodeMetadata(
         const uint8_t* input,
         size_t offset,
         const size_t len,
+        const size_t numValues,
         std::vector<uint16_t>& outMetadata)
     {
-        uint32_t numBlocks =
-                 static_cast<uint32_t>(input[offset])
-            |   (static_cast<uint32_t>(input[offset+1]) << 8)
-            |   (static_cast<uint32_t>(input[offset+2]) << 16)
-            |   (static_cast<uint32_t>(input[offset+3]) << 24);
+        if(offset + 4 > len)
+            return false;
+        
+        const uint32_t storedValues = Read32(input + offset);
+        if(storedValues < numValues)
+            return false;
     
-        outMetadata.resize(numBlocks);
+        // Blocks are always decoded whole
+        outMetadata.resize(ENCODING_BLOCK * ((numValues + ENCODING_BLOCK - 1) / ENCODING_BLOCK));
         offset += 4;
         
         uint8_t bits;
         uint16_t reference;
 
-        // Decode bits
         uint16_t* data = outMetadata.data();
 
-        for(int i = 0; i < numBlocks; i+=ENCODING_BLOCK) {
-            DecodeHeader(bits, reference, input+offset);
+        for(size_t i = 0; i < outMetadata.size(); i+=ENCODING_BLOCK) {
+            if(offset + HEADER_LENGTH > len)
+                return false;
             
+            DecodeHeader(bits, reference, input+offset);
             offset += HEADER_LENGTH;
-            offset += DecodeBlock(data, bits, input, offset, len);
+
+            if(offset + ENCODING_BLOCK_LENGTH[bits] > len)
+                return false;
+
+            offset += DecodeBlock(data, bits, input, offset);
             
             for(int x = 0; x < ENCODING_BLOCK; x++)
                 data[x] += reference;
@@ -494,120 +522,873 @@ namespace motioncam {
             data += ENCODING_BLOCK;
         }
         
-        return offset;
+        return true;
     }
     
-    void ReadMetadataHeader(const uint8_t* input, uint32_t& encodedWidth, uint32_t& encodedHeight, uint32_t& bitsOffset, uint32_t& refsOffset) {
-        encodedWidth =
-                 static_cast<uint32_t>(input[0])
-            |   (static_cast<uint32_t>(input[1]) << 8)
-            |   (static_cast<uint32_t>(input[2]) << 16)
-            |   (static_cast<uint32_t>(input[3]) << 24);
+    struct FrameLayout {
+        uint32_t encodedWidth;
+        uint32_t encodedHeight;
+        
+        // Blocks per 4 row group and number of groups that end up in the output
+        size_t blocksPerGroup;
+        size_t numGroups;
+        
+        std::vector<uint16_t> bits;
+        std::vector<uint16_t> refs;
+    };
+    
+    //
+    // Reads the frame header and bits/refs streams and checks every pixel block the output needs
+    // fits in the input. This is cheap compared to decoding the pixels, so corrupt frames are
+    // rejected before any real work is done and the decode loop needs no bounds checks.
+    //
+    // Functions that only look at the block headers pass checkBlocks = false, so they also take
+    // frames with the pixels stripped out (see StripPixels()).
+    //
+    
+    bool ReadLayout(
+        FrameLayout& layout,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        const bool checkBlocks = true)
+    {
+        if(!input || width <= 0 || height <= 0 || len < METADATA_OFFSET)
+            return false;
+        
+        uint32_t bitsOffset, refsOffset;
+
+        ReadMetadataHeader(input, layout.encodedWidth, layout.encodedHeight, bitsOffset, refsOffset);
 
-        encodedHeight =
-                 static_cast<uint32_t>(input[4])
-            |   (static_cast<uint32_t>(input[5]) << 8)
-            |   (static_cast<uint32_t>(input[6]) << 16)
-            |   (static_cast<uint32_t>(input[7]) << 24);
+        if(bitsOffset > len || refsOffset > len)
+            return false;
+
+        if(layout.encodedWidth % ENCODING_BLOCK > 0)
+            return false;
+
+        if(layout.encodedWidth < static_cast<uint32_t>(width) || layout.encodedHeight < static_cast<uint32_t>(height))
+            return false;
+
+        // Only the groups covering the output are decoded, padding rows after them are ignored
+        layout.blocksPerGroup = (layout.encodedWidth / ENCODING_BLOCK) * 4;
+        layout.numGroups = (static_cast<size_t>(height) + 3) / 4;
+        
+        const size_t numBlocks = layout.blocksPerGroup * layout.numGroups;
+        
+        // Each stream needs at least a block header per 64 blocks. Checking this first keeps a
+        // corrupt header from making us allocate more than a small multiple of the input.
+        if(numBlocks / ENCODING_BLOCK * HEADER_LENGTH * 2 > len)
+            return false;
+
+        if(!DecodeMetadata(input, bitsOffset, len, numBlocks, layout.bits))
+            return false;
+        
+        if(!DecodeMetadata(input, refsOffset, len, numBlocks, layout.refs))
+            return false;
+
+        if(!checkBlocks)
+            return std::all_of(layout.bits.begin(), layout.bits.end(), [](uint16_t bits) { return bits <= 16; });
+        
+        size_t end = METADATA_OFFSET;
+        
+        for(size_t i = 0; i < numBlocks; i++) {
+            if(layout.bits[i] > 16)
+                return false;
+            
+            end += ENCODING_BLOCK_LENGTH[layout.bits[i]];
+        }
+        
+        return end <= len;
+    }
 
-        bitsOffset =
-                 static_cast<uint32_t>(input[8])
-            |   (static_cast<uint32_t>(input[9])  << 8)
-            |   (static_cast<uint32_t>(input[10]) << 16)
-            |   (static_cast<uint32_t>(input[11]) << 24);
+    //
+    // Calls fn(b, bits, ref, n) for every block of the output in the order they are stored, with
+    // b the CFA position of the block (see FrameStats) and n the number of its pixels inside the
+    // frame. Blocks made only of padding are left out.
+    //
+
+    template<typename Fn>
+    void ForEachBlock(const FrameLayout& layout, const int width, const int height, Fn&& fn) {
+        const uint16_t* bits = layout.bits.data();
+        const uint16_t* refs = layout.refs.data();
+
+        for(size_t group = 0; group < layout.numGroups; group++) {
+            const int y = static_cast<int>(group * 4);
+
+            for(uint32_t x = 0; x < layout.encodedWidth; x += ENCODING_BLOCK) {
+                for(int b = 0; b < 4; b++) {
+                    // Block b holds columns x + (b & 1) + 2i of rows y + (b >> 1) and two below,
+                    // the ones past the edges of the frame are padding
+                    const int column = static_cast<int>(x) + (b & 1);
+                    const int row = y + (b >> 1);
+
+                    const int columns = std::clamp((width - column + 1) / 2, 0, ENCODING_BLOCK / 2);
+                    const int rows = (row < height ? 1 : 0) + (row + 2 < height ? 1 : 0);
+                    const uint64_t n = static_cast<uint64_t>(columns) * rows;
+
+                    if(n > 0)
+                        fn(b, bits[b], refs[b], n);
+                }
 
-        refsOffset =
-                 static_cast<uint32_t>(input[12])
-            |   (static_cast<uint32_t>(input[13]) << 8)
-            |   (static_cast<uint32_t>(input[14]) << 16)
-            |   (static_cast<uint32_t>(input[15]) << 24);
+                bits += 4;
+                refs += 4;
+            }
+        }
     }
-    
-    } // unnamed namespace
 
-    size_t Decode(
-        uint16_t* output,
+    // SummarizeBlocks() finds its percentiles on values rounded down to multiples of 16
+    const int LEVEL_SHIFT = 4;
+
+    //
+    // Collects the statistics of rows for a FrameStats. Neighbouring pixels of the same colour
+    // usually land in the same histogram bin, so each colour has HISTOGRAM_COPIES histograms
+    // that the pixels take turns in, and the increments don't wait on each other. They are
+    // added up in flush().
+    //
+
+    const int HISTOGRAM_COPIES = 4;
+    const int BINS = FrameStats::HISTOGRAM_BINS;
+
+    class StatsAccumulator {
+    public:
+        explicit StatsAccumulator(FrameStats& stats) :
+            mStats(stats),
+            mHistograms(4 * HISTOGRAM_COPIES * FrameStats::HISTOGRAM_BINS)
+        {
+        }
+
+        // Adds row y of the frame. Even and odd columns are different colours of the CFA, they
+        // stay apart in the even and odd 16 bit lanes.
+        void addRow(const uint16_t* row, const int width, const int y) {
+            const int first = (y & 1) * 2;
+
+            // Lane i of a vector goes to colour i & 1, copy i >> 1. The bins of all of them are
+            // offsets from the first histogram of the row.
+            uint32_t* histograms = histogram(first, 0);
+
+            const simde__m128i laneOffsets = simde_mm_setr_epi16(
+                0 * BINS, HISTOGRAM_COPIES * BINS + 0 * BINS,
+                1 * BINS, HISTOGRAM_COPIES * BINS + 1 * BINS,
+                2 * BINS, HISTOGRAM_COPIES * BINS + 2 * BINS,
+                3 * BINS, HISTOGRAM_COPIES * BINS + 3 * BINS);
+
+            const simde__m128i mask = simde_mm_set1_epi32(0xFFFF);
+            const simde__m128i clipLevel = simde_mm_set1_epi16(static_cast<int16_t>(mStats.clipLevel));
+            const simde__m128i lastBin = simde_mm_set1_epi16(FrameStats::HISTOGRAM_BINS - 1);
+            const simde__m128i shift = simde_mm_set_epi64x(0, mStats.histogramShift);
+
+            simde__m128i minimum = simde_mm_set1_epi16(-1);
+            simde__m128i maximum = simde_mm_setzero_si128();
+            simde__m128i evenSums = simde_mm_setzero_si128();
+            simde__m128i oddSums = simde_mm_setzero_si128();
+            simde__m128i clipped = simde_mm_setzero_si128();
+
+            int x = 0;
+
+            for(; x + 8 <= width; x += 8) {
+                const simde__m128i v = simde_mm_loadu_si128(reinterpret_cast<const simde__m128i*>(row + x));
+
+                minimum = simde_mm_min_epu16(minimum, v);
+                maximum = simde_mm_max_epu16(maximum, v);
+
+                evenSums = simde_mm_add_epi32(evenSums, simde_mm_and_si128(v, mask));
+                oddSums = simde_mm_add_epi32(oddSums, simde_mm_srli_epi32(v, 16));
+
+                // v >= clipLevel is all ones, which counts as -1
+                clipped = simde_mm_sub_epi16(clipped, simde_mm_cmpeq_epi16(simde_mm_max_epu16(v, clipLevel), v));
+
+                const simde__m128i binned = simde_mm_add_epi16(simde_mm_min_epu16(simde_mm_srl_epi16(v, shift), lastBin), laneOffsets);
+
+                // Indices come out of the vector in two 64 bit halves rather than through memory
+                const uint64_t low = static_cast<uint64_t>(simde_mm_cvtsi128_si64(binned));
+                const uint64_t high = static_cast<uint64_t>(simde_mm_cvtsi128_si64(simde_mm_unpackhi_epi64(binned, binned)));
+
+                histograms[low & 0xFFFF]++;
+                histograms[(low >> 16) & 0xFFFF]++;
+                histograms[(low >> 32) & 0xFFFF]++;
+                histograms[low >> 48]++;
+                histograms[high & 0xFFFF]++;
+                histograms[(high >> 16) & 0xFFFF]++;
+                histograms[(high >> 32) & 0xFFFF]++;
+                histograms[high >> 48]++;
+            }
+
+            alignas(16) uint16_t minimums[8];
+            alignas(16) uint16_t maximums[8];
+            alignas(16) uint16_t clips[8];
+            alignas(16) uint32_t evens[4];
+            alignas(16) uint32_t odds[4];
+
+            simde_mm_store_si128(reinterpret_cast<simde__m128i*>(minimums), minimum);
+            simde_mm_store_si128(reinterpret_cast<simde__m128i*>(maximums), maximum);
+            simde_mm_store_si128(reinterpret_cast<simde__m128i*>(clips), clipped);
+            simde_mm_store_si128(reinterpret_cast<simde__m128i*>(evens), evenSums);
+            simde_mm_store_si128(reinterpret_cast<simde__m128i*>(odds), oddSums);
+
+            for(int i = 0; i < 8; i++) {
+                const int p = first + (i & 1);
+
+                mStats.min[p] = std::min(mStats.min[p], minimums[i]);
+                mStats.max[p] = std::max(mStats.max[p], maximums[i]);
+                mStats.clipped[p] += clips[i];
+            }
+
+            for(int i = 0; i < 4; i++) {
+                mStats.sum[first] += evens[i];
+                mStats.sum[first + 1] += odds[i];
+            }
+
+            // x is a multiple of 8 here, so the colour of the remaining columns is still x & 1
+            for(; x < width; x++) {
+                const int p = first + (x & 1);
+                const uint16_t value = row[x];
+
+                mStats.min[p] = std::min(mStats.min[p], value);
+                mStats.max[p] = std::max(mStats.max[p], value);
+                mStats.sum[p] += value;
+                mStats.clipped[p] += value >= mStats.clipLevel ? 1 : 0;
+
+                histograms[(x & 1) * HISTOGRAM_COPIES * BINS + std::min(value >> mStats.histogramShift, BINS - 1)]++;
+            }
+
+            mStats.count[first] += static_cast<uint64_t>(width + 1) / 2;
+            mStats.count[first + 1] += static_cast<uint64_t>(width) / 2;
+        }
+
+        void flush() {
+            for(int p = 0; p < 4; p++) {
+                for(int copy = 0; copy < HISTOGRAM_COPIES; copy++) {
+                    uint32_t* bins = histogram(p, copy);
+
+                    for(int i = 0; i < FrameStats::HISTOGRAM_BINS; i++)
+                        mStats.histogram[p][i] += bins[i];
+
+                    std::fill(bins, bins + FrameStats::HISTOGRAM_BINS, 0);
+                }
+            }
+        }
+
+    private:
+        uint32_t* histogram(int p, int copy) {
+            return mHistograms.data() + (p * HISTOGRAM_COPIES + copy) * FrameStats::HISTOGRAM_BINS;
+        }
+
+    private:
+        FrameStats& mStats;
+        std::vector<uint32_t> mHistograms;
+    };
+
+    //
+    // Stores rows through a Normalization. Eight pixels at a time are widened to float,
+    // normalized, clamped and converted to the output format in registers, so this costs about
+    // the same as copying the row out. Even and odd columns alternate in the lanes, so each row
+    // only needs one vector of black levels and one of scales.
+    //
+
+    class Normalizer {
+    public:
+        explicit Normalizer(const Normalization& normalization) :
+            mFormat(normalization.format),
+            mMax(normalization.format == OutputFormat::UInt16 ? 65535.0f : 1.0f)
+        {
+            for(int p = 0; p < 4; p++) {
+                mBlack[p] = normalization.blackLevel[p];
+                mScale[p] = mMax / std::max(1.0f, normalization.whiteLevel - normalization.blackLevel[p]);
+            }
+        }
+
+        // Writes row y of output from row
+        void store(const uint16_t* row, const int width, const int y, void* output) const {
+            const size_t start = static_cast<size_t>(y) * width;
+
+            switch(mFormat) {
+                case OutputFormat::Half:
+                    storeRow<OutputFormat::Half>(row, width, y, static_cast<uint16_t*>(output) + start);
+                    break;
+
+                case OutputFormat::Float:
+                    storeRow<OutputFormat::Float>(row, width, y, static_cast<float*>(output) + start);
+                    break;
+
+                default:
+                    storeRow<OutputFormat::UInt16>(row, width, y, static_cast<uint16_t*>(output) + start);
+                    break;
+            }
+        }
+
+    private:
+        template<OutputFormat FORMAT, typename T>
+        void storeRow(const uint16_t* row, const int width, const int y, T* out) const {
+            const int p = (y & 1) * 2;
+
+            const simde__m128 black = simde_mm_setr_ps(mBlack[p], mBlack[p + 1], mBlack[p], mBlack[p + 1]);
+            const simde__m128 scale = simde_mm_setr_ps(mScale[p], mScale[p + 1], mScale[p], mScale[p + 1]);
+            const simde__m128 zero = simde_mm_setzero_ps();
+            const simde__m128 max = simde_mm_set1_ps(mMax);
+            const simde__m128i zeroi = simde_mm_setzero_si128();
+
+            int x = 0;
+
+            for(; x + 8 <= width; x += 8) {
+                const simde__m128i v = simde_mm_loadu_si128(reinterpret_cast<const simde__m128i*>(row + x));
+
+                simde__m128 low = simde_mm_cvtepi32_ps(simde_mm_unpacklo_epi16(v, zeroi));
+                simde__m128 high = simde_mm_cvtepi32_ps(simde_mm_unpackhi_epi16(v, zeroi));
+
+                low = simde_mm_min_ps(simde_mm_max_ps(simde_mm_mul_ps(simde_mm_sub_ps(low, black), scale), zero), max);
+                high = simde_mm_min_ps(simde_mm_max_ps(simde_mm_mul_ps(simde_mm_sub_ps(high, black), scale), zero), max);
+
+                if constexpr (FORMAT == OutputFormat::Float) {
+                    simde_mm_storeu_ps(out + x, low);
+                    simde_mm_storeu_ps(out + x + 4, high);
+                }
+                else if constexpr (FORMAT == OutputFormat::Half) {
+                    const simde__m128i halves = simde_mm_unpacklo_epi64(
+                        simde_mm_cvtps_ph(low, SIMDE_MM_FROUND_TO_NEAREST_INT),
+                        simde_mm_cvtps_ph(high, SIMDE_MM_FROUND_TO_NEAREST_INT));
+
+                    simde_mm_storeu_si128(reinterpret_cast<simde__m128i*>(out + x), halves);
+                }
+                else {
+                    // Rounds to nearest, ties to even
+                    const simde__m128i values = simde_mm_packus_epi32(simde_mm_cvtps_epi32(low), simde_mm_cvtps_epi32(high));
+
+                    simde_mm_storeu_si128(reinterpret_cast<simde__m128i*>(out + x), values);
+                }
+            }
+
+            // Same arithmetic one pixel at a time, so the results don't depend on the width
+            for(; x < width; x++) {
+                const float value = std::min(std::max((static_cast<float>(row[x]) - mBlack[p + (x & 1)]) * mScale[p + (x & 1)], 0.0f), mMax);
+
+                if constexpr (FORMAT == OutputFormat::Float)
+                    out[x] = value;
+                else if constexpr (FORMAT == OutputFormat::Half)
+                    out[x] = simde_float16_as_uint16(simde_float16_from_float32(value));
+                else
+                    out[x] = static_cast<uint16_t>(std::nearbyint(value));
+            }
+        }
+
+    private:
+        const OutputFormat mFormat;
+        const float mMax;
+        float mBlack[4];
+        float mScale[4];
+    };
+
+    //
+    // Where DecodeGroups() puts each finished row: into stats if given, then into output as is
+    // or through normalizer if given
+    //
+    struct RowOutput {
+        void* output = nullptr;
+        const Normalizer* normalizer = nullptr;
+        StatsAccumulator* stats = nullptr;
+    };
+
+    //
+    // Decodes 4 row groups [firstGroup, lastGroup). offset is the position of the first block
+    // of firstGroup in the input.
+    //
+    
+    void DecodeGroups(
+        const RowOutput& out,
         const int width,
         const int height,
+        const FrameLayout& layout,
         const uint8_t* input,
-        const size_t len)
+        size_t offset,
+        const size_t firstGroup,
+        const size_t lastGroup)
     {
-        uint16_t* outputStart = output;
-        
         uint16_t p0[ENCODING_BLOCK];
         uint16_t p1[ENCODING_BLOCK];
         uint16_t p2[ENCODING_BLOCK];
         uint16_t p3[ENCODING_BLOCK];
 
-        std::vector<uint16_t> bits, refs;
-        uint32_t encodedWidth, encodedHeight, bitsOffset, refsOffset;
-
-        ReadMetadataHeader(input, encodedWidth, encodedHeight, bitsOffset, refsOffset);
+        std::vector<uint16_t> row0(layout.encodedWidth);
+        std::vector<uint16_t> row1(layout.encodedWidth);
+        std::vector<uint16_t> row2(layout.encodedWidth);
+        std::vector<uint16_t> row3(layout.encodedWidth);
         
-        if(bitsOffset > len || refsOffset > len)
-            return 0;
-        
-        if(encodedWidth % ENCODING_BLOCK > 0)
-            return 0;
+        const uint16_t* bits = layout.bits.data() + firstGroup * layout.blocksPerGroup;
+        const uint16_t* refs = layout.refs.data() + firstGroup * layout.blocksPerGroup;
+
+        for(size_t group = firstGroup; group < lastGroup; group++) {
+            for(uint32_t x = 0; x < layout.encodedWidth; x += ENCODING_BLOCK) {
+                offset += DecodeBlock(&p0[0], bits[0], input, offset);
+                offset += DecodeBlock(&p1[0], bits[1], input, offset);
+                offset += DecodeBlock(&p2[0], bits[2], input, offset);
+                offset += DecodeBlock(&p3[0], bits[3], input, offset);
+
+                for(int i = 0; i < ENCODING_BLOCK; i+=2) {
+                    row0[x + i]     = p0[i/2] + refs[0];
+                    row0[x + i + 1] = p1[i/2] + refs[1];
+                    
+                    row1[x + i]     = p2[i/2] + refs[2];
+                    row1[x + i + 1] = p3[i/2] + refs[3];
+
+                    row2[x + i]     = p0[ENCODING_BLOCK/2+i/2] + refs[0];
+                    row2[x + i + 1] = p1[ENCODING_BLOCK/2+i/2] + refs[1];
+                    
+                    row3[x + i]     = p2[ENCODING_BLOCK/2+i/2] + refs[2];
+                    row3[x + i + 1] = p3[ENCODING_BLOCK/2+i/2] + refs[3];
+                }
+                
+                bits += 4;
+                refs += 4;
+            }
+
+            // Don't write rows that only exist as padding in the encoded frame
+            const uint16_t* rows[4] = { row0.data(), row1.data(), row2.data(), row3.data() };
+            const int y = static_cast<int>(group * 4);
             
-        if(encodedWidth < width)
-            return 0;
+            for(int i = 0; i < 4 && y + i < height; i++) {
+                if(out.stats)
+                    out.stats->addRow(rows[i], width, y + i);
+
+                if(out.normalizer)
+                    out.normalizer->store(rows[i], width, y + i, out.output);
+                else
+                    std::memcpy(static_cast<uint16_t*>(out.output) + static_cast<size_t>(y + i) * width, rows[i], width * 2);
+            }
+        }
+    }
 
-        // Decode bits
-        DecodeMetadata(input, bitsOffset, len, bits);
-        
-        // Decode refs
-        DecodeMetadata(input, refsOffset, len, refs);
+    // Sums each pair of neighbouring values of a and b into 32 bits
+    INLINE
+    simde__m128i SumPairs(const simde__m128i a, const simde__m128i b) {
+        const simde__m128i mask = simde_mm_set1_epi32(0xFFFF);
+
+        const simde__m128i low = simde_mm_add_epi32(simde_mm_and_si128(a, mask), simde_mm_and_si128(b, mask));
+        const simde__m128i high = simde_mm_add_epi32(simde_mm_srli_epi32(a, 16), simde_mm_srli_epi32(b, 16));
+
+        return simde_mm_add_epi32(low, high);
+    }
+
+    //
+    // Decodes FACTOR/2 row groups per pair of output rows. The four blocks of a 64 column
+    // group each hold one colour of the CFA, 32 pixels from each of two rows of that colour,
+    // so FACTOR neighbouring values from both halves of a block are exactly the same colour
+    // pixels that make up one binned pixel. They are summed straight out of the blocks, the
+    // full resolution rows are never built.
+    //
+
+    template<int FACTOR>
+    void DecodeGroupsBinned(
+        uint16_t* output,
+        const int outWidth,
+        const int outHeight,
+        const FrameLayout& layout,
+        const uint8_t* input)
+    {
+        constexpr int GROUPS_PER_ROW = FACTOR / 2;
+        constexpr int SHIFT = FACTOR == 2 ? 2 : 4;
+        constexpr uint32_t ROUNDING = 1 << (SHIFT - 1);
+
+        uint16_t p[4][ENCODING_BLOCK];
+
+        // Sums of each colour of the CFA, planes of one output row each
+        const size_t planeWidth = layout.encodedWidth / (2 * FACTOR);
+        std::vector<uint32_t> sums(4 * planeWidth);
+
+        const uint16_t* bits = layout.bits.data();
+        const uint16_t* refs = layout.refs.data();
 
         size_t offset = METADATA_OFFSET;
+
+        for(int y = 0; y < outHeight; y += 2) {
+            std::fill(sums.begin(), sums.end(), 0);
+
+            for(int group = 0; group < GROUPS_PER_ROW; group++) {
+                for(uint32_t x = 0; x < layout.encodedWidth; x += ENCODING_BLOCK) {
+                    for(int b = 0; b < 4; b++)
+                        offset += DecodeBlock(&p[b][0], bits[b], input, offset);
+
+                    for(int b = 0; b < 4; b++) {
+                        const auto* top = reinterpret_cast<const simde__m128i*>(&p[b][0]);
+                        const auto* bottom = reinterpret_cast<const simde__m128i*>(&p[b][ENCODING_BLOCK/2]);
+                        auto* out = reinterpret_cast<simde__m128i*>(sums.data() + b * planeWidth + x / (2 * FACTOR));
+
+                        // Adding the reference in 16 bits wraps the same way Decode() does
+                        const simde__m128i ref = simde_mm_set1_epi16(static_cast<int16_t>(refs[b]));
+
+                        for(int v = 0; v < 4; v += FACTOR / 2) {
+                            simde__m128i sum = SumPairs(
+                                simde_mm_add_epi16(simde_mm_loadu_si128(top + v), ref),
+                                simde_mm_add_epi16(simde_mm_loadu_si128(bottom + v), ref));
+
+                            if constexpr (FACTOR == 4) {
+                                const simde__m128i next = SumPairs(
+                                    simde_mm_add_epi16(simde_mm_loadu_si128(top + v + 1), ref),
+                                    simde_mm_add_epi16(simde_mm_loadu_si128(bottom + v + 1), ref));
+
+                                sum = simde_mm_hadd_epi32(sum, next);
+                            }
+
+                            simde__m128i* dst = out + v / (FACTOR / 2);
+                            simde_mm_storeu_si128(dst, simde_mm_add_epi32(simde_mm_loadu_si128(dst), sum));
+                        }
+                    }
+
+                    bits += 4;
+                    refs += 4;
+                }
+            }
+
+            for(int row = 0; row < 2; row++) {
+                const uint32_t* even = sums.data() + (2 * row) * planeWidth;
+                const uint32_t* odd = even + planeWidth;
+
+                for(int x = 0; x < outWidth / 2; x++) {
+                    output[2*x]     = static_cast<uint16_t>((even[x] + ROUNDING) >> SHIFT);
+                    output[2*x + 1] = static_cast<uint16_t>((odd[x] + ROUNDING) >> SHIFT);
+                }
+
+                output += outWidth;
+            }
+        }
+    }
+
+    //
+    // Splits the row groups across numThreads threads (0 uses all cores), the last range runs
+    // on the calling thread
+    //
+
+    void DecodeGroupsParallel(
+        const RowOutput& out,
+        const int width,
+        const int height,
+        const FrameLayout& layout,
+        const uint8_t* input,
+        unsigned int numThreads)
+    {
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
         
-        std::vector<uint16_t> row0(encodedWidth);
-        std::vector<uint16_t> row1(encodedWidth);
-        std::vector<uint16_t> row2(encodedWidth);
-        std::vector<uint16_t> row3(encodedWidth);
+        numThreads = static_cast<unsigned int>(std::min<size_t>(numThreads, layout.numGroups));
         
-        int metadataIdx = 0;
+        // Where each thread starts reading comes from the block sizes in the bits stream
+        const size_t groupsPerThread = (layout.numGroups + numThreads - 1) / numThreads;
 
-        for(int y = 0; y < encodedHeight; y+=4) {
-            for(int x = 0; x < encodedWidth; x += ENCODING_BLOCK) {
-                uint16_t blockBits[4] = { bits[metadataIdx], bits[metadataIdx+1], bits[metadataIdx+2], bits[metadataIdx+3] };
-                uint16_t blockRef[4] = { refs[metadataIdx], refs[metadataIdx+1], refs[metadataIdx+2], refs[metadataIdx+3] };
+        std::vector<std::thread> threads;
+        size_t offset = METADATA_OFFSET;
+        
+        for(size_t firstGroup = 0; firstGroup < layout.numGroups; firstGroup += groupsPerThread) {
+            const size_t lastGroup = std::min(firstGroup + groupsPerThread, layout.numGroups);
+            
+            if(lastGroup == layout.numGroups) {
+                DecodeGroups(out, width, height, layout, input, offset, firstGroup, lastGroup);
+                break;
+            }
+            
+            threads.emplace_back(DecodeGroups, std::cref(out), width, height, std::cref(layout), input, offset, firstGroup, lastGroup);
             
-                offset += DecodeBlock(&p0[0], blockBits[0], input, offset, len);
-                offset += DecodeBlock(&p1[0], blockBits[1], input, offset, len);
-                offset += DecodeBlock(&p2[0], blockBits[2], input, offset, len);
-                offset += DecodeBlock(&p3[0], blockBits[3], input, offset, len);
+            const uint16_t* bits = layout.bits.data() + firstGroup * layout.blocksPerGroup;
+            const uint16_t* end = layout.bits.data() + lastGroup * layout.blocksPerGroup;
+            
+            for(; bits < end; ++bits)
+                offset += ENCODING_BLOCK_LENGTH[*bits];
+        }
+        
+        for(auto& thread : threads)
+            thread.join();
+    }
 
-                for(int i = 0; i < ENCODING_BLOCK; i+=2) {
-                    row0[x + i]     = p0[i/2] + blockRef[0];
-                    row0[x + i + 1] = p1[i/2] + blockRef[1];
-                    
-                    row1[x + i]     = p2[i/2] + blockRef[2];
-                    row1[x + i + 1] = p3[i/2] + blockRef[3];
+    } // unnamed namespace
 
-                    row2[x + i]     = p0[ENCODING_BLOCK/2+i/2] + blockRef[0];
-                    row2[x + i + 1] = p1[ENCODING_BLOCK/2+i/2] + blockRef[1];
-                    
-                    row3[x + i]     = p2[ENCODING_BLOCK/2+i/2] + blockRef[2];
-                    row3[x + i + 1] = p3[ENCODING_BLOCK/2+i/2] + blockRef[3];
-                }
-                
-                metadataIdx += 4;
+#if defined(MOTIONCAM_RAW_TARGET)
+    // Built once per instruction set level, RawData_Dispatch.cpp picks one at runtime
+    namespace MOTIONCAM_RAW_TARGET {
+#endif
+
+    size_t Decode(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len))
+            return 0;
+        
+        RowOutput out;
+        out.output = output;
+
+        DecodeGroups(out, width, height, layout, input, METADATA_OFFSET, 0, layout.numGroups);
+        
+        return static_cast<size_t>(width) * height;
+    }
+
+    size_t DecodeWithStats(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        FrameStats& stats)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len))
+            return 0;
+
+        StatsAccumulator accumulator(stats);
+
+        RowOutput out;
+        out.output = output;
+        out.stats = &accumulator;
+
+        DecodeGroups(out, width, height, layout, input, METADATA_OFFSET, 0, layout.numGroups);
+        accumulator.flush();
+
+        return static_cast<size_t>(width) * height;
+    }
+
+    void AccumulateStats(
+        const uint16_t* image,
+        const int width,
+        const int height,
+        FrameStats& stats)
+    {
+        StatsAccumulator accumulator(stats);
+
+        for(int y = 0; y < height; y++)
+            accumulator.addRow(image + static_cast<size_t>(y) * width, width, y);
+
+        accumulator.flush();
+    }
+
+    bool EstimateStats(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        FrameStats& stats)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len, false))
+            return false;
+
+        ForEachBlock(layout, width, height, [&](int b, uint16_t bits, uint16_t ref, uint64_t n) {
+            const uint32_t range = (1u << bits) - 1;
+            const uint16_t estimate = static_cast<uint16_t>(std::min<uint32_t>(ref + range / 2, 0xFFFF));
+            const uint16_t upper = static_cast<uint16_t>(std::min<uint32_t>(ref + range, 0xFFFF));
+
+            stats.min[b] = std::min(stats.min[b], ref);
+            stats.max[b] = std::max(stats.max[b], upper);
+            stats.sum[b] += n * estimate;
+            stats.count[b] += n;
+            stats.clipped[b] += estimate >= stats.clipLevel ? n : 0;
+            stats.histogram[b][std::min(estimate >> stats.histogramShift, FrameStats::HISTOGRAM_BINS - 1)] += static_cast<uint32_t>(n);
+        });
+
+        return true;
+    }
+
+    bool SummarizeBlocks(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        BlockSummary& summary)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len, false))
+            return false;
+
+        // Pixels per level, LEVEL_SHIFT bits coarser than the raw values
+        std::vector<uint64_t> levels((0xFFFF >> LEVEL_SHIFT) + 1, 0);
+
+        uint64_t sum[4] = {};
+        uint64_t count[4] = {};
+        uint64_t bitsSum = 0;
+
+        ForEachBlock(layout, width, height, [&](int b, uint16_t bits, uint16_t ref, uint64_t n) {
+            const uint32_t estimate = std::min<uint32_t>(ref + ((1u << bits) - 1) / 2, 0xFFFF);
+
+            sum[b] += n * estimate;
+            count[b] += n;
+            bitsSum += n * bits;
+            levels[estimate >> LEVEL_SHIFT] += n;
+        });
+
+        const uint64_t total = count[0] + count[1] + count[2] + count[3];
+
+        summary = BlockSummary();
+
+        if(total == 0)
+            return true;
+
+        for(int p = 0; p < 4; p++)
+            summary.mean[p] = count[p] > 0 ? static_cast<float>(static_cast<double>(sum[p]) / static_cast<double>(count[p])) : 0.0f;
+
+        summary.detail = static_cast<float>(static_cast<double>(bitsSum) / static_cast<double>(total));
+
+        // Middle of the level the 1st and 99th percentile pixels fall in
+        auto percentile = [&](uint64_t rank) {
+            uint64_t seen = 0;
+
+            for(size_t level = 0; level < levels.size(); level++) {
+                seen += levels[level];
+
+                if(seen > rank)
+                    return static_cast<uint16_t>((level << LEVEL_SHIFT) + (1 << (LEVEL_SHIFT - 1)));
             }
 
-            std::memcpy(output, row0.data(), width * 2);
-            output += width;
+            return static_cast<uint16_t>(0xFFFF);
+        };
+
+        summary.shadows = percentile(total / 100);
+        summary.highlights = percentile(total - 1 - total / 100);
+
+        return true;
+    }
+
+    size_t DecodeParallel(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        unsigned int numThreads)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len))
+            return 0;
+
+        RowOutput out;
+        out.output = output;
+
+        DecodeGroupsParallel(out, width, height, layout, input, numThreads);
+
+        return static_cast<size_t>(width) * height;
+    }
+
+    size_t DecodeNormalized(
+        void* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        const Normalization& normalization,
+        unsigned int numThreads)
+    {
+        FrameLayout layout;
+
+        if(!ReadLayout(layout, width, height, input, len))
+            return 0;
+
+        const Normalizer normalizer(normalization);
+
+        RowOutput out;
+        out.output = output;
+        out.normalizer = &normalizer;
+
+        DecodeGroupsParallel(out, width, height, layout, input, numThreads);
+
+        return static_cast<size_t>(width) * height;
+    }
+
+    void Normalize(
+        void* output,
+        const uint16_t* input,
+        const int width,
+        const int height,
+        const Normalization& normalization)
+    {
+        const Normalizer normalizer(normalization);
+
+        for(int y = 0; y < height; y++)
+            normalizer.store(input + static_cast<size_t>(y) * width, width, y, output);
+    }
+
+    size_t DecodeBinned(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        const int factor)
+    {
+        const int outWidth = BinnedSize(width, factor);
+        const int outHeight = BinnedSize(height, factor);
+
+        if(outWidth <= 0 || outHeight <= 0)
+            return 0;
+
+        FrameLayout layout;
 
-            std::memcpy(output, row1.data(), width * 2);
-            output += width;
+        if(!ReadLayout(layout, width, height, input, len))
+            return 0;
+
+        if(factor == 2)
+            DecodeGroupsBinned<2>(output, outWidth, outHeight, layout, input);
+        else
+            DecodeGroupsBinned<4>(output, outWidth, outHeight, layout, input);
 
-            std::memcpy(output, row2.data(), width * 2);
-            output += width;
+        return static_cast<size_t>(outWidth) * outHeight;
+    }
+
+    void Bin(
+        uint16_t* output,
+        const uint16_t* input,
+        const int width,
+        const int height,
+        const int factor)
+    {
+        const int outWidth = BinnedSize(width, factor);
+        const int outHeight = BinnedSize(height, factor);
+        const uint32_t samples = static_cast<uint32_t>(factor * factor);
 
-            std::memcpy(output, row3.data(), width * 2);
-            output += width;
+        if(outWidth <= 0 || outHeight <= 0)
+            return;
+
+        std::vector<uint32_t> sums(outWidth);
+
+        for(int y = 0; y < outHeight; y++) {
+            std::fill(sums.begin(), sums.end(), 0);
+
+            // Output row y is made of every other input row, starting from the first one of its colour
+            const int firstRow = (y / 2) * 2 * factor + (y & 1);
+
+            for(int j = 0; j < factor; j++) {
+                const uint16_t* row = input + static_cast<size_t>(firstRow + 2*j) * width;
+
+                for(int x = 0; x < outWidth; x++) {
+                    const uint16_t* p = row + (x / 2) * 2 * factor + (x & 1);
+
+                    for(int i = 0; i < factor; i++)
+                        sums[x] += p[2*i];
+                }
+            }
+
+            for(int x = 0; x < outWidth; x++)
+                output[x] = static_cast<uint16_t>((sums[x] + samples / 2) / samples);
+
+            output += outWidth;
         }
-        
-        return (output - outputStart);
     }
+
+    bool Validate(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len)
+    {
+        FrameLayout layout;
+
+        return ReadLayout(layout, width, height, input, len);
+    }
+
+#if defined(MOTIONCAM_RAW_TARGET)
+    } // namespace MOTIONCAM_RAW_TARGET
+#endif
 }}
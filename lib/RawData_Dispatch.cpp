@@ -0,0 +1,175 @@
+#include <motioncam/RawData.hpp>
+#include "RawData_Targets.hpp"
+
+//
+// raw::Decode() entry points for builds where RawData.cpp is compiled once per x86-64
+// instruction set level (see MCRAWFS_SIMD_MULTIVERSION in CMakeLists.txt).
+//
+
+namespace motioncam {
+    namespace raw {
+    namespace {
+        enum class Target { X86_64, X86_64_V2, X86_64_V3 };
+
+        Target SelectTarget() {
+            __builtin_cpu_init();
+
+            if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("fma"))
+                return Target::X86_64_V3;
+
+            if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+                return Target::X86_64_V2;
+
+            return Target::X86_64;
+        }
+
+        template<typename Func>
+        Func Select(Func x86_64, Func x86_64_v2, Func x86_64_v3) {
+            static const Target target = SelectTarget();
+
+            switch(target) {
+                case Target::X86_64_V3:
+                    return x86_64_v3;
+                case Target::X86_64_V2:
+                    return x86_64_v2;
+                default:
+                    return x86_64;
+            }
+        }
+    }
+
+    size_t Decode(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len)
+    {
+        static const auto decode = Select(x86_64::Decode, x86_64_v2::Decode, x86_64_v3::Decode);
+
+        return decode(output, width, height, input, len);
+    }
+
+    size_t DecodeParallel(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        unsigned int numThreads)
+    {
+        static const auto decode = Select(x86_64::DecodeParallel, x86_64_v2::DecodeParallel, x86_64_v3::DecodeParallel);
+
+        return decode(output, width, height, input, len, numThreads);
+    }
+
+    size_t DecodeNormalized(
+        void* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        const Normalization& normalization,
+        unsigned int numThreads)
+    {
+        static const auto decode = Select(x86_64::DecodeNormalized, x86_64_v2::DecodeNormalized, x86_64_v3::DecodeNormalized);
+
+        return decode(output, width, height, input, len, normalization, numThreads);
+    }
+
+    void Normalize(
+        void* output,
+        const uint16_t* input,
+        const int width,
+        const int height,
+        const Normalization& normalization)
+    {
+        static const auto normalize = Select(x86_64::Normalize, x86_64_v2::Normalize, x86_64_v3::Normalize);
+
+        normalize(output, input, width, height, normalization);
+    }
+
+    size_t DecodeWithStats(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        FrameStats& stats)
+    {
+        static const auto decode = Select(x86_64::DecodeWithStats, x86_64_v2::DecodeWithStats, x86_64_v3::DecodeWithStats);
+
+        return decode(output, width, height, input, len, stats);
+    }
+
+    void AccumulateStats(
+        const uint16_t* image,
+        const int width,
+        const int height,
+        FrameStats& stats)
+    {
+        static const auto accumulate = Select(x86_64::AccumulateStats, x86_64_v2::AccumulateStats, x86_64_v3::AccumulateStats);
+
+        accumulate(image, width, height, stats);
+    }
+
+    bool EstimateStats(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        FrameStats& stats)
+    {
+        static const auto estimate = Select(x86_64::EstimateStats, x86_64_v2::EstimateStats, x86_64_v3::EstimateStats);
+
+        return estimate(width, height, input, len, stats);
+    }
+
+    bool SummarizeBlocks(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        BlockSummary& summary)
+    {
+        static const auto summarize = Select(x86_64::SummarizeBlocks, x86_64_v2::SummarizeBlocks, x86_64_v3::SummarizeBlocks);
+
+        return summarize(width, height, input, len, summary);
+    }
+
+    size_t DecodeBinned(
+        uint16_t* output,
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len,
+        const int factor)
+    {
+        static const auto decode = Select(x86_64::DecodeBinned, x86_64_v2::DecodeBinned, x86_64_v3::DecodeBinned);
+
+        return decode(output, width, height, input, len, factor);
+    }
+
+    void Bin(
+        uint16_t* output,
+        const uint16_t* input,
+        const int width,
+        const int height,
+        const int factor)
+    {
+        static const auto bin = Select(x86_64::Bin, x86_64_v2::Bin, x86_64_v3::Bin);
+
+        bin(output, input, width, height, factor);
+    }
+
+    bool Validate(
+        const int width,
+        const int height,
+        const uint8_t* input,
+        const size_t len)
+    {
+        static const auto validate = Select(x86_64::Validate, x86_64_v2::Validate, x86_64_v3::Validate);
+
+        return validate(width, height, input, len);
+    }
+}}
@@ -0,0 +1,312 @@
+#include <motioncam/RawData.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace motioncam {
+    namespace raw {
+
+    namespace {
+    const int ENCODING_BLOCK = 64;
+    const int HEADER_LENGTH = 2;
+    const int METADATA_OFFSET = 16;
+    const uint16_t MAX_METADATA_REFERENCE = 0x0FFF;
+
+    // Must match the block lengths used by the decoder
+    constexpr int ENCODING_BLOCK_LENGTH[] = {
+        0,
+        8,
+        16,
+        24,
+        32,
+        40,
+        48,
+        64,
+        64,
+        80,
+        80,
+        128,
+        128,
+        128,
+        128,
+        128,
+        128
+    };
+
+    int BitsNeeded(uint16_t value) {
+        int bits = 0;
+
+        while(value > 0) {
+            ++bits;
+            value >>= 1;
+        }
+
+        return bits;
+    }
+
+    void Write32(std::vector<uint8_t>& output, size_t offset, uint32_t value) {
+        output[offset]   = value & 0xFF;
+        output[offset+1] = (value >> 8) & 0xFF;
+        output[offset+2] = (value >> 16) & 0xFF;
+        output[offset+3] = (value >> 24) & 0xFF;
+    }
+
+    //
+    // Each EncodeN() is the exact inverse of the matching DecodeN() in RawData.cpp. The decoder
+    // unpacks 8 bytes at a time into 8 lanes, so value i lives in byte (i % 8) of its 8 byte group.
+    //
+
+    void Encode1(uint8_t* output, const uint16_t* input) {
+        for(int j = 0; j < 8; j++) {
+            uint8_t p = 0;
+
+            for(int k = 0; k < 8; k++)
+                p |= (input[k*8 + j] & 0x01) << k;
+
+            output[j] = p;
+        }
+    }
+
+    void Encode2(uint8_t* output, const uint16_t* input) {
+        for(int h = 0; h < 2; h++) {
+            for(int j = 0; j < 8; j++) {
+                uint8_t p = 0;
+
+                for(int k = 0; k < 4; k++)
+                    p |= (input[h*32 + k*8 + j] & 0x03) << (k*2);
+
+                output[h*8 + j] = p;
+            }
+        }
+    }
+
+    void Encode3(uint8_t* output, const uint16_t* input) {
+        for(int j = 0; j < 8; j++) {
+            const uint16_t* r = input + j;
+
+            output[j]      =  (r[0]  & 0x07) | ((r[8]  & 0x07) << 3) | ((r[16] & 0x03) << 6);
+            output[j + 8]  =  (r[24] & 0x07) | ((r[32] & 0x07) << 3) | ((r[40] & 0x03) << 6);
+            output[j + 16] =  (r[48] & 0x07) | ((r[56] & 0x07) << 3)
+                           | (((r[16] >> 2) & 0x01) << 6)
+                           | (((r[40] >> 2) & 0x01) << 7);
+        }
+    }
+
+    void Encode4(uint8_t* output, const uint16_t* input) {
+        for(int h = 0; h < 4; h++) {
+            for(int j = 0; j < 8; j++)
+                output[h*8 + j] = (input[h*16 + j] & 0x0F) | ((input[h*16 + 8 + j] & 0x0F) << 4);
+        }
+    }
+
+    void Encode5(uint8_t* output, const uint16_t* input) {
+        for(int j = 0; j < 8; j++) {
+            const uint16_t* r = input + j;
+
+            output[j]      = (r[0]  & 0x1F) | ((r[40] & 0x07) << 5);
+            output[j + 8]  = (r[8]  & 0x1F) | ((r[48] & 0x07) << 5);
+            output[j + 16] = (r[16] & 0x1F) | ((r[56] & 0x07) << 5);
+            output[j + 24] = (r[24] & 0x1F) | (((r[40] >> 3) & 0x03) << 5) | (((r[56] >> 3) & 0x01) << 7);
+            output[j + 32] = (r[32] & 0x1F) | (((r[48] >> 3) & 0x03) << 5) | (((r[56] >> 4) & 0x01) << 7);
+        }
+    }
+
+    void Encode6(uint8_t* output, const uint16_t* input) {
+        for(int j = 0; j < 8; j++) {
+            const uint16_t* r = input + j;
+
+            output[j]      = (r[0]  & 0x3F) | ((r[48] & 0x03) << 6);
+            output[j + 8]  = (r[8]  & 0x3F) | (((r[48] >> 2) & 0x03) << 6);
+            output[j + 16] = (r[16] & 0x3F) | (((r[48] >> 4) & 0x03) << 6);
+            output[j + 24] = (r[24] & 0x3F) | ((r[56] & 0x03) << 6);
+            output[j + 32] = (r[32] & 0x3F) | (((r[56] >> 2) & 0x03) << 6);
+            output[j + 40] = (r[40] & 0x3F) | (((r[56] >> 4) & 0x03) << 6);
+        }
+    }
+
+    void Encode8(uint8_t* output, const uint16_t* input) {
+        for(int i = 0; i < ENCODING_BLOCK; i++)
+            output[i] = input[i] & 0xFF;
+    }
+
+    void Encode10(uint8_t* output, const uint16_t* input) {
+        for(int h = 0; h < 2; h++) {
+            const uint16_t* r = input + h*32;
+            uint8_t* p = output + h*40;
+
+            for(int j = 0; j < 8; j++) {
+                p[j]      = r[j]      & 0xFF;
+                p[j + 8]  = r[j + 8]  & 0xFF;
+                p[j + 16] = r[j + 16] & 0xFF;
+                p[j + 24] = r[j + 24] & 0xFF;
+
+                p[j + 32] =
+                       ((r[j]      >> 8) & 0x03)
+                    | (((r[j + 8]  >> 8) & 0x03) << 2)
+                    | (((r[j + 16] >> 8) & 0x03) << 4)
+                    | (((r[j + 24] >> 8) & 0x03) << 6);
+            }
+        }
+    }
+
+    void Encode16(uint8_t* output, const uint16_t* input) {
+        for(int i = 0; i < ENCODING_BLOCK; i++) {
+            output[i*2]     = input[i] & 0xFF;
+            output[i*2 + 1] = (input[i] >> 8) & 0xFF;
+        }
+    }
+
+    void EncodeBlock(std::vector<uint8_t>& output, const uint16_t* input, const int bits) {
+        const size_t offset = output.size();
+
+        output.resize(offset + ENCODING_BLOCK_LENGTH[bits]);
+
+        uint8_t* dst = output.data() + offset;
+
+        switch(bits) {
+            case 0:
+                break;
+            case 1:
+                Encode1(dst, input);
+                break;
+            case 2:
+                Encode2(dst, input);
+                break;
+            case 3:
+                Encode3(dst, input);
+                break;
+            case 4:
+                Encode4(dst, input);
+                break;
+            case 5:
+                Encode5(dst, input);
+                break;
+            case 6:
+                Encode6(dst, input);
+                break;
+            case 7:
+            case 8:
+                Encode8(dst, input);
+                break;
+            case 9:
+            case 10:
+                Encode10(dst, input);
+                break;
+            default:
+                Encode16(dst, input);
+                break;
+        }
+    }
+
+    void EncodeMetadata(std::vector<uint8_t>& output, std::vector<uint16_t> metadata) {
+        const size_t numValues = metadata.size();
+
+        // The decoder always unpacks whole blocks, so pad to avoid it writing past the end
+        const size_t paddedValues = ENCODING_BLOCK * ((numValues + ENCODING_BLOCK - 1) / ENCODING_BLOCK);
+        metadata.resize(paddedValues, numValues > 0 ? metadata[numValues - 1] : 0);
+
+        const size_t offset = output.size();
+        output.resize(offset + 4);
+        Write32(output, offset, static_cast<uint32_t>(paddedValues));
+
+        uint16_t block[ENCODING_BLOCK];
+
+        for(size_t i = 0; i < paddedValues; i += ENCODING_BLOCK) {
+            const auto range = std::minmax_element(metadata.begin() + i, metadata.begin() + i + ENCODING_BLOCK);
+
+            // Header only has 12 bits for the reference
+            const uint16_t reference = std::min(*range.first, MAX_METADATA_REFERENCE);
+
+            // Header only has 4 bits for the bit width, everything above 10 bits is stored as 16 bits
+            const int bits = std::min(BitsNeeded(*range.second - reference), 15);
+
+            for(int x = 0; x < ENCODING_BLOCK; x++)
+                block[x] = metadata[i + x] - reference;
+
+            output.push_back(static_cast<uint8_t>((bits << 4) | ((reference >> 8) & 0x0F)));
+            output.push_back(static_cast<uint8_t>(reference & 0xFF));
+
+            EncodeBlock(output, block, bits);
+        }
+    }
+
+    } // unnamed namespace
+
+    size_t Encode(
+        std::vector<uint8_t>& output,
+        const uint16_t* input,
+        const int width,
+        const int height)
+    {
+        if(width < 2 || height < 2)
+            return 0;
+
+        const int encodedWidth = ENCODING_BLOCK * ((width + ENCODING_BLOCK - 1) / ENCODING_BLOCK);
+        const int encodedHeight = 4 * ((height + 3) / 4);
+
+        // Padding repeats the last row/column of the same colour so the blocks stay narrow
+        auto sample = [&](int x, int y) -> uint16_t {
+            if(x >= width)
+                x = width - 2 + ((x - width) & 1);
+            if(y >= height)
+                y = height - 2 + ((y - height) & 1);
+
+            return input[y * width + x];
+        };
+
+        std::vector<uint16_t> bits, refs;
+
+        bits.reserve((encodedHeight / 4) * (encodedWidth / ENCODING_BLOCK) * 4);
+        refs.reserve(bits.capacity());
+
+        output.clear();
+        output.resize(METADATA_OFFSET);
+
+        uint16_t p[4][ENCODING_BLOCK];
+        uint16_t block[ENCODING_BLOCK];
+
+        for(int y = 0; y < encodedHeight; y += 4) {
+            for(int x = 0; x < encodedWidth; x += ENCODING_BLOCK) {
+                // Each block holds one colour channel of two rows, see raw::Decode()
+                for(int i = 0; i < ENCODING_BLOCK/2; i++) {
+                    p[0][i]                  = sample(x + i*2,     y);
+                    p[1][i]                  = sample(x + i*2 + 1, y);
+                    p[2][i]                  = sample(x + i*2,     y + 1);
+                    p[3][i]                  = sample(x + i*2 + 1, y + 1);
+
+                    p[0][ENCODING_BLOCK/2+i] = sample(x + i*2,     y + 2);
+                    p[1][ENCODING_BLOCK/2+i] = sample(x + i*2 + 1, y + 2);
+                    p[2][ENCODING_BLOCK/2+i] = sample(x + i*2,     y + 3);
+                    p[3][ENCODING_BLOCK/2+i] = sample(x + i*2 + 1, y + 3);
+                }
+
+                for(int c = 0; c < 4; c++) {
+                    const auto range = std::minmax_element(&p[c][0], &p[c][0] + ENCODING_BLOCK);
+                    const uint16_t reference = *range.first;
+                    const int blockBits = BitsNeeded(*range.second - reference);
+
+                    for(int i = 0; i < ENCODING_BLOCK; i++)
+                        block[i] = p[c][i] - reference;
+
+                    EncodeBlock(output, block, blockBits);
+
+                    bits.push_back(blockBits);
+                    refs.push_back(reference);
+                }
+            }
+        }
+
+        const size_t bitsOffset = output.size();
+        EncodeMetadata(output, bits);
+
+        const size_t refsOffset = output.size();
+        EncodeMetadata(output, refs);
+
+        Write32(output, 0,  encodedWidth);
+        Write32(output, 4,  encodedHeight);
+        Write32(output, 8,  static_cast<uint32_t>(bitsOffset));
+        Write32(output, 12, static_cast<uint32_t>(refsOffset));
+
+        return output.size();
+    }
+}}
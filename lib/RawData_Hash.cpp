@@ -0,0 +1,89 @@
+#include <motioncam/RawData.hpp>
+
+#include <cstring>
+
+namespace motioncam {
+    namespace raw {
+    namespace {
+        const uint64_t PRIME_1 = 0x9E3779B185EBCA87ULL;
+        const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+        const uint64_t PRIME_3 = 0x165667B19E3779F9ULL;
+
+        inline uint64_t Rotate(const uint64_t value, const int bits) {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        inline uint64_t Read64(const uint8_t* input) {
+            uint64_t value;
+            std::memcpy(&value, input, sizeof(value));
+
+            return value;
+        }
+
+        inline uint64_t Mix(uint64_t hash, const uint64_t value) {
+            hash += value * PRIME_2;
+            hash = Rotate(hash, 31);
+
+            return hash * PRIME_1;
+        }
+
+        //
+        // Four independent lanes over 32 bytes at a time keep the multipliers busy, so this runs
+        // at several GB/s and costs little next to decoding the same bytes
+        //
+        uint64_t Hash(const uint8_t* input, const size_t len, const uint64_t seed) {
+            uint64_t lanes[4] = { seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1 };
+            size_t i = 0;
+
+            for(; i + 32 <= len; i += 32) {
+                lanes[0] = Mix(lanes[0], Read64(input + i));
+                lanes[1] = Mix(lanes[1], Read64(input + i + 8));
+                lanes[2] = Mix(lanes[2], Read64(input + i + 16));
+                lanes[3] = Mix(lanes[3], Read64(input + i + 24));
+            }
+
+            uint64_t hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+
+            for(; i + 8 <= len; i += 8)
+                hash = Mix(hash, Read64(input + i));
+
+            for(; i < len; i++)
+                hash = Mix(hash, input[i]);
+
+            hash ^= static_cast<uint64_t>(len) * PRIME_3;
+
+            // Final avalanche, so every input bit reaches every output bit
+            hash ^= hash >> 33;
+            hash *= PRIME_2;
+            hash ^= hash >> 29;
+            hash *= PRIME_3;
+            hash ^= hash >> 32;
+
+            // 0 stands for no hash
+            return hash == 0 ? 1 : hash;
+        }
+    }
+
+    uint64_t HashFrame(const uint8_t* input, const size_t len) {
+        return Hash(input, len, 0);
+    }
+
+    uint64_t Fingerprint(const uint8_t* input, const size_t len) {
+        if(len < FRAME_HEADER_SIZE)
+            return 0;
+
+        const size_t start = BlockHeadersOffset(input);
+
+        if(start < FRAME_HEADER_SIZE || start > len)
+            return 0;
+
+        // The offsets of the streams move when the pixels are stripped, the gap between them doesn't
+        uint8_t header[12];
+
+        std::memcpy(header, input, 8);
+        detail::WriteHeader32(header, 8, detail::ReadHeader32(input, 12) - detail::ReadHeader32(input, 8));
+
+        return Hash(input + start, len - start, Hash(header, sizeof(header), 0));
+    }
+    }
+} // namespace motioncam
@@ -1,4 +1,6 @@
 #include <motioncam/RawData.hpp>
+#include <algorithm>
+#include <cstring>
 #include <vector>
 
 namespace motioncam {
@@ -443,6 +445,9 @@ namespace motioncam {
     } // anonymous namespace
 
     size_t DecodeLegacy(uint16_t* output, const int width, const int height, const uint8_t* input, const size_t len) {
+        if(!input || len == 0 || width <= 0 || height <= 0)
+            return 0;
+
         uint16_t* outputStart = output;
         
         // Account for padding at the end
@@ -455,7 +460,7 @@ namespace motioncam {
         uint8_t marker = input[len - 1];
         size_t decodeOffset = len - 1;
         
-        while(marker == 0xFF) {
+        while(marker == 0xFF && decodeOffset >= 5) {
             uint32_t pos =
                 ((uint32_t) input[decodeOffset-4] << 24) |
                 ((uint32_t) input[decodeOffset-3] << 16) |
@@ -0,0 +1,105 @@
+#ifndef RawData_Targets_hpp
+#define RawData_Targets_hpp
+
+#include <stddef.h>
+#include <cstdint>
+
+#include <motioncam/RawData.hpp>
+
+//
+// Per instruction set copies of the raw::Decode() family, see MCRAWFS_SIMD_MULTIVERSION in
+// CMakeLists.txt. Only RawData_Dispatch.cpp and the decoder fuzzer call these directly.
+//
+
+#define MOTIONCAM_DECLARE_DECODE(target)    \
+    namespace target {                      \
+        size_t Decode(                      \
+            uint16_t* output,               \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len);              \
+                                            \
+        size_t DecodeParallel(              \
+            uint16_t* output,               \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            unsigned int numThreads);       \
+                                            \
+        size_t DecodeNormalized(            \
+            void* output,                   \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            const Normalization& norm,      \
+            unsigned int numThreads);       \
+                                            \
+        void Normalize(                     \
+            void* output,                   \
+            const uint16_t* input,          \
+            const int width,                \
+            const int height,               \
+            const Normalization& norm);     \
+                                            \
+        size_t DecodeWithStats(             \
+            uint16_t* output,               \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            FrameStats& stats);             \
+                                            \
+        void AccumulateStats(               \
+            const uint16_t* image,          \
+            const int width,                \
+            const int height,               \
+            FrameStats& stats);             \
+                                            \
+        bool EstimateStats(                 \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            FrameStats& stats);             \
+                                            \
+        bool SummarizeBlocks(               \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            BlockSummary& summary);         \
+                                            \
+        size_t DecodeBinned(                \
+            uint16_t* output,               \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len,               \
+            const int factor);              \
+                                            \
+        void Bin(                           \
+            uint16_t* output,               \
+            const uint16_t* input,          \
+            const int width,                \
+            const int height,               \
+            const int factor);              \
+                                            \
+        bool Validate(                      \
+            const int width,                \
+            const int height,               \
+            const uint8_t* input,           \
+            const size_t len);              \
+    }
+
+namespace motioncam {
+    namespace raw {
+        MOTIONCAM_DECLARE_DECODE(x86_64)
+        MOTIONCAM_DECLARE_DECODE(x86_64_v2)
+        MOTIONCAM_DECLARE_DECODE(x86_64_v3)
+    }
+}
+
+#endif /* RawData_Targets_hpp */
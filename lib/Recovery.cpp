@@ -0,0 +1,376 @@
+#include "Recovery.hpp"
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Metadata.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+    #include <io.h>
+    #include <windows.h>
+
+    #define FSEEK _fseeki64
+    #define FTELL _ftelli64
+    #define FILENO _fileno
+#elif defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+    #include <unistd.h>
+
+    #define FSEEK fseeko
+    #define FTELL ftello
+    #define FILENO fileno
+#else
+    #error Unknown platform
+#endif
+
+namespace motioncam {
+    namespace {
+        // Frames are several MB so they always need a read of their own, everything between
+        // them (frame metadata, audio) comes out of the read-ahead buffer
+        const size_t READ_AHEAD = 1 << 20;
+
+        // Don't bother splitting files into regions smaller than this
+        const int64_t MIN_REGION_SIZE = 64ll << 20;
+
+        // Frame metadata is a few KB of JSON, anything bigger isn't metadata
+        const uint32_t MAX_METADATA_SIZE = 1 << 20;
+
+        // Positional read that is safe to call from several threads, returns the number of bytes
+        // read which is only less than size at the end of the file
+        size_t ReadAt(FILE* file, void* data, size_t size, int64_t offset) {
+            size_t total = 0;
+
+#if defined(_WIN32)
+            HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(FILENO(file)));
+
+            while(total < size) {
+                OVERLAPPED overlapped{};
+                const uint64_t position = static_cast<uint64_t>(offset) + total;
+
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+
+                DWORD bytesRead = 0;
+                const DWORD toRead = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+
+                if(!ReadFile(handle, static_cast<uint8_t*>(data) + total, toRead, &bytesRead, &overlapped) || bytesRead == 0)
+                    break;
+
+                total += bytesRead;
+            }
+#else
+            const int fd = FILENO(file);
+
+            while(total < size) {
+                const ssize_t result = pread(fd, static_cast<uint8_t*>(data) + total, size - total, static_cast<off_t>(offset + total));
+
+                if(result < 0 && errno == EINTR)
+                    continue;
+
+                if(result <= 0)
+                    break;
+
+                total += static_cast<size_t>(result);
+            }
+#endif
+
+            return total;
+        }
+
+        class Reader {
+        public:
+            Reader(FILE* file, int64_t fileSize) : mFile(file), mFileSize(fileSize), mBufferStart(0), mBufferSize(0) {}
+
+            int64_t fileSize() const { return mFileSize; }
+
+            // Copies size bytes at offset into data, returns false if the file ends first
+            bool read(int64_t offset, void* data, size_t size) {
+                if(offset < 0 || offset > mFileSize || static_cast<int64_t>(size) > mFileSize - offset)
+                    return false;
+
+                if(size > READ_AHEAD)
+                    return ReadAt(mFile, data, size, offset) == size;
+
+                if(offset < mBufferStart || offset + static_cast<int64_t>(size) > mBufferStart + static_cast<int64_t>(mBufferSize)) {
+                    mBuffer.resize(READ_AHEAD);
+
+                    mBufferStart = offset;
+                    mBufferSize = ReadAt(mFile, mBuffer.data(), static_cast<size_t>(std::min<int64_t>(READ_AHEAD, mFileSize - offset)), offset);
+
+                    if(mBufferSize < size)
+                        return false;
+                }
+
+                std::memcpy(data, mBuffer.data() + (offset - mBufferStart), size);
+
+                return true;
+            }
+
+        private:
+            FILE* mFile;
+            const int64_t mFileSize;
+            std::vector<uint8_t> mBuffer;
+            int64_t mBufferStart;
+            size_t mBufferSize;
+        };
+
+        struct Region {
+            // First item of the region, -1 if none was found
+            int64_t start = -1;
+            int64_t limit = 0;
+
+            // Where scanning stopped, complete is false if that was because of a bad or cut off item
+            int64_t end = 0;
+            bool complete = false;
+
+            std::vector<BufferOffset> frames;
+            std::vector<BufferOffset> audio;
+
+            std::exception_ptr error;
+        };
+
+        // Reads the item at offset into region, returns false if it isn't a complete frame or
+        // audio item
+        bool ParseItem(Reader& reader, int64_t offset, Region& region, int64_t& outNext) {
+            Item item{};
+
+            if(!reader.read(offset, &item, sizeof(Item)))
+                return false;
+
+            const int64_t dataEnd = offset + static_cast<int64_t>(sizeof(Item)) + item.size;
+
+            if(dataEnd > reader.fileSize())
+                return false;
+
+            if(item.type == Type::BUFFER) {
+                Item metadataItem{};
+
+                if(!reader.read(dataEnd, &metadataItem, sizeof(Item)))
+                    return false;
+
+                if(metadataItem.type != Type::METADATA || metadataItem.size == 0 || metadataItem.size > MAX_METADATA_SIZE)
+                    return false;
+
+                std::string json(metadataItem.size, '\0');
+
+                if(!reader.read(dataEnd + static_cast<int64_t>(sizeof(Item)), json.data(), json.size()))
+                    return false;
+
+                Timestamp timestamp = -1;
+
+                try {
+                    timestamp = FrameMetadata::parse(json).timestamp;
+                }
+                catch(const MotionCamException&) {
+                    return false;
+                }
+
+                region.frames.push_back({ offset, timestamp });
+                outNext = dataEnd + static_cast<int64_t>(sizeof(Item)) + metadataItem.size;
+
+                return true;
+            }
+            else if(item.type == Type::AUDIO_DATA) {
+                Timestamp timestamp = -1;
+                Item metadataItem{};
+
+                outNext = dataEnd;
+
+                // Older files don't have audio metadata
+                if(reader.read(dataEnd, &metadataItem, sizeof(Item))
+                   && metadataItem.type == Type::AUDIO_DATA_METADATA
+                   && metadataItem.size == sizeof(AudioMetadata))
+                {
+                    AudioMetadata metadata{};
+
+                    if(!reader.read(dataEnd + static_cast<int64_t>(sizeof(Item)), &metadata, sizeof(AudioMetadata)))
+                        return false;
+
+                    timestamp = metadata.timestampNs;
+                    outNext = dataEnd + static_cast<int64_t>(sizeof(Item) + sizeof(AudioMetadata));
+                }
+
+                region.audio.push_back({ offset, timestamp });
+
+                return true;
+            }
+            else if(item.type == Type::METADATA || item.type == Type::AUDIO_DATA_METADATA) {
+                // Not attached to anything we know, skip it
+                outNext = dataEnd;
+
+                return true;
+            }
+
+            // Indexes (MotionCam was cut off while writing them) or garbage
+            return false;
+        }
+
+        void ScanRegion(Reader& reader, int64_t offset, Region& region) {
+            region.start = offset;
+
+            while(offset < region.limit) {
+                int64_t next = offset;
+
+                if(!ParseItem(reader, offset, region, next)) {
+                    region.end = offset;
+                    region.complete = false;
+
+                    return;
+                }
+
+                offset = next;
+            }
+
+            region.end = offset;
+            region.complete = true;
+        }
+
+        // First offset in [offset, limit) that is a frame followed by valid metadata, -1 if none
+        int64_t FindFrame(Reader& reader, FILE* file, int64_t offset, int64_t limit) {
+            std::vector<uint8_t> chunk(READ_AHEAD + sizeof(Type));
+            const auto type = static_cast<uint32_t>(Type::BUFFER);
+
+            Region scratch;
+
+            while(offset < limit) {
+                const size_t size = ReadAt(file, chunk.data(), static_cast<size_t>(std::min<int64_t>(chunk.size(), reader.fileSize() - offset)), offset);
+                if(size < sizeof(Type))
+                    return -1;
+
+                const size_t last = std::min<size_t>(size - sizeof(Type), static_cast<size_t>(std::min<int64_t>(limit - offset, READ_AHEAD)));
+
+                for(size_t i = 0; i < last; i++) {
+                    // memchr for the first byte then compare the rest
+                    const void* candidate = std::memchr(chunk.data() + i, static_cast<uint8_t>(type), last - i);
+                    if(!candidate)
+                        break;
+
+                    i = static_cast<const uint8_t*>(candidate) - chunk.data();
+
+                    uint32_t value = 0;
+                    std::memcpy(&value, chunk.data() + i, sizeof(value));
+
+                    if(value != type)
+                        continue;
+
+                    int64_t next = 0;
+                    scratch.frames.clear();
+
+                    if(ParseItem(reader, offset + static_cast<int64_t>(i), scratch, next))
+                        return offset + static_cast<int64_t>(i);
+                }
+
+                offset += static_cast<int64_t>(std::max<size_t>(last, 1));
+            }
+
+            return -1;
+        }
+
+        void Append(RecoveredIndex& index, const Region& region) {
+            index.frames.insert(index.frames.end(), region.frames.begin(), region.frames.end());
+            index.audio.insert(index.audio.end(), region.audio.begin(), region.audio.end());
+        }
+    }
+
+    RecoveredIndex RecoverIndex(FILE* file, int64_t start, unsigned int numThreads) {
+        if(FSEEK(file, 0, SEEK_END) != 0)
+            throw IOException("Failed to get file size");
+
+        const int64_t fileSize = FTELL(file);
+
+        if(numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        const int64_t length = std::max<int64_t>(0, fileSize - start);
+        const size_t numRegions = static_cast<size_t>(std::clamp<int64_t>(length / MIN_REGION_SIZE, 1, numThreads));
+
+        std::vector<Region> regions(numRegions);
+
+        for(size_t i = 0; i < numRegions; i++)
+            regions[i].limit = i + 1 == numRegions ? fileSize : start + length * static_cast<int64_t>(i + 1) / static_cast<int64_t>(numRegions);
+
+        auto scan = [&](size_t i) {
+            Region& region = regions[i];
+
+            try {
+                Reader reader(file, fileSize);
+
+                // The first region starts on an item, the others have to find one
+                const int64_t regionStart = i == 0 ? start : FindFrame(reader, file, regions[i - 1].limit, region.limit);
+
+                if(regionStart >= 0)
+                    ScanRegion(reader, regionStart, region);
+            }
+            catch(...) {
+                region.error = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+
+        for(size_t i = 1; i < numRegions; i++)
+            threads.emplace_back(scan, i);
+
+        scan(0);
+
+        for(auto& thread : threads)
+            thread.join();
+
+        for(const auto& region : regions) {
+            if(region.error)
+                std::rethrow_exception(region.error);
+        }
+
+        // Stitch the regions together. A region is only trusted if it starts where the one before
+        // ended, otherwise it is scanned again from there.
+        RecoveredIndex index;
+        Reader reader(file, fileSize);
+
+        Append(index, regions[0]);
+
+        int64_t end = regions[0].end;
+        bool complete = regions[0].complete;
+
+        for(size_t i = 1; i < numRegions; i++) {
+            Region& region = regions[i];
+
+            if(complete) {
+                if(region.start != end) {
+                    const int64_t limit = region.limit;
+
+                    region = Region();
+                    region.limit = limit;
+
+                    ScanRegion(reader, end, region);
+                }
+            }
+            // The region before ran into damaged data, carry on from the first frame found after it
+            else if(region.start < end) {
+                continue;
+            }
+
+            Append(index, region);
+
+            end = region.end;
+            complete = region.complete;
+        }
+
+        index.end = end;
+
+        // Frames without a timestamp follow the one before them
+        Timestamp previous = -1;
+
+        for(auto& frame : index.frames) {
+            if(frame.timestamp < 0)
+                frame.timestamp = previous + 1;
+
+            previous = frame.timestamp;
+        }
+
+        return index;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef Recovery_hpp
+#define Recovery_hpp
+
+#include <motioncam/Container.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace motioncam {
+    struct RecoveredIndex {
+        // In file order
+        std::vector<BufferOffset> frames;
+        std::vector<BufferOffset> audio;
+
+        // End of the last complete item
+        int64_t end = 0;
+    };
+
+    //
+    // Rebuilds the frame and audio offsets of a container that has no index, usually because the
+    // recording was cut off before MotionCam could write it. Items are walked from start using
+    // their sizes, reading ahead so small items don't cost a read each. Large files are split
+    // into regions scanned in parallel, each region finds its first item by looking for a frame
+    // followed by its metadata and the results are only kept where they line up with the region
+    // before. Scanning stops at the first incomplete item.
+    //
+    // Frame timestamps come from the frame metadata, frames without one are numbered after the
+    // frame before them. numThreads 0 uses all available cores.
+    //
+    RecoveredIndex RecoverIndex(FILE* file, int64_t start, unsigned int numThreads = 0);
+}
+
+#endif /* Recovery_hpp */
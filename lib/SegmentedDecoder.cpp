@@ -0,0 +1,230 @@
+#include <motioncam/SegmentedDecoder.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+namespace motioncam {
+    namespace {
+        const std::string EXTENSION = ".mcraw";
+
+        bool Exists(const std::string& path) {
+            unique_file file(std::fopen(path.c_str(), "rb"));
+            return file != nullptr;
+        }
+
+        // Splits "clip.3.mcraw" into "clip" and 3, returns false if path has no segment number
+        bool ParseSegment(const std::string& path, std::string& outBase, unsigned long& outNumber) {
+            if(path.size() <= EXTENSION.size() || path.compare(path.size() - EXTENSION.size(), EXTENSION.size(), EXTENSION) != 0)
+                return false;
+
+            const size_t end = path.size() - EXTENSION.size();
+            size_t start = end;
+
+            while(start > 0 && std::isdigit(static_cast<unsigned char>(path[start - 1])))
+                --start;
+
+            if(start == end || end - start > 9 || start == 0 || path[start - 1] != '.')
+                return false;
+
+            outBase = path.substr(0, start - 1);
+            outNumber = std::stoul(path.substr(start, end - start));
+
+            return true;
+        }
+
+        std::string SegmentPath(const std::string& base, unsigned long number) {
+            return base + "." + std::to_string(number) + EXTENSION;
+        }
+    }
+
+    SegmentedDecoder::SegmentedDecoder(const std::string& path) {
+        auto index = std::make_shared<Index>();
+
+        index->paths = findSegments(path);
+
+        struct Frame {
+            Timestamp timestamp;
+            uint32_t segment;
+            uint32_t segmentIndex;
+        };
+
+        std::vector<Frame> frames;
+
+        for(size_t i = 0; i < index->paths.size(); i++) {
+            auto decoder = std::make_unique<Decoder>(index->paths[i]);
+
+            if(i == 0)
+                index->containerMetadata = decoder->getContainerMetadata();
+
+            const auto timestamps = decoder->getFrames();
+
+            for(size_t j = 0; j < timestamps.size(); j++)
+                frames.push_back({ timestamps[j], static_cast<uint32_t>(i), static_cast<uint32_t>(j) });
+
+            // Only the first segment stays open, the rest are opened again when they are needed
+            mDecoders.push_back(i == 0 ? std::move(decoder) : nullptr);
+        }
+
+        // Segments follow each other in time, a stable sort keeps the first copy of a timestamp first
+        std::stable_sort(frames.begin(), frames.end(), [](const Frame& a, const Frame& b) {
+            return a.timestamp < b.timestamp;
+        });
+
+        index->frames.reserve(frames.size());
+        index->frameSegments.reserve(frames.size());
+        index->segmentIndices.reserve(frames.size());
+
+        for(const auto& frame : frames) {
+            if(!index->frames.empty() && index->frames.back() == frame.timestamp)
+                continue;
+
+            index->frames.push_back(frame.timestamp);
+            index->frameSegments.push_back(frame.segment);
+            index->segmentIndices.push_back(frame.segmentIndex);
+        }
+
+        mIndex = std::move(index);
+    }
+
+    SegmentedDecoder::SegmentedDecoder(std::shared_ptr<const Index> index) :
+        mIndex(std::move(index)), mDecoders(mIndex->paths.size())
+    {
+    }
+
+    std::vector<std::string> SegmentedDecoder::findSegments(const std::string& path) {
+        std::string base;
+        unsigned long number = 0;
+
+        if(!ParseSegment(path, base, number))
+            return { path };
+
+        // Segments are numbered consecutively, walk out from the one we were given
+        unsigned long first = number;
+        unsigned long last = number;
+
+        while(first > 0 && Exists(SegmentPath(base, first - 1)))
+            --first;
+
+        while(Exists(SegmentPath(base, last + 1)))
+            ++last;
+
+        std::vector<std::string> paths;
+
+        for(unsigned long i = first; i <= last; i++)
+            paths.push_back(i == number ? path : SegmentPath(base, i));
+
+        return paths;
+    }
+
+    std::unique_ptr<SegmentedDecoder> SegmentedDecoder::clone() const {
+        return std::unique_ptr<SegmentedDecoder>(new SegmentedDecoder(mIndex));
+    }
+
+    const std::string& SegmentedDecoder::getContainerMetadata() const {
+        return mIndex->containerMetadata;
+    }
+
+    std::span<const Timestamp> SegmentedDecoder::getFrames() const {
+        return mIndex->frames;
+    }
+
+    size_t SegmentedDecoder::numSegments() const {
+        return mIndex->paths.size();
+    }
+
+    bool SegmentedDecoder::findNearestFrame(const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex) const {
+        return FindNearestTimestamp(mIndex->frames, timestamp, tolerance, outIndex);
+    }
+
+    Decoder& SegmentedDecoder::decoderFor(const Timestamp timestamp) {
+        const auto& frames = mIndex->frames;
+        const auto it = std::lower_bound(frames.begin(), frames.end(), timestamp);
+
+        if(it == frames.end() || *it != timestamp)
+            throw IOException("Frame not found (timestamp: " + std::to_string(timestamp) + ")");
+
+        return segment(mIndex->frameSegments[it - frames.begin()]);
+    }
+
+    Decoder& SegmentedDecoder::decoderFor(const size_t index, size_t& outSegmentIndex) {
+        if(index >= mIndex->frames.size())
+            throw IOException("Frame not found (index: " + std::to_string(index) + ")");
+
+        outSegmentIndex = mIndex->segmentIndices[index];
+
+        return segment(mIndex->frameSegments[index]);
+    }
+
+    void SegmentedDecoder::loadFrame(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType) {
+        decoderFor(timestamp).loadFrame(timestamp, outData, width, height, compressionType);
+    }
+
+    void SegmentedDecoder::loadFrameAt(const size_t index, uint16_t* outData, int width, int height, int compressionType) {
+        size_t segmentIndex = 0;
+        Decoder& decoder = decoderFor(index, segmentIndex);
+
+        decoder.loadFrameAt(segmentIndex, outData, width, height, compressionType);
+    }
+
+    void SegmentedDecoder::loadFrameAt(const size_t index, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads) {
+        size_t segmentIndex = 0;
+        Decoder& decoder = decoderFor(index, segmentIndex);
+
+        decoder.loadFrameAt(segmentIndex, outData, width, height, compressionType, normalization, numThreads);
+    }
+
+    const std::string SegmentedDecoder::loadFrameMetadata(const Timestamp timestamp) {
+        return decoderFor(timestamp).loadFrameMetadata(timestamp);
+    }
+
+    const std::string SegmentedDecoder::loadFrameMetadataAt(const size_t index) {
+        size_t segmentIndex = 0;
+        Decoder& decoder = decoderFor(index, segmentIndex);
+
+        return decoder.loadFrameMetadataAt(segmentIndex);
+    }
+
+    void SegmentedDecoder::loadCompressedFrame(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata) {
+        decoderFor(timestamp).loadCompressedFrame(timestamp, outBuffer, outMetadata);
+    }
+
+    void SegmentedDecoder::loadBlockHeaders(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata) {
+        decoderFor(timestamp).loadBlockHeaders(timestamp, outBuffer, outMetadata);
+    }
+
+    void SegmentedDecoder::loadCompressedFrames(std::span<const Timestamp> timestamps, const CompressedFrameCallback& onFrame, unsigned int queueDepth) {
+        size_t start = 0;
+
+        while(start < timestamps.size()) {
+            Decoder& decoder = decoderFor(timestamps[start]);
+
+            // Run of frames in the same segment
+            size_t end = start + 1;
+            while(end < timestamps.size() && &decoderFor(timestamps[end]) == &decoder)
+                end++;
+
+            bool stopped = false;
+
+            decoder.loadCompressedFrames(timestamps.subspan(start, end - start), [&](size_t index, std::vector<uint8_t>& buffer, std::string& metadata) {
+                if(onFrame(start + index, buffer, metadata))
+                    return true;
+
+                stopped = true;
+                return false;
+            }, queueDepth);
+
+            if(stopped)
+                return;
+
+            start = end;
+        }
+    }
+
+    Decoder& SegmentedDecoder::segment(uint32_t index) {
+        if(!mDecoders[index])
+            mDecoders[index] = std::make_unique<Decoder>(mIndex->paths[index]);
+
+        return *mDecoders[index];
+    }
+}
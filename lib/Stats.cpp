@@ -0,0 +1,296 @@
+#include <motioncam/Stats.hpp>
+
+#include <cstdio>
+#include <mutex>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace motioncam {
+    namespace stats {
+        namespace {
+            // Four buckets per power of two, enough for the 64 bit range of nanoseconds
+            const int SUB_BUCKET_BITS = 2;
+            const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+            const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+            const size_t NUM_STAGES = static_cast<size_t>(Stage::Count);
+            const size_t NUM_COUNTERS = static_cast<size_t>(Counter::Count);
+            const size_t NUM_GAUGES = static_cast<size_t>(Gauge::Count);
+
+            struct Histogram {
+                std::atomic<uint64_t> count{0};
+                std::atomic<uint64_t> totalNs{0};
+                std::atomic<uint64_t> maxNs{0};
+                std::atomic<uint64_t> buckets[NUM_BUCKETS] = {};
+            };
+
+            struct GaugeState {
+                std::atomic<int64_t> current{0};
+                std::atomic<int64_t> max{0};
+            };
+
+            Histogram gStages[NUM_STAGES];
+            std::atomic<uint64_t> gCounters[NUM_COUNTERS] = {};
+            GaugeState gGauges[NUM_GAUGES];
+
+            std::mutex gStartLock;
+            std::chrono::steady_clock::time_point gStart = std::chrono::steady_clock::now();
+
+            int MostSignificantBit(uint64_t value) {
+#if defined(_MSC_VER)
+                unsigned long index;
+                _BitScanReverse64(&index, value);
+                return static_cast<int>(index);
+#else
+                return 63 - __builtin_clzll(value);
+#endif
+            }
+
+            int BucketIndex(uint64_t value) {
+                if(value < SUB_BUCKETS)
+                    return static_cast<int>(value);
+
+                const int msb = MostSignificantBit(value);
+                const int sub = static_cast<int>((value >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+
+                return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+            }
+
+            // Middle of the range of values that land in a bucket
+            uint64_t BucketValue(int index) {
+                if(index < SUB_BUCKETS)
+                    return static_cast<uint64_t>(index);
+
+                const int shift = index / SUB_BUCKETS - 1;
+                const uint64_t sub = static_cast<uint64_t>(index % SUB_BUCKETS);
+                const uint64_t lower = (SUB_BUCKETS + sub) << shift;
+
+                return lower + ((uint64_t(1) << shift) >> 1);
+            }
+
+            void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) {
+                uint64_t current = max.load(std::memory_order_relaxed);
+
+                while(value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+                }
+            }
+
+            void UpdateMax(std::atomic<int64_t>& max, int64_t value) {
+                int64_t current = max.load(std::memory_order_relaxed);
+
+                while(value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+                }
+            }
+
+            uint64_t Percentile(const uint64_t* buckets, uint64_t count, double percentile) {
+                if(count == 0)
+                    return 0;
+
+                const uint64_t target = static_cast<uint64_t>(percentile * static_cast<double>(count - 1)) + 1;
+                uint64_t seen = 0;
+
+                for(int i = 0; i < NUM_BUCKETS; i++) {
+                    seen += buckets[i];
+
+                    if(seen >= target)
+                        return BucketValue(i);
+                }
+
+                return BucketValue(NUM_BUCKETS - 1);
+            }
+
+            void AppendMicroseconds(std::string& out, const char* key, uint64_t nanoseconds, bool last = false) {
+                char buffer[64];
+                std::snprintf(buffer, sizeof(buffer), "\"%s\":%.1f%s", key, static_cast<double>(nanoseconds) / 1000.0, last ? "" : ",");
+
+                out += buffer;
+            }
+        }
+
+        namespace detail {
+            std::atomic<bool> gEnabled{false};
+
+            void Record(Stage stage, uint64_t nanoseconds) {
+                Histogram& histogram = gStages[static_cast<size_t>(stage)];
+
+                histogram.count.fetch_add(1, std::memory_order_relaxed);
+                histogram.totalNs.fetch_add(nanoseconds, std::memory_order_relaxed);
+                histogram.buckets[BucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+
+                UpdateMax(histogram.maxNs, nanoseconds);
+            }
+
+            void Add(Counter counter, uint64_t value) {
+                gCounters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+            }
+
+            void AddGauge(Gauge gauge, int64_t delta) {
+                GaugeState& state = gGauges[static_cast<size_t>(gauge)];
+
+                UpdateMax(state.max, state.current.fetch_add(delta, std::memory_order_relaxed) + delta);
+            }
+
+            void SetGauge(Gauge gauge, int64_t value) {
+                GaugeState& state = gGauges[static_cast<size_t>(gauge)];
+
+                state.current.store(value, std::memory_order_relaxed);
+                UpdateMax(state.max, value);
+            }
+        }
+
+        void SetEnabled(bool enabled) {
+            if(enabled && !Enabled())
+                Reset();
+
+            detail::gEnabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        void Reset() {
+            for(auto& histogram : gStages) {
+                histogram.count.store(0, std::memory_order_relaxed);
+                histogram.totalNs.store(0, std::memory_order_relaxed);
+                histogram.maxNs.store(0, std::memory_order_relaxed);
+
+                for(auto& bucket : histogram.buckets)
+                    bucket.store(0, std::memory_order_relaxed);
+            }
+
+            for(auto& counter : gCounters)
+                counter.store(0, std::memory_order_relaxed);
+
+            // Gauges describe the current state, only their maximum starts again
+            for(auto& gauge : gGauges)
+                gauge.max.store(gauge.current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(gStartLock);
+            gStart = std::chrono::steady_clock::now();
+        }
+
+        Snapshot TakeSnapshot() {
+            Snapshot snapshot;
+
+            snapshot.enabled = Enabled();
+
+            {
+                std::lock_guard<std::mutex> lock(gStartLock);
+                snapshot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - gStart).count();
+            }
+
+            for(size_t i = 0; i < NUM_STAGES; i++) {
+                const Histogram& histogram = gStages[i];
+                Latency& latency = snapshot.stages[i];
+
+                // Percentiles come from the buckets so count them rather than trusting count
+                uint64_t buckets[NUM_BUCKETS];
+                uint64_t count = 0;
+
+                for(int j = 0; j < NUM_BUCKETS; j++) {
+                    buckets[j] = histogram.buckets[j].load(std::memory_order_relaxed);
+                    count += buckets[j];
+                }
+
+                latency.count = histogram.count.load(std::memory_order_relaxed);
+                latency.totalNs = histogram.totalNs.load(std::memory_order_relaxed);
+                latency.maxNs = histogram.maxNs.load(std::memory_order_relaxed);
+                latency.p50Ns = Percentile(buckets, count, 0.50);
+                latency.p90Ns = Percentile(buckets, count, 0.90);
+                latency.p99Ns = Percentile(buckets, count, 0.99);
+            }
+
+            for(size_t i = 0; i < NUM_COUNTERS; i++)
+                snapshot.counters[i] = gCounters[i].load(std::memory_order_relaxed);
+
+            for(size_t i = 0; i < NUM_GAUGES; i++) {
+                snapshot.gauges[i].current = gGauges[i].current.load(std::memory_order_relaxed);
+                snapshot.gauges[i].max = gGauges[i].max.load(std::memory_order_relaxed);
+            }
+
+            return snapshot;
+        }
+
+        std::string ToJson(const Snapshot& snapshot) {
+            std::string out;
+            char buffer[128];
+
+            std::snprintf(buffer, sizeof(buffer), "{\n  \"enabled\": %s,\n  \"seconds\": %.3f,\n", snapshot.enabled ? "true" : "false", snapshot.seconds);
+            out += buffer;
+
+            out += "  \"stages\": {\n";
+
+            for(size_t i = 0; i < NUM_STAGES; i++) {
+                const Latency& latency = snapshot.stages[i];
+
+                std::snprintf(buffer, sizeof(buffer), "    \"%s\": {\"count\":%llu,", Name(static_cast<Stage>(i)), static_cast<unsigned long long>(latency.count));
+                out += buffer;
+
+                AppendMicroseconds(out, "total_us", latency.totalNs);
+                AppendMicroseconds(out, "mean_us", latency.count > 0 ? latency.totalNs / latency.count : 0);
+                AppendMicroseconds(out, "p50_us", latency.p50Ns);
+                AppendMicroseconds(out, "p90_us", latency.p90Ns);
+                AppendMicroseconds(out, "p99_us", latency.p99Ns);
+                AppendMicroseconds(out, "max_us", latency.maxNs, true);
+
+                out += i + 1 < NUM_STAGES ? "},\n" : "}\n";
+            }
+
+            out += "  },\n  \"counters\": {\n";
+
+            for(size_t i = 0; i < NUM_COUNTERS; i++) {
+                std::snprintf(buffer, sizeof(buffer), "    \"%s\": %llu%s\n",
+                    Name(static_cast<Counter>(i)), static_cast<unsigned long long>(snapshot.counters[i]), i + 1 < NUM_COUNTERS ? "," : "");
+
+                out += buffer;
+            }
+
+            out += "  },\n  \"gauges\": {\n";
+
+            for(size_t i = 0; i < NUM_GAUGES; i++) {
+                std::snprintf(buffer, sizeof(buffer), "    \"%s\": {\"current\":%lld,\"max\":%lld}%s\n",
+                    Name(static_cast<Gauge>(i)),
+                    static_cast<long long>(snapshot.gauges[i].current),
+                    static_cast<long long>(snapshot.gauges[i].max),
+                    i + 1 < NUM_GAUGES ? "," : "");
+
+                out += buffer;
+            }
+
+            out += "  }\n}\n";
+
+            return out;
+        }
+
+        const char* Name(Stage stage) {
+            switch(stage) {
+                case Stage::Read: return "read";
+                case Stage::Decode: return "decode";
+                case Stage::Render: return "render";
+                case Stage::Copy: return "copy";
+                case Stage::Write: return "write";
+                default: return "unknown";
+            }
+        }
+
+        const char* Name(Counter counter) {
+            switch(counter) {
+                case Counter::CacheHits: return "cache_hits";
+                case Counter::CacheMisses: return "cache_misses";
+                case Counter::CacheEvictions: return "cache_evictions";
+                case Counter::RepeatedFrames: return "repeated_frames";
+                case Counter::BytesRead: return "bytes_read";
+                case Counter::BytesServed: return "bytes_served";
+                default: return "unknown";
+            }
+        }
+
+        const char* Name(Gauge gauge) {
+            switch(gauge) {
+                case Gauge::RendersInFlight: return "renders_in_flight";
+                case Gauge::DecodeQueue: return "decode_queue";
+                case Gauge::WriteQueue: return "write_queue";
+                default: return "unknown";
+            }
+        }
+    }
+}
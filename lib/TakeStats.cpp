@@ -0,0 +1,320 @@
+#include "Color.hpp"
+
+#include <motioncam/TakeStats.hpp>
+#include <motioncam/BoundedQueue.hpp>
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace motioncam {
+    namespace {
+        struct StatsJob {
+            size_t index;
+            std::vector<uint8_t> buffer;
+            std::string metadata;
+        };
+
+        // Names of the four pixels of the CFA quad. Greens are named after the colour next to
+        // them in the same row.
+        std::array<std::string, 4> ChannelNames(const ContainerMetadata& metadata) {
+            const CFA cfa = color::CFAFromArrangement(metadata.sensorArrangement);
+            const char* COLOURS = "rgb";
+
+            std::array<std::string, 4> names;
+
+            for(int p = 0; p < 4; p++) {
+                names[p] = COLOURS[cfa[p]];
+
+                if(cfa[p] == 1)
+                    names[p] += COLOURS[cfa[p ^ 1]];
+            }
+
+            return names;
+        }
+
+        //
+        // Reads every frame of the take on the calling thread, with only the block headers if
+        // headersOnly, and runs work(job, scratch) for each on options.numWorkers threads. The
+        // first exception stops the reads and is rethrown once the workers are done.
+        //
+        template<typename Work>
+        void ForEachFrame(SegmentedDecoder& decoder, const TakeStatsOptions& options, const bool headersOnly, const std::string& name, Work&& work) {
+            const auto frames = decoder.getFrames();
+
+            unsigned int numWorkers = options.numWorkers;
+            if(numWorkers == 0)
+                numWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+            BoundedQueue<StatsJob> queue(options.queueDepth);
+
+            std::mutex errorLock;
+            std::exception_ptr error;
+
+            auto fail = [&](std::exception_ptr e) {
+                {
+                    std::lock_guard<std::mutex> lock(errorLock);
+                    if(!error)
+                        error = e;
+                }
+
+                queue.close();
+            };
+
+            std::vector<std::thread> workers;
+
+            for(unsigned int i = 0; i < numWorkers; i++) {
+                workers.emplace_back([&, i] {
+                    StatsJob job;
+                    std::vector<uint16_t> scratch;
+
+                    trace::SetThreadName(name + " " + std::to_string(i));
+
+                    try {
+                        while(queue.pop(job))
+                            work(job, scratch);
+                    }
+                    catch(...) {
+                        fail(std::current_exception());
+                    }
+                });
+            }
+
+            try {
+                for(size_t i = 0; i < frames.size(); i++) {
+                    StatsJob job{ i, {}, {} };
+
+                    if(headersOnly)
+                        decoder.loadBlockHeaders(frames[i], job.buffer, job.metadata);
+                    else
+                        decoder.loadCompressedFrame(frames[i], job.buffer, job.metadata);
+
+                    if(!queue.push(std::move(job)))
+                        break;
+                }
+            }
+            catch(...) {
+                fail(std::current_exception());
+            }
+
+            queue.close();
+
+            for(auto& worker : workers)
+                worker.join();
+
+            if(error)
+                std::rethrow_exception(error);
+        }
+
+        double Mean(const raw::FrameStats& stats, int p) {
+            return stats.count[p] > 0 ? static_cast<double>(stats.sum[p]) / static_cast<double>(stats.count[p]) : 0.0;
+        }
+
+        double Clipped(const raw::FrameStats& stats, int p) {
+            return stats.count[p] > 0 ? static_cast<double>(stats.clipped[p]) / static_cast<double>(stats.count[p]) : 0.0;
+        }
+    }
+
+    std::vector<FrameStatsEntry> CollectTakeStats(SegmentedDecoder& decoder, const TakeStatsOptions& options) {
+        const ContainerMetadata containerMetadata = ContainerMetadata::parse(decoder.getContainerMetadata());
+        const auto frames = decoder.getFrames();
+
+        const double whiteLevel = containerMetadata.whiteLevel > 0 ? containerMetadata.whiteLevel : 65535.0;
+
+        std::vector<FrameStatsEntry> entries(frames.size());
+
+        for(size_t i = 0; i < frames.size(); i++) {
+            entries[i].timestamp = frames[i];
+            entries[i].stats.clipLevel = static_cast<uint16_t>(std::min(std::round(whiteLevel), 65535.0));
+            entries[i].stats.histogramShift = raw::HistogramShift(whiteLevel);
+        }
+
+        // Estimates only need the block headers, legacy frames come back whole for decoding
+        ForEachFrame(decoder, options, !options.exact, "stats", [&](StatsJob& job, std::vector<uint16_t>& image) {
+            FrameStatsEntry& entry = entries[job.index];
+            trace::ScopedEvent event("frame_stats", entry.timestamp);
+
+            const FrameMetadata metadata = FrameMetadata::parse(job.metadata);
+
+            if(!options.exact && Decoder::estimateStats(job.buffer, metadata.width, metadata.height, metadata.compressionType, entry.stats))
+                return;
+
+            image.resize(static_cast<size_t>(std::max(0, metadata.width)) * std::max(0, metadata.height));
+
+            Decoder::uncompress(job.buffer, image.data(), metadata.width, metadata.height, metadata.compressionType, entry.stats);
+            entry.exact = true;
+        });
+
+        return entries;
+    }
+
+    std::vector<FrameSummaryEntry> SummarizeTake(SegmentedDecoder& decoder, const TakeStatsOptions& options) {
+        const ContainerMetadata containerMetadata = ContainerMetadata::parse(decoder.getContainerMetadata());
+        const auto frames = decoder.getFrames();
+
+        double blackLevel[4] = {};
+
+        for(size_t p = 0; p < 4 && p < containerMetadata.blackLevel.size(); p++)
+            blackLevel[p] = containerMetadata.blackLevel[p];
+
+        const double black = (blackLevel[0] + blackLevel[1] + blackLevel[2] + blackLevel[3]) / 4.0;
+        const double white = containerMetadata.whiteLevel > 0 ? containerMetadata.whiteLevel : 65535.0;
+
+        std::vector<FrameSummaryEntry> entries(frames.size());
+
+        for(size_t i = 0; i < frames.size(); i++)
+            entries[i].timestamp = frames[i];
+
+        ForEachFrame(decoder, options, true, "summary", [&](StatsJob& job, std::vector<uint16_t>&) {
+            FrameSummaryEntry& entry = entries[job.index];
+            trace::ScopedEvent event("frame_summary", entry.timestamp);
+
+            const FrameMetadata metadata = FrameMetadata::parse(job.metadata);
+
+            entry.fingerprint = Decoder::fingerprint(job.buffer, metadata.compressionType);
+
+            if(!Decoder::summarizeBlocks(job.buffer, metadata.width, metadata.height, metadata.compressionType, entry.blocks))
+                return;
+
+            double brightness = 0.0;
+
+            for(int p = 0; p < 4; p++)
+                brightness += std::clamp((entry.blocks.mean[p] - blackLevel[p]) / std::max(1.0, white - blackLevel[p]), 0.0, 1.0) / 4.0;
+
+            const double shadows = std::max(1.0, entry.blocks.shadows - black);
+            const double highlights = std::max(1.0, entry.blocks.highlights - black);
+
+            entry.valid = true;
+            entry.brightness = static_cast<float>(brightness);
+            entry.dynamicRange = static_cast<float>(std::log2(highlights / shadows));
+        });
+
+        return entries;
+    }
+
+    std::string TakeStatsToCsv(const std::vector<FrameStatsEntry>& frames, const ContainerMetadata& metadata) {
+        const auto names = ChannelNames(metadata);
+
+        std::string out = "index,timestamp,exact";
+
+        for(const auto& name : names)
+            out += "," + name + "_min," + name + "_max," + name + "_mean," + name + "_clipped";
+
+        out += "\n";
+
+        char buffer[128];
+
+        for(size_t i = 0; i < frames.size(); i++) {
+            const FrameStatsEntry& frame = frames[i];
+
+            out += std::to_string(i) + "," + std::to_string(frame.timestamp) + "," + (frame.exact ? "1" : "0");
+
+            for(int p = 0; p < 4; p++) {
+                std::snprintf(buffer, sizeof(buffer), ",%u,%u,%.2f,%.6f",
+                    frame.stats.min[p], frame.stats.max[p], Mean(frame.stats, p), Clipped(frame.stats, p));
+
+                out += buffer;
+            }
+
+            out += "\n";
+        }
+
+        return out;
+    }
+
+    std::string TakeStatsToJson(const std::vector<FrameStatsEntry>& frames, const ContainerMetadata& metadata) {
+        const auto names = ChannelNames(metadata);
+
+        std::string out = "{\n  \"frames\": [\n";
+        char buffer[128];
+
+        for(size_t i = 0; i < frames.size(); i++) {
+            const FrameStatsEntry& frame = frames[i];
+
+            // Timestamps are in nanoseconds and don't survive a double, keep them as strings
+            out += "    {\"index\":" + std::to_string(i) + ",\"timestamp\":\"" + std::to_string(frame.timestamp) + "\",\"exact\":" + (frame.exact ? "true" : "false");
+
+            if(i == 0)
+                out += ",\"histogramShift\":" + std::to_string(frame.stats.histogramShift);
+
+            out += ",\"channels\":{";
+
+            for(int p = 0; p < 4; p++) {
+                std::snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"min\":%u,\"max\":%u,\"mean\":%.2f,\"clipped\":%.6f,\"histogram\":[",
+                    p > 0 ? "," : "", names[p].c_str(), frame.stats.min[p], frame.stats.max[p], Mean(frame.stats, p), Clipped(frame.stats, p));
+
+                out += buffer;
+
+                // Empty bins at the top are left out
+                int bins = raw::FrameStats::HISTOGRAM_BINS;
+                while(bins > 0 && frame.stats.histogram[p][bins - 1] == 0)
+                    bins--;
+
+                for(int bin = 0; bin < bins; bin++) {
+                    if(bin > 0)
+                        out += ",";
+
+                    out += std::to_string(frame.stats.histogram[p][bin]);
+                }
+
+                out += "]}";
+            }
+
+            out += i + 1 < frames.size() ? "}},\n" : "}}\n";
+        }
+
+        out += "  ]\n}\n";
+
+        return out;
+    }
+
+    std::vector<size_t> FindRepeatedFrames(const std::vector<FrameSummaryEntry>& frames) {
+        std::unordered_map<uint64_t, size_t> first;
+        std::vector<size_t> repeats(frames.size());
+
+        for(size_t i = 0; i < frames.size(); i++)
+            repeats[i] = first.try_emplace(frames[i].fingerprint, i).first->second;
+
+        return repeats;
+    }
+
+    std::string TakeSummaryToCsv(const std::vector<FrameSummaryEntry>& frames) {
+        const auto repeats = FindRepeatedFrames(frames);
+
+        std::string out = "index,timestamp,brightness,dynamic_range,detail,shadows,highlights,fingerprint,repeat_of\n";
+        char buffer[128];
+
+        for(size_t i = 0; i < frames.size(); i++) {
+            const FrameSummaryEntry& frame = frames[i];
+
+            out += std::to_string(i) + "," + std::to_string(frame.timestamp);
+
+            // Left empty for frames without block headers
+            if(frame.valid) {
+                std::snprintf(buffer, sizeof(buffer), ",%.6f,%.3f,%.3f,%u,%u",
+                    frame.brightness, frame.dynamicRange, frame.blocks.detail, frame.blocks.shadows, frame.blocks.highlights);
+
+                out += buffer;
+            }
+            else {
+                out += ",,,,,";
+            }
+
+            std::snprintf(buffer, sizeof(buffer), ",%016llx,", static_cast<unsigned long long>(frame.fingerprint));
+            out += buffer;
+
+            if(repeats[i] != i)
+                out += std::to_string(repeats[i]);
+
+            out += "\n";
+        }
+
+        return out;
+    }
+} // namespace motioncam
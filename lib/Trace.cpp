@@ -0,0 +1,225 @@
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace motioncam {
+    namespace trace {
+        namespace {
+            // Buffers of threads that have exited are kept for the next dump, up to this many
+            const size_t MAX_EXITED_THREADS = 64;
+
+            struct Event {
+                const char* name;
+                int64_t startNs;
+                int64_t durationNs;
+                int64_t frame;
+            };
+
+            struct ThreadBuffer {
+                // Only contended while a trace is being dumped
+                std::mutex lock;
+
+                uint32_t id = 0;
+                std::string name;
+                bool exited = false;
+
+                std::vector<Event> events;
+                size_t next = 0;
+                size_t count = 0;
+            };
+
+            std::mutex gRegistryLock;
+            std::vector<std::shared_ptr<ThreadBuffer>> gBuffers;
+            uint32_t gNextThreadId = 1;
+
+            std::atomic<int64_t> gEpochNs{0};
+
+            struct ThreadHandle {
+                std::shared_ptr<ThreadBuffer> buffer;
+
+                ~ThreadHandle() {
+                    if(buffer) {
+                        std::lock_guard<std::mutex> lock(buffer->lock);
+                        buffer->exited = true;
+                    }
+                }
+            };
+
+            thread_local ThreadHandle tThread;
+
+            // Drops the buffers of exited threads that have nothing in them, and the oldest ones
+            // if too many threads have come and gone. Expects gRegistryLock to be held.
+            void PruneExited() {
+                size_t exited = 0;
+
+                for(auto it = gBuffers.rbegin(); it != gBuffers.rend(); ++it) {
+                    std::lock_guard<std::mutex> lock((*it)->lock);
+
+                    if((*it)->exited && ((*it)->count == 0 || ++exited > MAX_EXITED_THREADS))
+                        (*it)->id = 0;
+                }
+
+                gBuffers.erase(
+                    std::remove_if(gBuffers.begin(), gBuffers.end(), [](const auto& buffer) { return buffer->id == 0; }),
+                    gBuffers.end());
+            }
+
+            ThreadBuffer& CurrentThread() {
+                if(!tThread.buffer) {
+                    auto buffer = std::make_shared<ThreadBuffer>();
+                    buffer->events.resize(EVENTS_PER_THREAD);
+
+                    std::lock_guard<std::mutex> lock(gRegistryLock);
+
+                    PruneExited();
+
+                    buffer->id = gNextThreadId++;
+                    gBuffers.push_back(buffer);
+
+                    tThread.buffer = std::move(buffer);
+                }
+
+                return *tThread.buffer;
+            }
+
+            void AppendEscaped(std::string& out, const std::string& value) {
+                for(char c : value) {
+                    if(c == '"' || c == '\\')
+                        out += '\\';
+
+                    if(static_cast<unsigned char>(c) >= 0x20)
+                        out += c;
+                }
+            }
+        }
+
+        namespace detail {
+            std::atomic<bool> gEnabled{false};
+            thread_local int64_t gCurrentFrame = -1;
+
+            int64_t Now() {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+            void Record(const char* name, int64_t startNs, int64_t endNs, int64_t frame) {
+                ThreadBuffer& buffer = CurrentThread();
+                std::lock_guard<std::mutex> lock(buffer.lock);
+
+                buffer.events[buffer.next] = { name, startNs, endNs - startNs, frame };
+                buffer.next = (buffer.next + 1) % buffer.events.size();
+                buffer.count = std::min(buffer.count + 1, buffer.events.size());
+            }
+        }
+
+        void SetEnabled(bool enabled) {
+            if(enabled && !Enabled())
+                Reset();
+
+            detail::gEnabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        void Reset() {
+            std::lock_guard<std::mutex> lock(gRegistryLock);
+
+            for(auto& buffer : gBuffers) {
+                std::lock_guard<std::mutex> bufferLock(buffer->lock);
+
+                buffer->next = 0;
+                buffer->count = 0;
+            }
+
+            PruneExited();
+
+            gEpochNs.store(detail::Now(), std::memory_order_relaxed);
+        }
+
+        void SetThreadName(const std::string& name) {
+            if(!Enabled())
+                return;
+
+            ThreadBuffer& buffer = CurrentThread();
+            std::lock_guard<std::mutex> lock(buffer.lock);
+
+            buffer.name = name;
+        }
+
+        std::string ToJson() {
+            struct Thread {
+                uint32_t id;
+                std::string name;
+                std::vector<Event> events;
+            };
+
+            // Copy everything out first so recording threads only wait for a memcpy
+            std::vector<Thread> threads;
+
+            {
+                std::lock_guard<std::mutex> lock(gRegistryLock);
+
+                for(const auto& buffer : gBuffers) {
+                    std::lock_guard<std::mutex> bufferLock(buffer->lock);
+
+                    Thread thread{ buffer->id, buffer->name, {} };
+                    const size_t size = buffer->events.size();
+                    const size_t first = (buffer->next + size - buffer->count) % size;
+
+                    thread.events.reserve(buffer->count);
+
+                    for(size_t i = 0; i < buffer->count; i++)
+                        thread.events.push_back(buffer->events[(first + i) % size]);
+
+                    threads.push_back(std::move(thread));
+                }
+            }
+
+            const int64_t epoch = gEpochNs.load(std::memory_order_relaxed);
+
+            std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+            char buffer[256];
+            bool first = true;
+
+            for(auto& thread : threads) {
+                if(!thread.name.empty()) {
+                    out += first ? "" : ",\n";
+                    out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(thread.id) + ",\"args\":{\"name\":\"";
+                    AppendEscaped(out, thread.name);
+                    out += "\"}}";
+
+                    first = false;
+                }
+
+                // Events are recorded when they end, viewers want them in the order they started
+                std::stable_sort(thread.events.begin(), thread.events.end(), [](const Event& a, const Event& b) {
+                    return a.startNs < b.startNs;
+                });
+
+                for(const auto& event : thread.events) {
+                    const int length = std::snprintf(buffer, sizeof(buffer),
+                        "%s{\"name\":\"%s\",\"cat\":\"mcraw\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                        first ? "" : ",\n",
+                        event.name,
+                        thread.id,
+                        static_cast<double>(event.startNs - epoch) / 1000.0,
+                        static_cast<double>(event.durationNs) / 1000.0);
+
+                    out.append(buffer, static_cast<size_t>(std::min<int>(length, sizeof(buffer) - 1)));
+
+                    // Frame timestamps are in nanoseconds and don't survive a double, keep them as strings
+                    if(event.frame >= 0)
+                        out += ",\"args\":{\"frame\":\"" + std::to_string(event.frame) + "\"}";
+
+                    out += "}";
+                    first = false;
+                }
+            }
+
+            out += "\n]}\n";
+
+            return out;
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include <motioncam/Transcoder.hpp>
+#include <motioncam/BoundedQueue.hpp>
+#include <motioncam/ContainerWriter.hpp>
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/RawData.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace motioncam {
+    namespace {
+        struct TranscodeJob {
+            size_t index;
+            Timestamp timestamp;
+            std::vector<uint8_t> buffer;
+            std::string metadata;
+        };
+
+        void transcodeFrame(TranscodeJob& job, std::vector<uint16_t>& tmp) {
+            const FrameMetadata metadata = FrameMetadata::parse(job.metadata);
+
+            if(metadata.compressionType == MOTIONCAM_COMPRESSION_TYPE)
+                return;
+
+            if(metadata.compressionType != MOTIONCAM_COMPRESSION_TYPE_LEGACY)
+                throw IOException("Invalid compression type (timestamp: " + std::to_string(job.timestamp) + ")");
+
+            if(metadata.width <= 0 || metadata.height <= 0)
+                throw IOException("Invalid frame size (timestamp: " + std::to_string(job.timestamp) + ")");
+
+            tmp.resize(static_cast<size_t>(metadata.width) * metadata.height);
+
+            if(raw::DecodeLegacy(tmp.data(), metadata.width, metadata.height, job.buffer.data(), job.buffer.size()) <= 0)
+                throw IOException("Failed to uncompress legacy frame (timestamp: " + std::to_string(job.timestamp) + ")");
+
+            if(raw::Encode(job.buffer, tmp.data(), metadata.width, metadata.height) <= 0)
+                throw IOException("Failed to compress frame (timestamp: " + std::to_string(job.timestamp) + ")");
+
+            job.metadata = replaceCompressionType(job.metadata, MOTIONCAM_COMPRESSION_TYPE);
+        }
+    }
+
+    void Transcode(const std::string& inputPath, const std::string& outputPath, const TranscodeOptions& options) {
+        Decoder decoder(inputPath);
+        ContainerWriter writer(outputPath, decoder.getContainerMetadata());
+
+        const auto frames = decoder.getFrames();
+
+        unsigned int numWorkers = options.numWorkers;
+        if(numWorkers == 0)
+            numWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+        BoundedQueue<TranscodeJob> readQueue(options.queueDepth);
+        BoundedQueue<TranscodeJob> writeQueue(options.queueDepth);
+
+        std::mutex errorLock;
+        std::exception_ptr error;
+
+        auto fail = [&](std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lock(errorLock);
+                if(!error)
+                    error = e;
+            }
+
+            readQueue.close();
+            writeQueue.close();
+        };
+
+        // Read compressed frames in file order (Decoder is not thread safe so only this thread touches it)
+        std::thread reader([&] {
+            try {
+                for(size_t i = 0; i < frames.size(); i++) {
+                    TranscodeJob job{ i, frames[i], {}, {} };
+
+                    decoder.loadCompressedFrame(job.timestamp, job.buffer, job.metadata);
+
+                    if(!readQueue.push(std::move(job)))
+                        break;
+                }
+            }
+            catch(...) {
+                fail(std::current_exception());
+            }
+
+            readQueue.close();
+        });
+
+        // Decode and re-encode on all workers
+        std::atomic<unsigned int> activeWorkers(numWorkers);
+        std::vector<std::thread> workers;
+
+        for(unsigned int i = 0; i < numWorkers; i++) {
+            workers.emplace_back([&] {
+                std::vector<uint16_t> tmp;
+                TranscodeJob job;
+
+                try {
+                    while(readQueue.pop(job)) {
+                        transcodeFrame(job, tmp);
+
+                        if(!writeQueue.push(std::move(job)))
+                            break;
+                    }
+                }
+                catch(...) {
+                    fail(std::current_exception());
+                }
+
+                if(--activeWorkers == 0)
+                    writeQueue.close();
+            });
+        }
+
+        // Write frames back in their original order
+        size_t nextIndex = 0;
+
+        try {
+            std::map<size_t, TranscodeJob> pending;
+            TranscodeJob job;
+
+            while(writeQueue.pop(job)) {
+                pending.emplace(job.index, std::move(job));
+
+                for(auto it = pending.find(nextIndex); it != pending.end(); it = pending.find(nextIndex)) {
+                    writer.writeFrame(it->second.timestamp, it->second.buffer, it->second.metadata);
+                    pending.erase(it);
+
+                    ++nextIndex;
+
+                    if(options.progress)
+                        options.progress(nextIndex, frames.size());
+                }
+            }
+        }
+        catch(...) {
+            fail(std::current_exception());
+        }
+
+        reader.join();
+        for(auto& worker : workers)
+            worker.join();
+
+        if(error)
+            std::rethrow_exception(error);
+
+        if(nextIndex != frames.size())
+            throw IOException("Failed to transcode all frames");
+
+        // Audio is copied as is
+        std::vector<RawAudioChunk> audioChunks;
+        decoder.loadRawAudio(audioChunks);
+
+        for(const auto& chunk : audioChunks)
+            writer.writeAudio(chunk);
+
+        writer.finish();
+    }
+} // namespace motioncam
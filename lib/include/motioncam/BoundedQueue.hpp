@@ -0,0 +1,82 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BoundedQueue_hpp
+#define BoundedQueue_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace motioncam {
+    // Blocking multi-producer/multi-consumer queue used between pipeline stages.
+    // Closing the queue wakes everyone up, push() then fails and pop() drains what is left.
+    template<typename T>
+    class BoundedQueue {
+    public:
+        BoundedQueue(size_t capacity) : mCapacity(capacity > 0 ? capacity : 1), mClosed(false) {}
+
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            mNotFull.wait(lock, [this] { return mClosed || mItems.size() < mCapacity; });
+            if(mClosed)
+                return false;
+
+            mItems.push_back(std::move(item));
+            mNotEmpty.notify_one();
+
+            return true;
+        }
+
+        bool pop(T& outItem) {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            mNotEmpty.wait(lock, [this] { return mClosed || !mItems.empty(); });
+            if(mItems.empty())
+                return false;
+
+            outItem = std::move(mItems.front());
+            mItems.pop_front();
+            mNotFull.notify_one();
+
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            mClosed = true;
+            mNotEmpty.notify_all();
+            mNotFull.notify_all();
+        }
+
+        size_t size() const {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mItems.size();
+        }
+
+    private:
+        const size_t mCapacity;
+        bool mClosed;
+        std::deque<T> mItems;
+        mutable std::mutex mMutex;
+        std::condition_variable mNotEmpty;
+        std::condition_variable mNotFull;
+    };
+} // namespace motioncam
+
+#endif /* BoundedQueue_hpp */
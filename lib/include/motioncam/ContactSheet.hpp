@@ -0,0 +1,100 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ContactSheet_hpp
+#define ContactSheet_hpp
+
+#include <motioncam/PreviewRenderer.hpp>
+#include <motioncam/SegmentedDecoder.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace motioncam {
+    struct ContactSheetOptions {
+        // Sample every Nth frame, 0 spreads maxFrames thumbnails over the whole take
+        size_t frameStep = 0;
+        size_t maxFrames = 100;
+
+        // Leave out frames with the same fingerprint as one already on the sheet, for timelapses
+        // and static shots where many frames repeat (see Decoder::fingerprint()). Costs a read
+        // of the block headers of each sampled frame.
+        bool skipRepeats = false;
+
+        // Thumbnails per row, 0 puts them all in one row (a filmstrip)
+        size_t columns = 10;
+
+        // Binning of the proxy decode the thumbnails are made from, 2 or 4
+        int binning = 4;
+
+        // Thumbnails are box filtered down from the preview until their long edge fits
+        int thumbnailSize = 256;
+
+        // Pixels between thumbnails and around the edge
+        int spacing = 4;
+
+        int quality = PreviewRenderer::DEFAULT_JPEG_QUALITY;
+
+        // Frames decoded at the same time, 0 uses all cores
+        unsigned int numThreads = 0;
+    };
+
+    //
+    // Tiles thumbnails of a sample of the frames of a take into one image, for triaging footage
+    // without opening every frame. Frames go through the proxy decode (see raw::DecodeBinned())
+    // and the half size demosaic of PreviewRenderer, so the cost of each is bounded by the
+    // binned size rather than the sensor. Frames are decoded in parallel, each thread with its
+    // own clone of the decoder.
+    //
+    // Cells are sized from the first frame, thumbnails of frames with a different size are
+    // centred and cropped to fit.
+    //
+    class ContactSheet {
+    public:
+        ContactSheet(SegmentedDecoder& decoder, const ContactSheetOptions& options = {});
+
+        int width() const { return mWidth; }
+        int height() const { return mHeight; }
+
+        // Indices of the frames on the sheet, in getFrames() of the decoder
+        const std::vector<size_t>& frames() const { return mFrames; }
+
+        // Render the sheet as interleaved RGB into output, which must hold 3 x width() x height() bytes
+        void render(uint8_t* output) const;
+
+        // Render the sheet and encode it as a JPEG into output
+        void renderJpeg(std::vector<uint8_t>& output) const;
+
+    private:
+        void renderCell(SegmentedDecoder& decoder, size_t cell, uint8_t* output) const;
+
+    private:
+        const ContactSheetOptions mOptions;
+        const std::unique_ptr<SegmentedDecoder> mPrototype;
+        const PreviewRenderer mRenderer;
+
+        std::vector<size_t> mFrames;
+        size_t mColumns;
+        int mScale;
+        int mCellWidth;
+        int mCellHeight;
+        int mWidth;
+        int mHeight;
+    };
+} // namespace motioncam
+
+#endif /* ContactSheet_hpp */
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ContainerWriter_hpp
+#define ContainerWriter_hpp
+
+#include <motioncam/Decoder.hpp>
+
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    // Writes a container in the layout Decoder expects:
+    // header, camera metadata, frames/audio, audio index, buffer index.
+    class ContainerWriter {
+    public:
+        ContainerWriter(const std::string& path, const std::string& containerMetadata);
+
+        // Append a compressed frame buffer followed by its metadata.
+        void writeFrame(const Timestamp timestamp, const std::vector<uint8_t>& buffer, const std::string& metadata);
+
+        // Append an audio chunk.
+        void writeAudio(const AudioChunk& chunk);
+
+        // Append an audio chunk as loaded by Decoder::loadRawAudio(), byte for byte.
+        void writeAudio(const RawAudioChunk& chunk);
+
+        // Write the indexes and close the file. Nothing can be written afterwards and
+        // a writer destroyed without calling this leaves a container with no index.
+        void finish();
+
+    private:
+        void writeAudio(const Timestamp timestamp, const void* data, size_t size);
+        void writeItem(Type type, const void* data, size_t size);
+        void write(const void* data, size_t size);
+        int64_t tell() const;
+
+    private:
+        unique_file mFile;
+        std::vector<BufferOffset> mOffsets;
+        std::vector<BufferOffset> mAudioOffsets;
+    };
+} // namespace motioncam
+
+#endif /* ContainerWriter_hpp */
@@ -19,9 +19,13 @@
 
 #include <motioncam/Container.hpp>
 
+#include <functional>
 #include <string>
 #include <vector>
-#include <map>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <stdexcept>
 
 struct FileDeleter {
     void operator()(FILE* file) const {
@@ -32,14 +36,25 @@ struct FileDeleter {
 using unique_file = std::unique_ptr<FILE, FileDeleter>;
 
 namespace motioncam {
+    namespace raw {
+        struct FrameStats;
+        struct BlockSummary;
+        struct Normalization;
+    }
+
     typedef int64_t Timestamp;
     typedef std::vector<uint8_t> FrameOutData;
     typedef std::pair<Timestamp, std::vector<int16_t>> AudioChunk;
+    typedef std::pair<Timestamp, std::vector<uint8_t>> RawAudioChunk;
     typedef std::ostringstream OssStream;
     typedef std::vector<uint8_t> CFA;
     typedef std::vector<uint32_t> ActiveArea;
     typedef unsigned long Count;
 
+    // Receives a frame from Decoder::loadCompressedFrames(), return false to stop reading.
+    // buffer and metadata may be moved from.
+    typedef std::function<bool(size_t index, std::vector<uint8_t>& buffer, std::string& metadata)> CompressedFrameCallback;
+
     class MotionCamException : public std::runtime_error {
     public:
         MotionCamException(const std::string& error) : runtime_error(error) {}
@@ -50,6 +65,10 @@ namespace motioncam {
         IOException(const std::string& error) : MotionCamException(error) {}
     };
 
+    // Position of the timestamp closest to timestamp in a sorted list, false if there is none
+    // within tolerance. Ties go to the earlier timestamp.
+    bool FindNearestTimestamp(std::span<const Timestamp> timestamps, const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex);
+
     class AudioChunkLoader {
         public:
             virtual bool next(AudioChunk& output) = 0;
@@ -63,39 +82,124 @@ namespace motioncam {
 
         // Get container metadata
         const std::string getContainerMetadata() const;
+
+        // True if the container had no index (the recording was cut off) and it was rebuilt by
+        // scanning the file
+        bool isRecovered() const;
         
-        // Get all frame timestamps in container
-        const std::vector<Timestamp> getFrames() const;
+        // Get all frame timestamps in container, in order. Valid for the lifetime of the decoder.
+        std::span<const Timestamp> getFrames() const;
+
+        size_t numFrames() const;
+
+        // Timestamp of the frame at index in getFrames()
+        Timestamp getFrameTimestamp(size_t index) const;
         
+        // Find the frame closest to timestamp, returns false if there is none within tolerance.
+        // Ties go to the earlier frame.
+        bool findNearestFrame(const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex) const;
+
         // Load a single frame and its metadata.
         void loadFrame(const Timestamp timestamp, std::vector<uint8_t>& outData, int width, int height, int compressionType);
+
+        // Load a single frame into outData, which must hold width*height pixels.
+        void loadFrame(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType);
+
+        // Same as above with the frame at index in getFrames()
+        void loadFrameAt(const size_t index, uint16_t* outData, int width, int height, int compressionType);
         
+        // Load a single frame normalized to the range of the sensor as it is decoded, see
+        // raw::DecodeNormalized(). outData must hold width*height pixels of
+        // raw::BytesPerPixel(normalization.format) bytes. numThreads 0 uses all cores.
+        void loadFrameAt(const size_t index, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads = 1);
+
+        // Load a single frame binned by factor (2 or 4) with the CFA pattern kept, see
+        // raw::DecodeBinned(). outData must hold raw::BinnedSize() of width x height pixels.
+        void loadProxy(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType, int factor);
+
+        // Same as above with the frame at index in getFrames()
+        void loadProxyAt(const size_t index, uint16_t* outData, int width, int height, int compressionType, int factor);
+
         // Load a single frame and its metadata.
         const std::string loadFrameMetadata(const Timestamp timestamp);
 
+        // Same as above with the frame at index in getFrames()
+        const std::string loadFrameMetadataAt(const size_t index);
+
+        // Load the still compressed frame buffer and its metadata.
+        void loadCompressedFrame(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata);
+
+        // Load the block headers of a compressed frame and its metadata, without the pixels (see
+        // raw::StripPixels()). The buffer stands in for the whole frame in estimateStats() and
+        // summarizeBlocks() at a fraction of the I/O. Frames without block headers come back whole.
+        void loadBlockHeaders(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata);
+
+        // Load the compressed buffers and metadata of many frames. On Linux the reads are submitted
+        // through io_uring with up to queueDepth frames in flight, elsewhere they are read one by
+        // one. onFrame is called on this thread as reads complete, index refers to timestamps.
+        void loadCompressedFrames(std::span<const Timestamp> timestamps, const CompressedFrameCallback& onFrame, unsigned int queueDepth = 32);
+
+        // Uncompress a buffer returned by loadCompressedFrame() into outData, which must hold width*height pixels.
+        static void uncompress(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType);
+
+        // Same as above normalized like loadFrameAt()
+        static void uncompress(const std::vector<uint8_t>& buffer, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads = 1);
+
+        // Same as above and accumulates the statistics of the frame into stats, see raw::DecodeWithStats()
+        static void uncompress(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType, raw::FrameStats& stats);
+
+        // Approximates the statistics of a frame from its block headers without decoding it, see
+        // raw::EstimateStats(). Returns false if the compression type has no block headers.
+        static bool estimateStats(const std::vector<uint8_t>& buffer, int width, int height, int compressionType, raw::FrameStats& stats);
+
+        // Brightness, spread and detail of a frame from its block headers, see raw::SummarizeBlocks().
+        // Returns false if the compression type has no block headers.
+        static bool summarizeBlocks(const std::vector<uint8_t>& buffer, int width, int height, int compressionType, raw::BlockSummary& summary);
+
+        // Fingerprint of a frame from a buffer returned by loadCompressedFrame() or
+        // loadBlockHeaders(), see raw::Fingerprint(). Frames without block headers come whole
+        // from both and are hashed whole instead, see raw::HashFrame().
+        static uint64_t fingerprint(const std::vector<uint8_t>& buffer, int compressionType);
+
+        // Same as above binned by factor like loadProxy()
+        static void uncompressProxy(const std::vector<uint8_t>& buffer, uint16_t* outData, int width, int height, int compressionType, int factor);
+
         // Load all audio chunks.
         void loadAudio(std::vector<AudioChunk>& outAudioChunks);
         
+        // Load all audio chunks byte for byte as they are stored, for copying them to another
+        // container. An AudioChunk rounds a chunk of an odd number of bytes up to whole samples.
+        void loadRawAudio(std::vector<RawAudioChunk>& outAudioChunks);
+
         // Load audio in chunks
         AudioChunkLoader& loadAudio() const;
 
     private:
         void init();
         void read(void* data, size_t size, size_t items=1) const;
-        void readIndex();
-        void reindexOffsets();
+        bool readIndex();
+        void recoverIndex(int64_t start);
+        void reindexOffsets(std::vector<BufferOffset>& offsets);
         void readExtra();
-        void uncompress(const std::vector<uint8_t>& src, std::vector<uint8_t>& dst);
+        int64_t frameOffset(const Timestamp timestamp) const;
+        int64_t frameOffset(const size_t index) const;
+        void readBuffer(int64_t offset);
+        void readFrame(int64_t offset, uint16_t* outData, int width, int height, int compressionType, int factor = 1);
+        const std::string readFrameMetadata(int64_t offset);
+        int64_t frameEnd(int64_t offset) const;
         
     private:
         unique_file mFile;
-        std::vector<BufferOffset> mOffsets;
         std::vector<BufferOffset> mAudioOffsets;
-        std::map<Timestamp, BufferOffset> mFrameOffsetMap;
-        std::vector<Timestamp> mFrameList;
+        std::vector<int64_t> mItemOffsets;
+
+        // Frame index sorted by timestamp, mFrameOffsets[i] is where mFrameTimestamps[i] starts
+        std::vector<Timestamp> mFrameTimestamps;
+        std::vector<int64_t> mFrameOffsets;
         std::string mMetadata;
         std::vector<uint8_t> mTmpBuffer;
         std::unique_ptr<AudioChunkLoader> mAudioLoader;
+        bool mRecovered;
     };
 } // namespace motioncam
 
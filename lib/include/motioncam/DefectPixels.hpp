@@ -0,0 +1,68 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DefectPixels_hpp
+#define DefectPixels_hpp
+
+#include <motioncam/Metadata.hpp>
+#include <motioncam/SegmentedDecoder.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace motioncam {
+    struct DefectPixelOptions {
+        // Frames decoded, spread evenly over the take
+        size_t numFrames = 8;
+
+        // How far a pixel has to be above or below all four of its nearest neighbours of the
+        // same colour to stand out in a frame, as a fraction of the range from black to white
+        float threshold = 0.125f;
+
+        // Fraction of the decoded frames a pixel has to stand out in
+        float minFraction = 0.75f;
+
+        // Most pixels kept, the ones that stand out in the most frames first
+        size_t maxPixels = 4096;
+
+        // Frames decoded at the same time, 0 uses all cores
+        unsigned int numThreads = 0;
+    };
+
+    struct DefectPixel {
+        int x = 0;
+        int y = 0;
+    };
+
+    //
+    // Finds hot and dead pixels of the sensor of a take: pixels that stand out from their
+    // neighbours at the same place in most of a few frames spread over the take. A feature of the
+    // scene only does that when the camera doesn't move, so static shots need a higher
+    // minFraction or more frames. Only options.numFrames frames are decoded, in parallel, each
+    // thread with its own clone of the decoder. Sorted by row then column.
+    //
+    std::vector<DefectPixel> FindDefectPixels(SegmentedDecoder& decoder, const DefectPixelOptions& options = {});
+
+    // Replaces each defect in a full size CFA image with the mean of its four nearest neighbours
+    // of the same colour
+    void FixDefectPixels(uint16_t* image, int width, int height, const std::vector<DefectPixel>& defects);
+
+    // DNG OpcodeList1 with a FixBadPixelsList of the defects, so raw processors fix them when
+    // they open the file. Marked optional, readers without opcode support still open it.
+    std::vector<uint8_t> FixBadPixelsOpcodes(const std::vector<DefectPixel>& defects, const ContainerMetadata& containerMetadata);
+} // namespace motioncam
+
+#endif /* DefectPixels_hpp */
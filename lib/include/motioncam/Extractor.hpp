@@ -0,0 +1,68 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Extractor_hpp
+#define Extractor_hpp
+
+#include <motioncam/DefectPixels.hpp>
+#include <motioncam/FrameRenderer.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace motioncam {
+    struct ExtractProgress {
+        size_t framesWritten;
+        size_t totalFrames;
+        uint64_t bytesWritten;
+        double seconds;
+    };
+
+    struct ExtractOptions {
+        // Number of decode workers, 0 uses all available cores
+        unsigned int numWorkers = 0;
+
+        // Number of files written at the same time
+        unsigned int numWriters = 4;
+
+        // Maximum number of frames in flight between each pipeline stage
+        size_t queueDepth = 8;
+
+        // Number of frames read from the container at once (see Decoder::loadCompressedFrames())
+        unsigned int readDepth = 8;
+
+        // Long edge of the preview embedded in each DNG, 0 for none
+        int previewSize = FrameRenderer::DEFAULT_PREVIEW_SIZE;
+
+        // List hot and dead pixels in every DNG, see FindDefectPixels()
+        bool defectPixels = false;
+        DefectPixelOptions defectPixelOptions;
+
+        // Bypass the page cache when writing (O_DIRECT on Linux, F_NOCACHE on macOS)
+        bool directIO = true;
+
+        // Called after each frame is written, never from more than one thread at a time
+        std::function<void(const ExtractProgress& progress)> progress;
+    };
+
+    // Writes every frame of a container to outputDir as frame_N.dng, the same files the file
+    // system shows. Reading, decoding and writing run concurrently, frames are written as soon
+    // as they are ready so they can finish out of order.
+    void Extract(const std::string& inputPath, const std::string& outputDir, const ExtractOptions& options = {});
+} // namespace motioncam
+
+#endif /* Extractor_hpp */
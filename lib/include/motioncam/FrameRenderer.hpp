@@ -0,0 +1,117 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FrameRenderer_hpp
+#define FrameRenderer_hpp
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/DefectPixels.hpp>
+#include <motioncam/Metadata.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace motioncam {
+    // Builds the frame_N.dng files of a container. The DNG tags are written first and the frame
+    // is decoded straight into the image data that follows them, so the pixels are never copied.
+    // All methods are const and can be called from any number of threads, each with its own Decoder.
+    //
+    // IFD0 of the DNGs is a small 8 bit sRGB preview binned from the frame, the raw image is its
+    // SubIFD. The preview comes before the raw image data so thumbnailers only read the start
+    // of the file.
+    //
+    // With binning the raw image is binned by that factor (2 or 4) as it is decoded, for proxies
+    // that are much smaller and faster to make than the full frame.
+    //
+    // Defect pixels (see FindDefectPixels()) are listed in the OpcodeList1 of full size DNGs for
+    // raw processors to fix, the pixels themselves are left as they are.
+    class FrameRenderer {
+    public:
+        // Long edge of the preview in pixels
+        static constexpr int DEFAULT_PREVIEW_SIZE = 384;
+
+        FrameRenderer(const ContainerMetadata& containerMetadata);
+
+        // previewSize 0 writes the raw image as IFD0 without a preview
+        FrameRenderer(
+            const ContainerMetadata& containerMetadata,
+            int previewSize,
+            int binning = 1,
+            const std::vector<DefectPixel>& defects = {});
+
+        // Width and height of the raw image in the DNG of a frame
+        FrameMetadata outputMetadata(const FrameMetadata& metadata) const;
+
+        // Size of the DNG of a frame in bytes
+        size_t dngSize(const FrameMetadata& metadata) const;
+
+        // Render a frame into output, which must hold dngSize() bytes and be 2 byte aligned
+        void render(Decoder& decoder, const Timestamp timestamp, const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Same as above with the frame at index in Decoder::getFrames()
+        void renderAt(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Render a frame from a buffer returned by Decoder::loadCompressedFrame(), same requirements as above
+        void render(const std::vector<uint8_t>& compressed, const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Render an already decoded full size frame into output, which must hold dngSize() bytes
+        void render(const uint16_t* image, const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Render a frame that decodes to the same pixels as one already rendered into source (see
+        // raw::HashFrame()), which holds dngSize() of sourceMetadata bytes. The image data is
+        // copied instead of decoded, the tags and preview are those of metadata.
+        void render(const uint8_t* source, const FrameMetadata& sourceMetadata, const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Render a frame, resizing output to dngSize()
+        void render(Decoder& decoder, const Timestamp timestamp, const FrameMetadata& metadata, std::vector<uint8_t>& output) const;
+
+        void renderAt(Decoder& decoder, const size_t index, const FrameMetadata& metadata, std::vector<uint8_t>& output) const;
+
+    private:
+        struct Layout {
+            // Where the preview and the raw image data start in the file
+            size_t previewOffset;
+            size_t imageOffset;
+        };
+
+        // These take outputMetadata() of the frame
+
+        // Everything before the preview, which starts at header.size()
+        Layout writeHeader(const FrameMetadata& metadata, std::vector<uint8_t>& header) const;
+
+        // Writes the header to output, the image data then goes at imageOffset
+        Layout beginRender(const FrameMetadata& metadata, uint8_t* output) const;
+
+        // Bins the image data in output into the preview
+        void writePreview(const FrameMetadata& metadata, const Layout& layout, uint8_t* output) const;
+
+    private:
+        const ContainerMetadata mContainerMetadata;
+        const CFA mCFA;
+        const int mPreviewSize;
+        const int mBinning;
+
+        // White balanced camera RGB to linear sRGB
+        const std::array<float, 9> mPreviewMatrix;
+        const std::vector<uint8_t> mGammaTable;
+
+        // Empty without defects and for binned frames
+        const std::vector<uint8_t> mOpcodeList1;
+    };
+} // namespace motioncam
+
+#endif /* FrameRenderer_hpp */
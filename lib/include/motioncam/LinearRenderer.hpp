@@ -0,0 +1,74 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LinearRenderer_hpp
+#define LinearRenderer_hpp
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/DefectPixels.hpp>
+#include <motioncam/Metadata.hpp>
+#include <motioncam/RawData.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace motioncam {
+    // Builds demosaiced DNGs of frames (PhotometricInterpretation LinearRaw) for tools that want
+    // linear RGB instead of a CFA image. The frame is normalized to 16 bits as it is decoded (see
+    // raw::DecodeNormalized()), so the DNG has a black level of 0 and a white level of 65535, and
+    // then demosaiced with Malvar, He and Cutler's gradient corrected interpolation straight into
+    // the image data after the DNG tags. The colour matrices and asShotNeutral are the same as in
+    // the CFA DNGs of FrameRenderer, the pixels stay in camera RGB. Defect pixels are fixed
+    // before the demosaic spreads them to their neighbours.
+    //
+    // The demosaic works on tiles small enough to stay in L2 with their output, handed out to
+    // the threads one at a time.
+    //
+    // All methods are const and can be called from any number of threads, each with its own Decoder.
+    class LinearRenderer {
+    public:
+        // Pixels of each tile of demosaic(), both even so every tile starts on a CFA quad
+        static constexpr int TILE_WIDTH = 256;
+        static constexpr int TILE_HEIGHT = 32;
+
+        LinearRenderer(const ContainerMetadata& containerMetadata, const std::vector<DefectPixel>& defects = {});
+
+        // Size of the DNG of a frame in bytes
+        size_t dngSize(const FrameMetadata& metadata) const;
+
+        // Render a frame into output, which must hold dngSize() bytes and be 2 byte aligned.
+        // numThreads 0 uses all cores.
+        void render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads = 0) const;
+
+        // Render a frame, resizing output to dngSize()
+        void render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, std::vector<uint8_t>& output, unsigned int numThreads = 0) const;
+
+        // Demosaic a width x height CFA image into interleaved RGB, 3 x width x height values
+        void demosaic(const uint16_t* image, int width, int height, uint16_t* output, unsigned int numThreads = 0) const;
+
+    private:
+        // Returns where the image data starts, at or past the end of header
+        size_t writeHeader(const FrameMetadata& metadata, std::vector<uint8_t>& header) const;
+
+    private:
+        const ContainerMetadata mContainerMetadata;
+        const CFA mCFA;
+        const raw::Normalization mNormalization;
+        const std::vector<DefectPixel> mDefects;
+    };
+} // namespace motioncam
+
+#endif /* LinearRenderer_hpp */
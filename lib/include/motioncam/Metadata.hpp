@@ -0,0 +1,58 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Metadata_hpp
+#define Metadata_hpp
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    constexpr int MOTIONCAM_COMPRESSION_TYPE_LEGACY = 6;
+    constexpr int MOTIONCAM_COMPRESSION_TYPE = 7;
+
+    // Fields of the container metadata JSON we care about
+    struct ContainerMetadata {
+        std::vector<uint16_t> blackLevel;
+        double whiteLevel = 0;
+        std::string sensorArrangement;
+        std::vector<float> colorMatrix1;
+        std::vector<float> colorMatrix2;
+        std::vector<float> forwardMatrix1;
+        std::vector<float> forwardMatrix2;
+
+        static ContainerMetadata parse(const std::string& json);
+    };
+
+    // Fields of the per frame metadata JSON we care about
+    struct FrameMetadata {
+        int width = 0;
+        int height = 0;
+        std::vector<float> asShotNeutral;
+        int compressionType = 0;
+
+        // Capture timestamp in nanoseconds, -1 if the metadata doesn't have one
+        int64_t timestamp = -1;
+
+        static FrameMetadata parse(const std::string& json);
+    };
+
+    // Returns the frame metadata JSON with only the compressionType value replaced
+    std::string replaceCompressionType(const std::string& json, int compressionType);
+}
+
+#endif /* Metadata_hpp */
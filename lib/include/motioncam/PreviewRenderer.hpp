@@ -0,0 +1,82 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PreviewRenderer_hpp
+#define PreviewRenderer_hpp
+
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Metadata.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace motioncam {
+    // Builds 8 bit sRGB previews of frames for scrubbing through a take without a raw
+    // processor. Each 2x2 CFA quad of the decoded frame becomes one pixel (a half size
+    // demosaic), black level subtracted, white balanced with asShotNeutral, converted with the
+    // forward matrix and gamma encoded through a table. The colour stage is vectorised and
+    // split across threads.
+    //
+    // With binning (2 or 4) the frame is binned while it is decoded first, see
+    // raw::DecodeBinned(), so the preview is a quarter or an eighth of the frame size.
+    //
+    // All methods are const and can be called from any number of threads, each with its own Decoder.
+    class PreviewRenderer {
+    public:
+        static constexpr int DEFAULT_JPEG_QUALITY = 85;
+
+        PreviewRenderer(const ContainerMetadata& containerMetadata, int binning = 1);
+
+        // Size of the preview of a frame
+        int width(const FrameMetadata& metadata) const;
+        int height(const FrameMetadata& metadata) const;
+
+        // Render a frame as interleaved RGB into output, which must hold 3 x width() x height()
+        // bytes. numThreads 0 uses all cores.
+        void render(Decoder& decoder, const size_t index, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads = 0) const;
+
+        // Same as above from a frame that is already decoded (and binned)
+        void render(const uint16_t* image, const FrameMetadata& metadata, uint8_t* output, unsigned int numThreads = 0) const;
+
+        // Render a frame and encode it as a JPEG into output
+        void renderJpeg(
+            Decoder& decoder,
+            const size_t index,
+            const FrameMetadata& metadata,
+            std::vector<uint8_t>& output,
+            int quality = DEFAULT_JPEG_QUALITY,
+            unsigned int numThreads = 0) const;
+
+        // False when built without libjpeg, renderJpeg() throws then
+        static bool supportsJpeg();
+
+    private:
+        // Width and height of the decoded frame
+        int imageWidth(const FrameMetadata& metadata) const;
+        int imageHeight(const FrameMetadata& metadata) const;
+
+    private:
+        const ContainerMetadata mContainerMetadata;
+        const CFA mCFA;
+        const int mBinning;
+
+        const std::array<float, 9> mCameraToSrgb;
+        const std::vector<uint8_t> mGammaTable;
+    };
+} // namespace motioncam
+
+#endif /* PreviewRenderer_hpp */
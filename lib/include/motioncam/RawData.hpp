@@ -18,16 +18,260 @@
 #define RawData_hpp
 
 #include <stddef.h>
+#include <algorithm>
 #include <cstdint>
+#include <vector>
 
 namespace motioncam {
     namespace raw {
+        //
+        // Exposure statistics of a frame, kept separately for each of the four pixels of the
+        // 2x2 CFA quad (index (y & 1) * 2 + (x & 1)). clipLevel and histogramShift are set by the
+        // caller before anything is accumulated.
+        //
+        struct FrameStats {
+            static constexpr int HISTOGRAM_BINS = 256;
+
+            // Values at or above this count as clipped
+            uint16_t clipLevel = 0xFFFF;
+
+            // Each bin covers 1 << histogramShift values, the last one also everything above it
+            int histogramShift = 8;
+
+            uint32_t histogram[4][HISTOGRAM_BINS] = {};
+            uint16_t min[4] = { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF };
+            uint16_t max[4] = {};
+            uint64_t sum[4] = {};
+            uint64_t count[4] = {};
+            uint64_t clipped[4] = {};
+        };
+
+        //
+        // Figures of a whole frame read off its block headers, see SummarizeBlocks(). Like
+        // EstimateStats() every pixel is taken to be halfway up the range of its block.
+        //
+        struct BlockSummary {
+            // Mean of each of the four pixels of the CFA quad, indexed like FrameStats
+            float mean[4] = {};
+
+            // Levels 1% and 99% of the pixels are below, over all four, to within 16 values
+            uint16_t shadows = 0;
+            uint16_t highlights = 0;
+
+            // Mean bit width of the blocks. Flat areas pack into few bits and texture, edges and
+            // noise need more, so this follows the amount of detail in the scene.
+            float detail = 0;
+        };
+
+        enum class OutputFormat {
+            UInt16,     // 0 to 65535
+            Half,       // 0 to 1 as IEEE 754 half precision, stored in a uint16_t
+            Float       // 0 to 1
+        };
+
+        inline size_t BytesPerPixel(const OutputFormat format) {
+            return format == OutputFormat::Float ? 4 : 2;
+        }
+
+        //
+        // Black level subtraction and scaling applied to each pixel as it is stored, for
+        // consumers that want data ready to use instead of raw values:
+        //
+        //   out = clamp((in - blackLevel[p]) / (whiteLevel - blackLevel[p]), 0, 1)
+        //
+        // scaled to 65535 for UInt16. p is the position in the CFA quad like FrameStats.
+        //
+        struct Normalization {
+            float blackLevel[4] = {};
+            float whiteLevel = 65535.0f;
+            OutputFormat format = OutputFormat::UInt16;
+        };
+
+        // Normalization to the levels of a container (see ContainerMetadata)
+        inline Normalization NormalizationFor(const std::vector<uint16_t>& blackLevel, const double whiteLevel, const OutputFormat format) {
+            Normalization normalization;
+
+            for(size_t p = 0; p < 4 && p < blackLevel.size(); p++)
+                normalization.blackLevel[p] = blackLevel[p];
+
+            normalization.whiteLevel = whiteLevel > 0 ? static_cast<float>(whiteLevel) : 65535.0f;
+            normalization.format = format;
+
+            return normalization;
+        }
+
+        // Smallest histogramShift whose bins cover [0, whiteLevel]
+        inline int HistogramShift(const double whiteLevel) {
+            int shift = 0;
+
+            while(shift < 16 && (whiteLevel / static_cast<double>(1 << shift)) >= FrameStats::HISTOGRAM_BINS)
+                shift++;
+
+            return shift;
+        }
+
+        // Returns the number of pixels written, or 0 if the frame is corrupt
         size_t Decode(
             uint16_t* output,
             const int width,
             const int height,
             const uint8_t* input,
             const size_t len);
+
+        // Same as Decode() but splits the rows across numThreads threads (0 uses all cores)
+        size_t DecodeParallel(
+            uint16_t* output,
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            unsigned int numThreads = 0);
+
+        // Same as DecodeParallel() with every pixel normalized as it is stored, see Normalization.
+        // output must hold width x height pixels of BytesPerPixel(normalization.format) bytes.
+        // The extra work happens in registers on the way out, so it costs no pass over memory.
+        size_t DecodeNormalized(
+            void* output,
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            const Normalization& normalization,
+            unsigned int numThreads = 1);
+
+        // Normalizes an already decoded frame the same way as DecodeNormalized()
+        void Normalize(
+            void* output,
+            const uint16_t* input,
+            const int width,
+            const int height,
+            const Normalization& normalization);
+
+        // Same as Decode() and accumulates the statistics of the frame into stats while each
+        // row is still in cache, instead of a second pass over the whole frame
+        size_t DecodeWithStats(
+            uint16_t* output,
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            FrameStats& stats);
+
+        // Accumulates the statistics of an already decoded frame, the same as DecodeWithStats()
+        void AccumulateStats(
+            const uint16_t* image,
+            const int width,
+            const int height,
+            FrameStats& stats);
+
+        // Approximates the statistics of a frame from the block headers alone, without decoding
+        // any pixels. Every pixel of a block is taken to be halfway between the reference (the
+        // smallest value in the block) and the largest value its bit width allows, so min and
+        // max are bounds rather than the real values. Returns false if the frame is corrupt.
+        bool EstimateStats(
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            FrameStats& stats);
+
+        // Brightness, spread and detail of a frame from the block headers alone, for comparing
+        // many frames (scene changes, flicker, picking the sharpest) without decoding them.
+        // Returns false if the frame is corrupt.
+        bool SummarizeBlocks(
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            BlockSummary& summary);
+
+        //
+        // Frames store the headers of their blocks after the pixels. EstimateStats() and
+        // SummarizeBlocks() only read those, so they also take a frame cut down to its first
+        // FRAME_HEADER_SIZE bytes followed by everything from BlockHeadersOffset() on, once
+        // StripPixels() has moved the offsets in the header to match. Reading just these parts
+        // of each frame is what lets them run over a whole take at close to index speed.
+        //
+        const size_t FRAME_HEADER_SIZE = 16;
+
+        namespace detail {
+            // Frame headers are four little endian 32 bit values: encoded width and height, and
+            // the offsets of the bits and refs streams
+            inline uint32_t ReadHeader32(const uint8_t* header, const int offset) {
+                return static_cast<uint32_t>(header[offset])
+                    | (static_cast<uint32_t>(header[offset + 1]) << 8)
+                    | (static_cast<uint32_t>(header[offset + 2]) << 16)
+                    | (static_cast<uint32_t>(header[offset + 3]) << 24);
+            }
+
+            inline void WriteHeader32(uint8_t* header, const int offset, const uint32_t value) {
+                for(int i = 0; i < 4; i++)
+                    header[offset + i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        // Start of the block headers, from the first FRAME_HEADER_SIZE bytes of a frame
+        inline size_t BlockHeadersOffset(const uint8_t* header) {
+            return std::min(detail::ReadHeader32(header, 8), detail::ReadHeader32(header, 12));
+        }
+
+        // Rewrites the header of a cut down frame, see above. BlockHeadersOffset() must be at
+        // least FRAME_HEADER_SIZE.
+        inline void StripPixels(uint8_t* header) {
+            const uint32_t removed = static_cast<uint32_t>(BlockHeadersOffset(header) - FRAME_HEADER_SIZE);
+
+            detail::WriteHeader32(header, 8, detail::ReadHeader32(header, 8) - removed);
+            detail::WriteHeader32(header, 12, detail::ReadHeader32(header, 12) - removed);
+        }
+
+        // 64 bit hash of a whole compressed frame. Frames with the same hash decode to the same
+        // pixels, barring a collision once in 2^64. Never 0.
+        uint64_t HashFrame(const uint8_t* input, const size_t len);
+
+        //
+        // 64 bit hash of the block headers of a frame, so it also takes a frame cut down by
+        // StripPixels() and costs the same I/O as SummarizeBlocks(). Repeated frames (a timelapse
+        // or a camera that duplicated frames to keep its frame rate) always share one; other
+        // frames only do when every block has the same reference and bit width, which sensor
+        // noise all but rules out, but only HashFrame() proves two frames decode the same.
+        // Returns 0 if the frame is corrupt.
+        //
+        uint64_t Fingerprint(const uint8_t* input, const size_t len);
+
+        // Width or height of a frame binned by factor (2 or 4), rounded down to whole 2x2 CFA
+        // quads. 0 for any other factor.
+        inline int BinnedSize(const int size, const int factor) {
+            return factor == 2 || factor == 4 ? 2 * (size / (2 * factor)) : 0;
+        }
+
+        // Decodes a frame binned by factor into output, which must hold BinnedSize(width, factor) x
+        // BinnedSize(height, factor) pixels. Each pixel is the mean of the factor x factor pixels
+        // of the same colour it stands for, so the CFA pattern is kept. Pixels are binned as the
+        // blocks are unpacked and the full frame is never decoded. Returns the number of pixels
+        // written, or 0 if the frame is corrupt.
+        size_t DecodeBinned(
+            uint16_t* output,
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len,
+            const int factor);
+
+        // Bins an already decoded frame the same way as DecodeBinned()
+        void Bin(
+            uint16_t* output,
+            const uint16_t* input,
+            const int width,
+            const int height,
+            const int factor);
+
+        // Checks the frame header and block metadata without decoding any pixels. Decode() does
+        // the same checks first, so this is only needed to reject a frame ahead of time.
+        bool Validate(
+            const int width,
+            const int height,
+            const uint8_t* input,
+            const size_t len);
             
         size_t DecodeLegacy(
             uint16_t* output,
@@ -35,6 +279,12 @@ namespace motioncam {
             const int height,
             const uint8_t* input,
             const size_t len);
+
+        size_t Encode(
+            std::vector<uint8_t>& output,
+            const uint16_t* input,
+            const int width,
+            const int height);
     }
 }
 
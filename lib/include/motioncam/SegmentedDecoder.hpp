@@ -0,0 +1,96 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SegmentedDecoder_hpp
+#define SegmentedDecoder_hpp
+
+#include <motioncam/Decoder.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    // Reads a recording that MotionCam split into numbered segments (clip.0.mcraw, clip.1.mcraw, ...)
+    // as one container. The frames of all segments are merged into a single timestamp ordered list,
+    // container metadata comes from the first segment. A path without a segment number is read as
+    // a single segment.
+    //
+    // Like Decoder this is not thread safe. clone() gives another reader that shares the merged
+    // index and opens its own files.
+    class SegmentedDecoder {
+    public:
+        SegmentedDecoder(const std::string& path);
+
+        // Paths of all segments path belongs to, in order
+        static std::vector<std::string> findSegments(const std::string& path);
+
+        std::unique_ptr<SegmentedDecoder> clone() const;
+
+        const std::string& getContainerMetadata() const;
+
+        std::span<const Timestamp> getFrames() const;
+
+        size_t numSegments() const;
+
+        // See Decoder::findNearestFrame(), outIndex refers to getFrames()
+        bool findNearestFrame(const Timestamp timestamp, const Timestamp tolerance, size_t& outIndex) const;
+
+        // Decoder of the segment a frame belongs to, segments are opened on first use
+        Decoder& decoderFor(const Timestamp timestamp);
+
+        // Same as above with the frame at index in getFrames(), outSegmentIndex is its index in the segment
+        Decoder& decoderFor(const size_t index, size_t& outSegmentIndex);
+
+        void loadFrame(const Timestamp timestamp, uint16_t* outData, int width, int height, int compressionType);
+
+        void loadFrameAt(const size_t index, uint16_t* outData, int width, int height, int compressionType);
+
+        void loadFrameAt(const size_t index, void* outData, int width, int height, int compressionType, const raw::Normalization& normalization, unsigned int numThreads = 1);
+
+        const std::string loadFrameMetadata(const Timestamp timestamp);
+
+        const std::string loadFrameMetadataAt(const size_t index);
+
+        void loadCompressedFrame(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata);
+
+        void loadBlockHeaders(const Timestamp timestamp, std::vector<uint8_t>& outBuffer, std::string& outMetadata);
+
+        // See Decoder::loadCompressedFrames(), each run of frames in the same segment is read in one go
+        void loadCompressedFrames(std::span<const Timestamp> timestamps, const CompressedFrameCallback& onFrame, unsigned int queueDepth = 32);
+
+    private:
+        struct Index {
+            std::vector<std::string> paths;
+            std::string containerMetadata;
+            std::vector<Timestamp> frames;
+            std::vector<uint32_t> frameSegments;
+            std::vector<uint32_t> segmentIndices;
+        };
+
+        SegmentedDecoder(std::shared_ptr<const Index> index);
+
+        Decoder& segment(uint32_t index);
+
+    private:
+        std::shared_ptr<const Index> mIndex;
+        std::vector<std::unique_ptr<Decoder>> mDecoders;
+    };
+} // namespace motioncam
+
+#endif /* SegmentedDecoder_hpp */
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Stats_hpp
+#define Stats_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//
+// Process wide counters and latency histograms for the read/decode/serve pipeline. Everything is
+// off by default, while disabled every call is a relaxed load of one flag and a branch.
+//
+
+namespace motioncam {
+    namespace stats {
+        enum class Stage {
+            Read,       // Reading frames and metadata from the container
+            Decode,     // Uncompressing a frame
+            Render,     // Building the DNG tags of a frame
+            Copy,       // Handing rendered bytes to the reader (FUSE replies)
+            Write,      // Writing files (mcraw-extract)
+            Count
+        };
+
+        enum class Counter {
+            CacheHits,
+            CacheMisses,
+            CacheEvictions,
+            RepeatedFrames,
+            BytesRead,
+            BytesServed,
+            Count
+        };
+
+        enum class Gauge {
+            RendersInFlight,
+            DecodeQueue,
+            WriteQueue,
+            Count
+        };
+
+        struct Latency {
+            uint64_t count = 0;
+            uint64_t totalNs = 0;
+            uint64_t maxNs = 0;
+
+            // From the histogram, within 25% of the real value
+            uint64_t p50Ns = 0;
+            uint64_t p90Ns = 0;
+            uint64_t p99Ns = 0;
+        };
+
+        struct GaugeValue {
+            int64_t current = 0;
+            int64_t max = 0;
+        };
+
+        struct Snapshot {
+            bool enabled = false;
+
+            // Since stats were enabled or last reset
+            double seconds = 0;
+
+            Latency stages[static_cast<size_t>(Stage::Count)];
+            uint64_t counters[static_cast<size_t>(Counter::Count)] = {};
+            GaugeValue gauges[static_cast<size_t>(Gauge::Count)];
+        };
+
+        namespace detail {
+            extern std::atomic<bool> gEnabled;
+
+            void Record(Stage stage, uint64_t nanoseconds);
+            void Add(Counter counter, uint64_t value);
+            void AddGauge(Gauge gauge, int64_t delta);
+            void SetGauge(Gauge gauge, int64_t value);
+        }
+
+        inline bool Enabled() {
+            return detail::gEnabled.load(std::memory_order_relaxed);
+        }
+
+        void SetEnabled(bool enabled);
+
+        void Reset();
+
+        Snapshot TakeSnapshot();
+
+        std::string ToJson(const Snapshot& snapshot);
+
+        const char* Name(Stage stage);
+        const char* Name(Counter counter);
+        const char* Name(Gauge gauge);
+
+        inline void Record(Stage stage, uint64_t nanoseconds) {
+            if(Enabled())
+                detail::Record(stage, nanoseconds);
+        }
+
+        inline void Add(Counter counter, uint64_t value = 1) {
+            if(Enabled())
+                detail::Add(counter, value);
+        }
+
+        inline void AddGauge(Gauge gauge, int64_t delta) {
+            if(Enabled())
+                detail::AddGauge(gauge, delta);
+        }
+
+        inline void SetGauge(Gauge gauge, int64_t value) {
+            if(Enabled())
+                detail::SetGauge(gauge, value);
+        }
+
+        // Records the time until the end of the scope, the clock is only read when stats are enabled
+        class ScopedTimer {
+        public:
+            explicit ScopedTimer(Stage stage) : mStage(stage), mEnabled(Enabled()) {
+                if(mEnabled)
+                    mStart = std::chrono::steady_clock::now();
+            }
+
+            ~ScopedTimer() {
+                if(mEnabled) {
+                    const auto elapsed = std::chrono::steady_clock::now() - mStart;
+                    detail::Record(mStage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+                }
+            }
+
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        private:
+            const Stage mStage;
+            const bool mEnabled;
+            std::chrono::steady_clock::time_point mStart;
+        };
+    } // namespace stats
+} // namespace motioncam
+
+#endif /* Stats_hpp */
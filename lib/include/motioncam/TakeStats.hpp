@@ -0,0 +1,98 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TakeStats_hpp
+#define TakeStats_hpp
+
+#include <motioncam/Metadata.hpp>
+#include <motioncam/RawData.hpp>
+#include <motioncam/SegmentedDecoder.hpp>
+
+#include <string>
+#include <vector>
+
+namespace motioncam {
+    struct TakeStatsOptions {
+        // Decode every frame for exact statistics instead of estimating them from the block
+        // headers (see raw::EstimateStats()). Legacy frames are always decoded.
+        bool exact = false;
+
+        // Number of worker threads, 0 uses all available cores
+        unsigned int numWorkers = 0;
+
+        // Maximum number of frames read ahead of the workers
+        size_t queueDepth = 8;
+    };
+
+    struct FrameStatsEntry {
+        Timestamp timestamp = 0;
+
+        // False if the statistics were estimated from the block headers
+        bool exact = false;
+
+        raw::FrameStats stats;
+    };
+
+    struct FrameSummaryEntry {
+        Timestamp timestamp = 0;
+
+        // False for frames without block headers (the legacy format), which are left at zero
+        bool valid = false;
+
+        // Mean of the frame from black (0) to white (1)
+        float brightness = 0;
+
+        // Stops between the shadows and highlights of the blocks above the black level
+        float dynamicRange = 0;
+
+        raw::BlockSummary blocks;
+
+        // See Decoder::fingerprint(), set for every frame. Frames that share one are repeats.
+        uint64_t fingerprint = 0;
+    };
+
+    //
+    // Exposure statistics of every frame of a take, for QC without opening the frames. Frames
+    // are read on the calling thread and decoded (or estimated) on the workers. Clipping is
+    // counted at the white level and the histograms cover [0, whiteLevel].
+    //
+    std::vector<FrameStatsEntry> CollectTakeStats(SegmentedDecoder& decoder, const TakeStatsOptions& options = {});
+
+    // One line per frame: index, timestamp, whether the statistics are exact and the min, max,
+    // mean and clipped fraction of each colour of the CFA, named after sensorArrangement
+    std::string TakeStatsToCsv(const std::vector<FrameStatsEntry>& frames, const ContainerMetadata& metadata);
+
+    // Same as the CSV with the histogram of each colour
+    std::string TakeStatsToJson(const std::vector<FrameStatsEntry>& frames, const ContainerMetadata& metadata);
+
+    //
+    // Brightness, dynamic range and detail (see raw::BlockSummary) of every frame of a take from
+    // the block headers alone. Only those are read from disk, so this runs at close to the speed
+    // of reading the index, for finding scene changes, flicker, repeated frames or the sharpest
+    // frames of a take. options.exact is ignored.
+    //
+    std::vector<FrameSummaryEntry> SummarizeTake(SegmentedDecoder& decoder, const TakeStatsOptions& options = {});
+
+    // Index of the first frame with the same fingerprint as each frame, the frame itself for the
+    // first of each
+    std::vector<size_t> FindRepeatedFrames(const std::vector<FrameSummaryEntry>& frames);
+
+    // One line per frame: index, timestamp, brightness, dynamic range, detail, shadows,
+    // highlights, fingerprint and the first frame it repeats (empty for the first of each)
+    std::string TakeSummaryToCsv(const std::vector<FrameSummaryEntry>& frames);
+} // namespace motioncam
+
+#endif /* TakeStats_hpp */
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Trace_hpp
+#define Trace_hpp
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+//
+// Timeline of what every thread was doing, for seeing overlap and stalls when many frames are
+// read at once. Events go into a ring buffer per thread, so only the most recent ones are kept,
+// and are dumped in the Chrome trace event format that chrome://tracing and Perfetto open.
+// Off by default, while disabled every call is a relaxed load of one flag and a branch.
+//
+
+namespace motioncam {
+    namespace trace {
+        // Events recorded per thread before the oldest are overwritten
+        const size_t EVENTS_PER_THREAD = 1 << 14;
+
+        namespace detail {
+            extern std::atomic<bool> gEnabled;
+
+            // Frame of the innermost event with one on this thread, -1 if none
+            extern thread_local int64_t gCurrentFrame;
+
+            int64_t Now();
+            void Record(const char* name, int64_t startNs, int64_t endNs, int64_t frame);
+        }
+
+        inline bool Enabled() {
+            return detail::gEnabled.load(std::memory_order_relaxed);
+        }
+
+        // Enabling starts a new trace
+        void SetEnabled(bool enabled);
+
+        // Drops all recorded events
+        void Reset();
+
+        // Shown as the name of the calling thread, ignored while tracing is disabled
+        void SetThreadName(const std::string& name);
+
+        std::string ToJson();
+
+        // Records an event that started at startNs (from Now()), for work that doesn't fit a scope
+        inline void Record(const char* name, int64_t startNs, int64_t frame = -1) {
+            if(Enabled())
+                detail::Record(name, startNs, detail::Now(), frame < 0 ? detail::gCurrentFrame : frame);
+        }
+
+        inline int64_t Now() {
+            return Enabled() ? detail::Now() : 0;
+        }
+
+        //
+        // Records an event from construction to the end of the scope. name has to outlive the
+        // trace (a string literal). Events without a frame take the frame of the event they are
+        // nested in, so decoding inside a frame load is tagged with that frame.
+        //
+        class ScopedEvent {
+        public:
+            explicit ScopedEvent(const char* name, int64_t frame = -1) : mName(name), mEnabled(Enabled()), mStart(0), mFrame(-1), mPreviousFrame(-1) {
+                if(mEnabled) {
+                    mPreviousFrame = detail::gCurrentFrame;
+                    mFrame = frame < 0 ? mPreviousFrame : frame;
+
+                    detail::gCurrentFrame = mFrame;
+                    mStart = detail::Now();
+                }
+            }
+
+            ~ScopedEvent() {
+                if(mEnabled) {
+                    detail::Record(mName, mStart, detail::Now(), mFrame);
+                    detail::gCurrentFrame = mPreviousFrame;
+                }
+            }
+
+            ScopedEvent(const ScopedEvent&) = delete;
+            ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+        private:
+            const char* mName;
+            const bool mEnabled;
+            int64_t mStart;
+            int64_t mFrame;
+            int64_t mPreviousFrame;
+        };
+    } // namespace trace
+} // namespace motioncam
+
+#endif /* Trace_hpp */
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2023 MotionCam
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef Transcoder_hpp
+#define Transcoder_hpp
+
+#include <functional>
+#include <string>
+
+namespace motioncam {
+    struct TranscodeOptions {
+        // Number of decode/encode workers, 0 uses all available cores
+        unsigned int numWorkers = 0;
+
+        // Maximum number of frames in flight between each pipeline stage
+        size_t queueDepth = 8;
+
+        // Called from the writing thread after each frame is written
+        std::function<void(size_t framesWritten, size_t totalFrames)> progress;
+    };
+
+    // Converts a container with legacy (type 6) compressed frames into the current (type 7) bitstream.
+    // Reading, decoding/encoding and writing run concurrently. Container metadata and audio are
+    // copied unchanged, frame metadata only has its compressionType updated. Frames that are
+    // already type 7 are copied as is.
+    void Transcode(const std::string& inputPath, const std::string& outputPath, const TranscodeOptions& options = {});
+} // namespace motioncam
+
+#endif /* Transcoder_hpp */
@@ -18,7 +18,6 @@
 #include <fstream>
 #include <iostream>
 #include <sstream>
-#include <swift/bridging>
 
 namespace tinydngwriter {
 
@@ -466,6 +465,48 @@ bool DNGImage::SetBitsPerSample() {
   return true;
 }
 
+bool DNGImage::SetBitsPerSample(const unsigned int num_samples,
+                                const unsigned short *values) {
+  if (samples_per_pixels_ == 0) {
+    err_ += "SetSamplesPerPixel() must be called before SetBitsPerSample().\n";
+    return false;
+  }
+
+  if ((num_samples == 0) || (num_samples != samples_per_pixels_)) {
+    std::stringstream ss;
+    ss << "Samples per pixel mismatch. " << num_samples << " is given for SetBitsPerSample(), but SamplesPerPixel is set to " << samples_per_pixels_ << "\n";
+    err_ += ss.str();
+    return false;
+  }
+
+  std::vector<unsigned short> vs(values, values + num_samples);
+
+  for (size_t i = 0; i < vs.size(); i++) {
+    if (vs[i] != values[0]) {
+      err_ += "BitsPerSample must be same among samples at the moment.\n";
+      return false;
+    }
+
+    if (swap_endian_) {
+      swap2(&vs[i]);
+    }
+  }
+
+  bool ret = WriteTIFFTag(static_cast<unsigned short>(TIFFTAG_BITS_PER_SAMPLE),
+                          TIFF_SHORT, num_samples,
+                          reinterpret_cast<const unsigned char *>(vs.data()),
+                          &ifd_tags_, &data_os_);
+
+  if (!ret) {
+    return false;
+  }
+
+  bits_per_samples_.assign(values, values + num_samples);
+
+  num_fields_++;
+  return true;
+}
+
 bool DNGImage::SetPhotometric(const unsigned short value) {
   if ((value == PHOTOMETRIC_LINEARRAW) ||
       (value == PHOTOMETRIC_CFA) ||
@@ -980,6 +1021,26 @@ bool DNGImage::SetActiveArea(std::vector<uint32_t> values) {
   return true;
 }
 
+bool DNGImage::SetOpcodeList1(const std::vector<uint8_t> &data) {
+  if (data.size() <= 4) {
+    err_ += "Opcode list must hold at least one opcode.\n";
+    return false;
+  }
+
+  // Bytes, so nothing to swap
+  bool ret = WriteTIFFTag(
+      static_cast<unsigned short>(TIFFTAG_OPCODE_LIST1), TIFF_UNDEFINED,
+      static_cast<unsigned int>(data.size()), data.data(), &ifd_tags_,
+      &data_os_);
+
+  if (!ret) {
+    return false;
+  }
+
+  num_fields_++;
+  return true;
+}
+
 bool DNGImage::SetDNGVersion(const unsigned char a,
                              const unsigned char b,
                              const unsigned char c,
@@ -1478,6 +1539,43 @@ static bool IFDComparator(const IFDTag &a, const IFDTag &b) {
   return (a.tag < b.tag);
 }
 
+bool DNGImage::SetImageDataSize(const unsigned int bytes) {
+  if (bytes < 1) {
+    return false;
+  }
+
+  // Image data isn't part of data_os_, so there is nothing to endian swap
+  data_strip_offset_ = 0;
+  data_strip_bytes_ = 0;
+  image_data_size_ = bytes;
+
+  {
+    unsigned int count = 1;
+
+    bool ret = WriteTIFFTag(
+        static_cast<unsigned short>(TIFFTAG_STRIP_BYTE_COUNTS), TIFF_LONG,
+        count, reinterpret_cast<const unsigned char *>(&bytes), &ifd_tags_,
+        NULL);
+
+    if (!ret) {
+      return false;
+    }
+
+    num_fields_++;
+  }
+
+  return true;
+}
+
+bool DNGImage::SetSubIFDOffset(const unsigned int offset) {
+  if (offset == 0) {
+    return false;
+  }
+
+  sub_ifd_offset_ = offset;
+  return true;
+}
+
 bool DNGImage::WriteDataToStream(std::ostream *ofs) const {
   if ((data_os_.str().length() == 0)) {
     err_ += "Empty IFD data and image data.\n";
@@ -1570,6 +1668,16 @@ bool DNGImage::WriteIFDToStream(const unsigned int data_base_offset,
     tags.push_back(ifd);
   }
 
+  // Same for SUB_IFDS, the SubIFD is written after this one
+  if (sub_ifd_offset_ != 0) {
+    IFDTag ifd;
+    ifd.tag = TIFFTAG_SUB_IFDS;
+    ifd.type = TIFF_LONG;
+    ifd.count = 1;
+    ifd.offset_or_value = sub_ifd_offset_;
+    tags.push_back(ifd);
+  }
+
   // TIFF expects IFD tags are sorted.
   std::sort(tags.begin(), tags.end(), IFDComparator);
 
@@ -1691,6 +1799,162 @@ const char* DNGWriter::WriteToFile(DNGImage *image,
   return out;
 }
 
+bool DNGWriter::WriteHeader(DNGImage *image, std::string *err,
+                            std::vector<uint8_t> *out,
+                            unsigned int *strip_offset) const {
+  std::ostringstream ofs;
+  std::ostringstream header;
+  if (! WriteTIFFVersionHeader(&header, dng_big_endian_)) {
+    if (err) *err = "Failed to write TIFF version header.\n";
+    return false;
+  }
+
+  const size_t data_size = image->GetDataSize();
+  const unsigned int ifd_offset =
+    kHeaderSize + static_cast<unsigned int>(data_size);
+
+  Write4(ifd_offset, &header, swap_endian_);
+
+  // The image data follows the IFD, so its offset depends on the IFD size
+  std::ostringstream ifd;
+  if (! image->WriteIFDToStream(0, 0, &ifd)) {
+    if (err) {
+      *err  = "Failed to write IFD: ";
+      *err += image->Error();
+    }
+    return false;
+  }
+
+  // IFD + next IFD offset, image data 16 byte aligned
+  const size_t ifd_end = ifd_offset + ifd.str().length() + 4;
+  const size_t padded_end = (ifd_end + 15) & ~size_t(15);
+
+  ofs.write(header.str().c_str(),
+            static_cast<std::streamsize>(header.str().length()));
+
+  if (! image->WriteDataToStream(&ofs)) {
+    if (err) {
+      *err  = "Failed to write image data: ";
+      *err += image->Error();
+    }
+    return false;
+  }
+
+  if (! image->WriteIFDToStream(
+         0,
+         static_cast<unsigned int>(padded_end - kHeaderSize),
+         &ofs)) {
+    if (err) {
+      *err  = "Failed to write IFD: ";
+      *err += image->Error();
+    }
+    return false;
+  }
+
+  for (size_t i = ifd_end - 4; i < padded_end; i++) {
+    Write1(0, &ofs);
+  }
+
+  const std::string out_str = ofs.str();
+  assert(out_str.size() == padded_end);
+
+  out->assign(out_str.begin(), out_str.end());
+  *strip_offset = static_cast<unsigned int>(padded_end);
+
+  return true;
+}
+
+bool DNGWriter::WriteHeader(DNGImage *preview, DNGImage *image,
+                            std::string *err,
+                            std::vector<uint8_t> *out,
+                            unsigned int *preview_offset,
+                            unsigned int *strip_offset) const {
+  std::ostringstream ofs;
+  std::ostringstream header;
+  if (! WriteTIFFVersionHeader(&header, dng_big_endian_)) {
+    if (err) *err = "Failed to write TIFF version header.\n";
+    return false;
+  }
+
+  // Header, tag data of both IFDs, IFD0, the SubIFD, preview data, image data
+  const size_t preview_data_size = preview->GetDataSize();
+  const size_t data_size = preview_data_size + image->GetDataSize();
+  const unsigned int ifd_offset =
+    kHeaderSize + static_cast<unsigned int>(data_size);
+
+  Write4(ifd_offset, &header, swap_endian_);
+
+  // IFD sizes only depend on the number of tags, measure them with
+  // placeholder offsets
+  std::ostringstream ifd;
+  std::ostringstream sub_ifd;
+
+  preview->SetSubIFDOffset(1);
+
+  if (! preview->WriteIFDToStream(0, 0, &ifd) ||
+      ! image->WriteIFDToStream(0, 0, &sub_ifd)) {
+    if (err) {
+      *err  = "Failed to write IFD: ";
+      *err += preview->Error() + image->Error();
+    }
+    return false;
+  }
+
+  const size_t sub_ifd_offset = ifd_offset + ifd.str().length() + 4;
+  const size_t preview_start = sub_ifd_offset + sub_ifd.str().length() + 4;
+  const size_t preview_end = preview_start + preview->GetImageDataSize();
+  const size_t padded_end = (preview_end + 15) & ~size_t(15);
+
+  preview->SetSubIFDOffset(static_cast<unsigned int>(sub_ifd_offset));
+
+  ofs.write(header.str().c_str(),
+            static_cast<std::streamsize>(header.str().length()));
+
+  if (! preview->WriteDataToStream(&ofs) || ! image->WriteDataToStream(&ofs)) {
+    if (err) {
+      *err  = "Failed to write image data: ";
+      *err += preview->Error() + image->Error();
+    }
+    return false;
+  }
+
+  // Tag data offsets of the SubIFD start after the preview's tag data
+  if (! preview->WriteIFDToStream(
+         0,
+         static_cast<unsigned int>(preview_start - kHeaderSize),
+         &ofs)) {
+    if (err) {
+      *err  = "Failed to write IFD: ";
+      *err += preview->Error();
+    }
+    return false;
+  }
+
+  Write4(0, &ofs, swap_endian_);
+
+  if (! image->WriteIFDToStream(
+         static_cast<unsigned int>(preview_data_size),
+         static_cast<unsigned int>(padded_end - kHeaderSize),
+         &ofs)) {
+    if (err) {
+      *err  = "Failed to write IFD: ";
+      *err += image->Error();
+    }
+    return false;
+  }
+
+  Write4(0, &ofs, swap_endian_);
+
+  const std::string out_str = ofs.str();
+  assert(out_str.size() == preview_start);
+
+  out->assign(out_str.begin(), out_str.end());
+  *preview_offset = static_cast<unsigned int>(preview_start);
+  *strip_offset = static_cast<unsigned int>(padded_end);
+
+  return true;
+}
+
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
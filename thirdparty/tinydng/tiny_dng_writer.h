@@ -31,7 +31,12 @@ THE SOFTWARE.
 
 #include <sstream>
 #include <vector>
+
+#if __has_include(<swift/bridging>)
 #include <swift/bridging>
+#else
+#define SWIFT_RETURNS_INDEPENDENT_VALUE
+#endif
 
 #ifndef ROL32
 #define ROL32(v,a) ((v) << (a) | (v) >> (32-(a)))
@@ -123,6 +128,8 @@ typedef enum {
 
   TIFFTAG_SOFTWARE = 305,
 
+  TIFFTAG_SUB_IFDS = 330,
+
   TIFFTAG_SAMPLEFORMAT = 339,
 
   // DNG extension
@@ -157,6 +164,8 @@ typedef enum {
   TIFFTAG_ACTIVE_AREA = 50829,
   TIFFTAG_FORWARD_MATRIX1 = 50964,
   TIFFTAG_FORWARD_MATRIX2 = 50965,
+  TIFFTAG_PREVIEW_COLOR_SPACE = 50970,
+  TIFFTAG_OPCODE_LIST1 = 51008,
 
   // CinemaDNG specific
   TIFFTAG_TIMECODE = 51043,
@@ -234,6 +243,8 @@ class DNGImage {
   bool SetSamplesPerPixel(unsigned short value);
   // Set bits for each samples
   bool SetBitsPerSample();
+  bool SetBitsPerSample(const unsigned int num_samples,
+                        const unsigned short *values);
   bool SetPhotometric(unsigned short value);
   bool SetPlanarConfig(unsigned short value);
   bool SetOrientation(unsigned short value);
@@ -269,6 +280,10 @@ class DNGImage {
 
   bool SetActiveArea(std::vector<uint32_t> values);
 
+  /// Opcodes applied to the raw image as read from the file. `data` is the
+  /// whole list in the big endian layout of the DNG specification.
+  bool SetOpcodeList1(const std::vector<uint8_t> &data);
+
   bool SetChromaBlurRadius(float value);
 
   /// Specify black level per sample.
@@ -322,6 +337,14 @@ class DNGImage {
   /// Set image data.
   bool SetImageData(const std::vector<uint8_t> *imageData);
 
+  /// Set the size of image data that the caller appends after the output of
+  /// DNGWriter::WriteHeader() instead of passing it to SetImageData().
+  bool SetImageDataSize(const unsigned int bytes);
+
+  /// Point the SubIFDs tag at a single IFD at `offset` in the file.
+  /// DNGWriter::WriteHeader() with a preview sets this itself.
+  bool SetSubIFDOffset(const unsigned int offset);
+
   /// Set custom field.
   bool SetCustomFieldLong(const unsigned short tag, const int value);
   bool SetCustomFieldULong(const unsigned short tag, const unsigned int value);
@@ -330,6 +353,7 @@ class DNGImage {
 
   size_t GetStripOffset() const { return data_strip_offset_; }
   size_t GetStripBytes() const { return data_strip_bytes_; }
+  size_t GetImageDataSize() const { return image_data_size_; }
 
   /// Write aux IFD data and strip image data to stream.
   bool WriteDataToStream(std::ostream *ofs) const;
@@ -359,6 +383,12 @@ class DNGImage {
   size_t data_strip_offset_{0};
   size_t data_strip_bytes_{0};
 
+  // Set by SetImageDataSize()
+  size_t image_data_size_{0};
+
+  // 0 = no SubIFDs tag
+  unsigned int sub_ifd_offset_{0};
+
   mutable std::string err_;  // Error message
 
   std::vector<IFDTag> ifd_tags_;
@@ -376,6 +406,23 @@ class DNGWriter {
                                        std::string  *err,
                             unsigned long *count) const SWIFT_RETURNS_INDEPENDENT_VALUE;
 
+    /// Write everything but the image data of a DNG whose data size was set
+    /// with SetImageDataSize(). The image data goes at `*strip_offset` in the
+    /// file, right after what is written to `out`, in the DNG's byte order.
+    bool WriteHeader(DNGImage *image, std::string *err,
+                     std::vector<uint8_t> *out,
+                     unsigned int *strip_offset) const;
+
+    /// Same as above with `preview` as IFD0 and `image` as its SubIFD. Both
+    /// have their data size set with SetImageDataSize(). The preview data
+    /// goes at `*preview_offset`, which is `out->size()`, and the image data
+    /// at `*strip_offset`, 16 byte aligned after the preview. Whatever is
+    /// between the two is padding.
+    bool WriteHeader(DNGImage *preview, DNGImage *image, std::string *err,
+                     std::vector<uint8_t> *out,
+                     unsigned int *preview_offset,
+                     unsigned int *strip_offset) const;
+
  private:
   bool swap_endian_;
   bool dng_big_endian_;  // Endianness of DNG file.
@@ -0,0 +1,110 @@
+#include <motioncam/Extractor.hpp>
+#include <motioncam/Decoder.hpp>
+#include <motioncam/Stats.hpp>
+#include <motioncam/Trace.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    void usage(const char* name) {
+        std::fprintf(stderr, "Usage: %s [-j workers] [-w writers] [-q depth] [-r depth] [-p preview size] [-d defect frames] [--buffered] [--stats] [--trace file.json] <input.mcraw> <output dir>\n", name);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    motioncam::ExtractOptions options;
+    std::string paths[2];
+    std::string tracePath;
+    int numPaths = 0;
+
+    for(int i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+
+        if(arg == "-j" && i + 1 < argc) {
+            options.numWorkers = static_cast<unsigned int>(std::atoi(argv[++i]));
+        }
+        else if(arg == "-w" && i + 1 < argc) {
+            options.numWriters = static_cast<unsigned int>(std::atoi(argv[++i]));
+        }
+        else if(arg == "-q" && i + 1 < argc) {
+            options.queueDepth = static_cast<size_t>(std::atoi(argv[++i]));
+        }
+        else if(arg == "-r" && i + 1 < argc) {
+            options.readDepth = static_cast<unsigned int>(std::atoi(argv[++i]));
+        }
+        else if(arg == "-p" && i + 1 < argc) {
+            options.previewSize = std::atoi(argv[++i]);
+        }
+        else if(arg == "-d" && i + 1 < argc) {
+            options.defectPixelOptions.numFrames = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+            options.defectPixels = options.defectPixelOptions.numFrames > 0;
+        }
+        else if(arg == "--buffered") {
+            options.directIO = false;
+        }
+        else if(arg == "--stats") {
+            motioncam::stats::SetEnabled(true);
+        }
+        else if(arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+            motioncam::trace::SetEnabled(true);
+        }
+        else if(numPaths < 2 && !arg.empty() && arg[0] != '-') {
+            paths[numPaths++] = arg;
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(numPaths != 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    options.progress = [](const motioncam::ExtractProgress& progress) {
+        const double seconds = progress.seconds > 0 ? progress.seconds : 1e-9;
+
+        std::fprintf(stderr, "\r%zu/%zu frames, %.1f frames/s, %.1f MB/s",
+            progress.framesWritten,
+            progress.totalFrames,
+            progress.framesWritten / seconds,
+            progress.bytesWritten / seconds / (1024.0 * 1024.0));
+
+        if(progress.framesWritten == progress.totalFrames)
+            std::fprintf(stderr, "\n");
+    };
+
+    try {
+        motioncam::Extract(paths[0], paths[1], options);
+    }
+    catch(const std::exception& e) {
+        std::fprintf(stderr, "\nError: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    if(motioncam::stats::Enabled())
+        std::fprintf(stderr, "%s", motioncam::stats::ToJson(motioncam::stats::TakeSnapshot()).c_str());
+
+    if(!tracePath.empty()) {
+        const std::string json = motioncam::trace::ToJson();
+        FILE* file = std::fopen(tracePath.c_str(), "wb");
+
+        if(!file || std::fwrite(json.data(), 1, json.size(), file) != json.size()) {
+            std::fprintf(stderr, "Error: failed to write %s\n", tracePath.c_str());
+
+            if(file)
+                std::fclose(file);
+
+            return EXIT_FAILURE;
+        }
+
+        std::fclose(file);
+    }
+
+    return EXIT_SUCCESS;
+}
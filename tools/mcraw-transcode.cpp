@@ -0,0 +1,54 @@
+#include <motioncam/Transcoder.hpp>
+#include <motioncam/Decoder.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+    void usage(const char* name) {
+        std::fprintf(stderr, "Usage: %s [-j workers] <input.mcraw> <output.mcraw>\n", name);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    motioncam::TranscodeOptions options;
+    std::string paths[2];
+    int numPaths = 0;
+
+    for(int i = 1; i < argc; i++) {
+        const std::string arg(argv[i]);
+
+        if(arg == "-j" && i + 1 < argc) {
+            options.numWorkers = static_cast<unsigned int>(std::atoi(argv[++i]));
+        }
+        else if(numPaths < 2 && !arg.empty() && arg[0] != '-') {
+            paths[numPaths++] = arg;
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if(numPaths != 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    options.progress = [](size_t framesWritten, size_t totalFrames) {
+        std::fprintf(stderr, "\r%zu/%zu frames", framesWritten, totalFrames);
+        if(framesWritten == totalFrames)
+            std::fprintf(stderr, "\n");
+    };
+
+    try {
+        motioncam::Transcode(paths[0], paths[1], options);
+    }
+    catch(const std::exception& e) {
+        std::fprintf(stderr, "\nError: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}